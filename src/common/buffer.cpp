@@ -10,6 +10,7 @@
 // std
 #include <cassert>
 #include <cstring>
+#include <stdexcept>
 
 /**
  * Returns the minimum instance size required to be compatible with devices minOffsetAlignment
@@ -40,14 +41,88 @@ Buffer::Buffer(Device &device,
 {
     alignmentSize_ = getAlignment(instanceSize, minOffsetAlignment);
     bufferSize_ = alignmentSize_ * instanceCount;
-    device.createBuffer(bufferSize_, usageFlags, memoryPropertyFlags, buffer_, memory_);
+
+    // Memory the host never maps is sub-allocated from shared blocks, which keeps the number of
+    // vkAllocateMemory calls low and lets the Defragmenter move the buffer later on.
+    const bool hostVisible = memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    if ((memoryPropertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) && !hostVisible)
+    {
+        createSubAllocatedBuffer();
+    }
+    else
+    {
+        device.createBuffer(bufferSize_, usageFlags, memoryPropertyFlags, buffer_, memory_);
+    }
+
+    updateDeviceAddress();
 }
 
 Buffer::~Buffer()
 {
     unmap();
     vkDestroyBuffer(device_.device(), buffer_, nullptr);
-    vkFreeMemory(device_.device(), memory_, nullptr);
+    if (subAllocated_)
+    {
+        device_.memoryAllocator().free(allocation_);
+    }
+    else
+    {
+        vkFreeMemory(device_.device(), memory_, nullptr);
+    }
+}
+
+void Buffer::createSubAllocatedBuffer()
+{
+    // Sub-allocated buffers may be relocated with vkCmdCopyBuffer, so they can be copied from and to.
+    usageFlags_ |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    buffer_ = device_.createBufferHandle(bufferSize_, usageFlags_);
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device_.device(), buffer_, &memRequirements);
+
+    allocation_ = device_.memoryAllocator().allocate(memRequirements, memoryPropertyFlags_, this);
+    memory_ = allocation_.memory;
+    subAllocated_ = true;
+
+    vkBindBufferMemory(device_.device(), buffer_, allocation_.memory, allocation_.offset);
+}
+
+void Buffer::updateDeviceAddress()
+{
+    if (usageFlags_ & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)
+    {
+        VkBufferDeviceAddressInfo addressInfo{};
+        addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+        addressInfo.buffer = buffer_;
+        deviceAddress_ = vkGetBufferDeviceAddress(device_.device(), &addressInfo);
+        if (deviceAddress_ == 0)
+        {
+            throw std::runtime_error("failed to get buffer device address!");
+        }
+    }
+}
+
+/**
+ * Switches the buffer over to a new VkBuffer bound to a different allocation
+ *
+ * @param binding Buffer handle and allocation holding a copy of this buffer's contents
+ *
+ * @return The previous binding, to be destroyed once no in-flight frame references it
+ */
+Buffer::Binding Buffer::rebind(const Binding &binding)
+{
+    assert(subAllocated_ && "Only sub-allocated buffers can be rebound");
+    assert(binding.allocation.size >= bufferSize_ && "Relocated allocation is too small");
+
+    Binding previous{buffer_, allocation_};
+
+    buffer_ = binding.buffer;
+    allocation_ = binding.allocation;
+    memory_ = allocation_.memory;
+    device_.memoryAllocator().setOwner(allocation_, this);
+    updateDeviceAddress();
+
+    return previous;
 }
 
 /**
@@ -0,0 +1,285 @@
+#include "command_recorder.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+CommandRecorder::CommandRecorder(Device &device, uint32_t framesInFlight, WorkerPool *workers, uint32_t threadCount)
+  : device_{device}, workers_{workers}
+{
+    if (threadCount < 1)
+    {
+        throw std::runtime_error("command recorder needs at least one thread!");
+    }
+    threadCount = workers_ == nullptr ? 1 : std::min(threadCount, workers_->getThreadCount());
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = device_.findPhysicalQueueFamilies().graphicsFamily;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    pools_.resize(threadCount, std::vector<ThreadPool>(framesInFlight));
+    for (auto &threadPools : pools_)
+    {
+        for (auto &pool : threadPools)
+        {
+            if (vkCreateCommandPool(device_.device(), &poolInfo, nullptr, &pool.pool) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create recording command pool!");
+            }
+        }
+    }
+
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    if (vkCreateCommandPool(device_.device(), &poolInfo, nullptr, &cachePool_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create recording command pool!");
+    }
+    cachedPasses_.resize(framesInFlight);
+
+    ranges_.reserve(threadCount);
+    secondaries_.reserve(threadCount);
+}
+
+CommandRecorder::~CommandRecorder()
+{
+    // Destroying a pool frees its command buffers
+    for (auto &threadPools : pools_)
+    {
+        for (auto &pool : threadPools)
+        {
+            vkDestroyCommandPool(device_.device(), pool.pool, nullptr);
+        }
+    }
+    vkDestroyCommandPool(device_.device(), cachePool_, nullptr);
+}
+
+/**
+ * Recycles the command buffers of the frame slot. The frame that last used the slot must have completed.
+ *
+ * @param frameIndex Frame slot of the frame that is about to be recorded
+ */
+void CommandRecorder::beginFrame(int frameIndex)
+{
+    assert(!inPass_ && "Can't begin a frame inside of a pass");
+    frameIndex_ = frameIndex;
+    for (auto &threadPools : pools_)
+    {
+        auto &pool = threadPools[frameIndex_];
+        if (pool.used > 0)
+        {
+            vkResetCommandPool(device_.device(), pool.pool, 0);
+            pool.used = 0;
+        }
+    }
+}
+
+void CommandRecorder::beginPass(const PassInheritance &inheritance)
+{
+    assert(!inPass_ && "Pass already begun");
+    inheritance_ = inheritance;
+    inPass_ = true;
+}
+
+void CommandRecorder::endPass()
+{
+    assert(inPass_ && "No pass begun");
+    inPass_ = false;
+}
+
+/**
+ * Records count items on up to getThreadCount() threads and executes the secondary command buffers in
+ * order. Returns once all of them are recorded.
+ *
+ * @param primary Command buffer of the frame, inside of the pass begun for secondary command buffers
+ * @param count Number of items
+ * @param recordRange Called once per range, concurrently from different threads
+ */
+void CommandRecorder::record(VkCommandBuffer primary, size_t count, const RecordRange &recordRange)
+{
+    assert(inPass_ && "Secondary command buffers are only recorded inside of a pass");
+    if (count == 0)
+    {
+        return;
+    }
+
+    const size_t maxRanges = (count + MIN_ITEMS_PER_RANGE - 1) / MIN_ITEMS_PER_RANGE;
+    const size_t rangeCount = std::min<size_t>(getThreadCount(), maxRanges);
+    ranges_.clear();
+    for (size_t i = 0; i < rangeCount; i++)
+    {
+        ranges_.push_back({count * i / rangeCount, count * (i + 1) / rangeCount});
+    }
+    secondaries_.assign(rangeCount, VK_NULL_HANDLE);
+    const auto recordThreadRange = [&](uint32_t thread) {
+        secondaries_[thread] = recordSecondary(thread, ranges_[thread], recordRange);
+    };
+    if (rangeCount == 1)
+    {
+        recordThreadRange(0);
+    }
+    else
+    {
+        workers_->run(static_cast<uint32_t>(rangeCount), recordThreadRange);
+    }
+
+    vkCmdExecuteCommands(primary, static_cast<uint32_t>(secondaries_.size()), secondaries_.data());
+}
+
+/**
+ * Executes the commands cached for the frame slot, if they were recorded for sceneVersion and a pass like
+ * the current one. The frame slot's previous frames have to have used the same per-frame resources.
+ *
+ * @param primary Command buffer of the frame, inside of the pass begun for secondary command buffers
+ * @param sceneVersion Changes whenever the recorded draws would
+ * @return False if the pass has to be recorded with recordCached() instead
+ */
+bool CommandRecorder::replayCached(VkCommandBuffer primary, uint64_t sceneVersion)
+{
+    assert(inPass_ && "Secondary command buffers are only executed inside of a pass");
+    const auto &cached = cachedPasses_[frameIndex_];
+    if (!cached.valid || cached.sceneVersion != sceneVersion || !isCacheCompatible(cached.inheritance))
+    {
+        return false;
+    }
+    vkCmdExecuteCommands(primary, 1, &cached.commandBuffer);
+    return true;
+}
+
+/**
+ * Records count items into the frame slot's cached command buffer on the calling thread and executes it.
+ * Re-recording is rare, so it isn't split across threads. The framebuffer isn't inherited, so the commands
+ * replay on every image of the target.
+ *
+ * @param primary Command buffer of the frame, inside of the pass begun for secondary command buffers
+ * @param sceneVersion Version of the scene the items are recorded from
+ * @param count Number of items
+ * @param recordRange Called once for all items, may only reach per-frame data through resources of the slot
+ */
+void CommandRecorder::recordCached(VkCommandBuffer primary,
+                                   uint64_t sceneVersion,
+                                   size_t count,
+                                   const RecordRange &recordRange)
+{
+    assert(inPass_ && "Secondary command buffers are only recorded inside of a pass");
+    auto &cached = cachedPasses_[frameIndex_];
+    if (cached.commandBuffer == VK_NULL_HANDLE)
+    {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandPool = cachePool_;
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(device_.device(), &allocInfo, &cached.commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate secondary command buffer!");
+        }
+    }
+
+    // Beginning resets the command buffer, the frame that executed it last has completed
+    cached.valid = false;
+    beginSecondary(cached.commandBuffer, 0, VK_NULL_HANDLE);
+    recordRange(cached.commandBuffer, 0, count);
+    if (vkEndCommandBuffer(cached.commandBuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to record secondary command buffer!");
+    }
+    cached.valid = true;
+    cached.sceneVersion = sceneVersion;
+    cached.inheritance = inheritance_;
+
+    vkCmdExecuteCommands(primary, 1, &cached.commandBuffer);
+}
+
+void CommandRecorder::invalidateCache()
+{
+    for (auto &cached : cachedPasses_)
+    {
+        cached.valid = false;
+    }
+}
+
+// The framebuffer is left out, cached command buffers don't inherit it
+bool CommandRecorder::isCacheCompatible(const PassInheritance &cached) const
+{
+    return cached.renderPass == inheritance_.renderPass && cached.colorFormat == inheritance_.colorFormat &&
+           cached.depthFormat == inheritance_.depthFormat && cached.extent.width == inheritance_.extent.width &&
+           cached.extent.height == inheritance_.extent.height;
+}
+
+VkCommandBuffer CommandRecorder::recordSecondary(uint32_t thread, const Range &range, const RecordRange &recordRange)
+{
+    auto &pool = threadPool(thread);
+    if (pool.used == pool.commandBuffers.size())
+    {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandPool = pool.pool;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(device_.device(), &allocInfo, &commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate secondary command buffer!");
+        }
+        pool.commandBuffers.push_back(commandBuffer);
+    }
+    auto commandBuffer = pool.commandBuffers[pool.used++];
+
+    beginSecondary(commandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, inheritance_.framebuffer);
+    recordRange(commandBuffer, range.begin, range.end);
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to record secondary command buffer!");
+    }
+    return commandBuffer;
+}
+
+/**
+ * Begins a secondary command buffer that continues the current pass and sets its viewport and scissor
+ *
+ * @param commandBuffer Secondary command buffer, reset
+ * @param flags Usage flags besides VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT
+ * @param framebuffer Framebuffer of the pass, may be null even if it is known
+ */
+void CommandRecorder::beginSecondary(VkCommandBuffer commandBuffer,
+                                     VkCommandBufferUsageFlags flags,
+                                     VkFramebuffer framebuffer)
+{
+    // Matches the attachments the Renderer begins dynamic rendering with
+    VkCommandBufferInheritanceRenderingInfo renderingInfo{};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachmentFormats = &inheritance_.colorFormat;
+    renderingInfo.depthAttachmentFormat = inheritance_.depthFormat;
+    renderingInfo.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+    renderingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.pNext = inheritance_.renderPass == VK_NULL_HANDLE ? &renderingInfo : nullptr;
+    inheritanceInfo.renderPass = inheritance_.renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = framebuffer;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = flags | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to begin recording secondary command buffer!");
+    }
+
+    VkViewport viewport{};
+    viewport.width = static_cast<float>(inheritance_.extent.width);
+    viewport.height = static_cast<float>(inheritance_.extent.height);
+    viewport.maxDepth = 1.0f;
+    VkRect2D scissor{{0, 0}, inheritance_.extent};
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
@@ -0,0 +1,273 @@
+#include "defragmenter.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+
+Defragmenter::Defragmenter(Device &device) : Defragmenter(device, Settings{})
+{
+}
+
+Defragmenter::Defragmenter(Device &device, Settings settings)
+  : device_{device}, allocator_{device.memoryAllocator()}, timeline_{device.frameTimeline()}, settings_{settings}
+{
+}
+
+Defragmenter::~Defragmenter()
+{
+    vkDeviceWaitIdle(device_.device());
+
+    // Moves that never got applied still own their destination copy.
+    for (auto &move : moves_)
+    {
+        if (move.destination.buffer != VK_NULL_HANDLE)
+        {
+            destroyBinding(move.destination);
+        }
+    }
+    releaseRetired(true);
+
+    for (auto block : sourceBlocks_)
+    {
+        allocator_.setEvacuating(block, false);
+    }
+}
+
+/**
+ * Starts a defragmentation pass if any block is sparse enough to be worth evacuating
+ *
+ * @param frameNumber Number of the frame the pass starts in
+ *
+ * @return True if a pass was started
+ */
+bool Defragmenter::begin(uint64_t frameNumber)
+{
+    if (isActive())
+    {
+        return false;
+    }
+
+    auto blocks = allocator_.getBlockInfos();
+    if (blocks.size() < 2)
+    {
+        return false;
+    }
+
+    // Evacuate the emptiest blocks first, as long as the rest has room to take their contents.
+    std::sort(blocks.begin(), blocks.end(), [](const auto &a, const auto &b) { return a.usedBytes < b.usedBytes; });
+
+    VkDeviceSize freeElsewhere = 0;
+    for (const auto &block : blocks)
+    {
+        freeElsewhere += block.size - block.usedBytes;
+    }
+
+    sourceBlocks_.clear();
+    for (const auto &block : blocks)
+    {
+        const float utilization = static_cast<float>(block.usedBytes) / static_cast<float>(block.size);
+        if (block.evacuating || utilization >= settings_.maxSourceUtilization)
+        {
+            continue;
+        }
+
+        freeElsewhere -= block.size - block.usedBytes;
+        if (block.usedBytes > freeElsewhere || sourceBlocks_.size() + 1 >= blocks.size())
+        {
+            break;
+        }
+        sourceBlocks_.push_back(block.index);
+    }
+
+    if (sourceBlocks_.empty())
+    {
+        return false;
+    }
+
+    stats_ = Stats{};
+    stats_.before = allocator_.getMetrics();
+    stats_.startFrame = frameNumber;
+    stats_.evacuatedBlocks = static_cast<uint32_t>(sourceBlocks_.size());
+
+    for (auto block : sourceBlocks_)
+    {
+        allocator_.setEvacuating(block, true);
+        for (const auto &[allocation, owner] : allocator_.getAllocations(block))
+        {
+            Move move{};
+            move.owner = owner;
+            move.source = allocation;
+            moves_.push_back(move);
+        }
+    }
+    return true;
+}
+
+/**
+ * Advances the pass. Must be called once per frame outside of a render pass, also while no pass is
+ * active so that relocated buffers get released.
+ *
+ * @param commandBuffer Command buffer of the current frame
+ * @param frameNumber Monotonic number of the current frame
+ *
+ * @return True in the frame the running pass finished and its after-metrics became available
+ */
+bool Defragmenter::update(VkCommandBuffer commandBuffer, uint64_t frameNumber)
+{
+    releaseRetired(false);
+
+    if (!moves_.empty())
+    {
+        applyCompletedMoves();
+        recordCopies(commandBuffer);
+        if (moves_.empty())
+        {
+            finishPass();
+        }
+    }
+
+    // Measure once the evacuated allocations are actually gone.
+    if (awaitingMetrics_ && retired_.empty())
+    {
+        awaitingMetrics_ = false;
+        stats_.after = allocator_.getMetrics();
+        stats_.endFrame = frameNumber;
+        return true;
+    }
+    return false;
+}
+
+void Defragmenter::recordCopies(VkCommandBuffer commandBuffer)
+{
+    // The frame being recorded signals the next timeline value
+    const uint64_t frameValue = timeline_.submittedValue() + 1;
+    VkDeviceSize recordedBytes = 0;
+    bool recorded = false;
+
+    for (auto &move : moves_)
+    {
+        if (move.state != MoveState::Queued)
+        {
+            continue;
+        }
+        // Always make progress, even if a single allocation exceeds the budget.
+        if (recorded && recordedBytes + move.source.size > settings_.bytesPerFrame)
+        {
+            break;
+        }
+
+        if (allocator_.getOwner(move.source) != move.owner)
+        {
+            // The buffer was destroyed since the pass started.
+            move.owner = nullptr;
+            move.state = MoveState::Copied;
+            move.copyValue = frameValue;
+            continue;
+        }
+
+        const VkDeviceSize size = move.owner->getBufferSize();
+        move.destination.buffer = device_.createBufferHandle(size, move.owner->getUsageFlags());
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device_.device(), move.destination.buffer, &memRequirements);
+        move.destination.allocation =
+          allocator_.allocate(memRequirements, move.owner->getMemoryPropertyFlags(), move.owner);
+        vkBindBufferMemory(device_.device(),
+                           move.destination.buffer,
+                           move.destination.allocation.memory,
+                           move.destination.allocation.offset);
+
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = 0;
+        copyRegion.dstOffset = 0;
+        copyRegion.size = size;
+        vkCmdCopyBuffer(commandBuffer, move.owner->getBuffer(), move.destination.buffer, 1, &copyRegion);
+
+        move.state = MoveState::Copied;
+        move.copyValue = frameValue;
+        recordedBytes += size;
+        recorded = true;
+    }
+
+    if (recorded)
+    {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                             0,
+                             1,
+                             &barrier,
+                             0,
+                             nullptr,
+                             0,
+                             nullptr);
+    }
+}
+
+void Defragmenter::applyCompletedMoves()
+{
+    bool rebound = false;
+    while (!moves_.empty())
+    {
+        auto &move = moves_.front();
+        if (move.state != MoveState::Copied || !timeline_.isComplete(move.copyValue))
+        {
+            break;
+        }
+
+        if (move.owner != nullptr && allocator_.getOwner(move.source) == move.owner)
+        {
+            // Frames submitted before this one may still read through the old binding.
+            retired_.push_back({move.owner->rebind(move.destination), timeline_.submittedValue()});
+            rebound = true;
+            stats_.movedAllocations++;
+            stats_.movedBytes += move.destination.allocation.size;
+        }
+        else
+        {
+            if (move.destination.buffer != VK_NULL_HANDLE)
+            {
+                retired_.push_back({move.destination, timeline_.submittedValue()});
+            }
+            stats_.skippedAllocations++;
+        }
+        moves_.pop_front();
+    }
+    if (rebound)
+    {
+        bindingGeneration_++;
+    }
+}
+
+void Defragmenter::releaseRetired(bool force)
+{
+    auto it = std::remove_if(retired_.begin(), retired_.end(), [&](const RetiredBinding &retired) {
+        if (force || timeline_.isComplete(retired.releaseValue))
+        {
+            destroyBinding(retired.binding);
+            return true;
+        }
+        return false;
+    });
+    retired_.erase(it, retired_.end());
+}
+
+void Defragmenter::finishPass()
+{
+    for (auto block : sourceBlocks_)
+    {
+        allocator_.setEvacuating(block, false);
+    }
+    sourceBlocks_.clear();
+    awaitingMetrics_ = true;
+}
+
+void Defragmenter::destroyBinding(const Buffer::Binding &binding)
+{
+    vkDestroyBuffer(device_.device(), binding.buffer, nullptr);
+    allocator_.free(binding.allocation);
+}
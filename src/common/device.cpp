@@ -1,6 +1,11 @@
 #include "device.hpp"
+#include "frame_timeline.hpp"
+#include "memory_allocator.hpp"
+#include "staging_pool.hpp"
 
 // std headers
+#include <algorithm>
+#include <cassert>
 #include <cstring>
 #include <iostream>
 #include <set>
@@ -45,18 +50,25 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance,
 }
 
 // class member functions
-Device::Device(Window &window) : window{window}
+Device::Device(Window *window) : window{window}
 {
     createInstance();
     setupDebugMessenger();
     createSurface();
     pickPhysicalDevice();
+    queryOptionalFeatures();
     createLogicalDevice();
     createCommandPool();
+    frameTimeline_ = std::make_unique<FrameTimeline>(*this);
+    memoryAllocator_ = std::make_unique<MemoryAllocator>(*this);
+    stagingPool_ = std::make_unique<StagingPool>(*this);
 }
 
 Device::~Device()
 {
+    stagingPool_ = nullptr;
+    memoryAllocator_ = nullptr;
+    frameTimeline_ = nullptr;
     vkDestroyCommandPool(device_, commandPool, nullptr);
     vkDestroyDevice(device_, nullptr);
 
@@ -65,7 +77,10 @@ Device::~Device()
         DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
     }
 
-    vkDestroySurfaceKHR(instance, surface_, nullptr);
+    if (surface_ != VK_NULL_HANDLE)
+    {
+        vkDestroySurfaceKHR(instance, surface_, nullptr);
+    }
     vkDestroyInstance(instance, nullptr);
 }
 
@@ -82,7 +97,17 @@ void Device::createInstance()
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+
+    // Ask for the newest version the loader knows about (capped at 1.3) so that features promoted to
+    // core can be enabled without extensions. vkEnumerateInstanceVersion does not exist on 1.0 loaders.
+    auto enumerateInstanceVersion =
+      (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+    if (enumerateInstanceVersion != nullptr)
+    {
+        enumerateInstanceVersion(&instanceApiVersion_);
+    }
+    instanceApiVersion_ = std::min(instanceApiVersion_, static_cast<uint32_t>(VK_API_VERSION_1_3));
+    appInfo.apiVersion = instanceApiVersion_;
 
     VkInstanceCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -143,6 +168,99 @@ void Device::pickPhysicalDevice()
 
     vkGetPhysicalDeviceProperties(physicalDevice, &properties);
     std::cout << "physical device: " << properties.deviceName << std::endl;
+
+    apiVersion_ = std::min(instanceApiVersion_, properties.apiVersion);
+}
+
+void Device::queryOptionalFeatures()
+{
+    enabledExtensions_ = getRequiredDeviceExtensions();
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+    timestampValidBits_ = queueFamilies[findQueueFamilies(physicalDevice).graphicsFamily].timestampValidBits;
+
+    if (apiVersion_ < VK_API_VERSION_1_1)
+    {
+        return;
+    }
+
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+    auto hasExtension = [&](const char *name) {
+        return std::any_of(availableExtensions.begin(), availableExtensions.end(), [name](const auto &extension) {
+            return strcmp(extension.extensionName, name) == 0;
+        });
+    };
+
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+    presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+    presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    presentWaitFeatures.pNext = &presentIdFeatures;
+
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+    VkPhysicalDeviceVulkan13Features vulkan13Features{};
+    vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+    dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &presentWaitFeatures;
+    if (apiVersion_ >= VK_API_VERSION_1_2)
+    {
+        presentIdFeatures.pNext = &vulkan12Features;
+        if (apiVersion_ >= VK_API_VERSION_1_3)
+        {
+            vulkan12Features.pNext = &vulkan13Features;
+        }
+        else if (hasExtension(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME))
+        {
+            // The extension depends on VK_KHR_depth_stencil_resolve, which is core in 1.2
+            vulkan12Features.pNext = &dynamicRenderingFeatures;
+        }
+    }
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+    bufferDeviceAddressEnabled_ = vulkan12Features.bufferDeviceAddress == VK_TRUE;
+    std::cout << "buffer device address: " << (bufferDeviceAddressEnabled_ ? "enabled" : "unsupported") << std::endl;
+
+    timelineSemaphoreEnabled_ = vulkan12Features.timelineSemaphore == VK_TRUE;
+    std::cout << "timeline semaphore: " << (timelineSemaphoreEnabled_ ? "enabled" : "unsupported") << std::endl;
+
+    presentWaitEnabled_ = !isHeadless() && hasExtension(VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+                          hasExtension(VK_KHR_PRESENT_WAIT_EXTENSION_NAME) &&
+                          presentIdFeatures.presentId == VK_TRUE && presentWaitFeatures.presentWait == VK_TRUE;
+    if (presentWaitEnabled_)
+    {
+        enabledExtensions_.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+        enabledExtensions_.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+    }
+    std::cout << "present wait: " << (presentWaitEnabled_ ? "enabled" : "unsupported") << std::endl;
+
+    dynamicRenderingEnabled_ =
+      vulkan13Features.dynamicRendering == VK_TRUE || dynamicRenderingFeatures.dynamicRendering == VK_TRUE;
+    if (dynamicRenderingFeatures.dynamicRendering == VK_TRUE)
+    {
+        enabledExtensions_.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+    }
+    std::cout << "dynamic rendering: " << (dynamicRenderingEnabled_ ? "enabled" : "unsupported") << std::endl;
+
+    // Core in 1.2, older devices only have the extension and are left out
+    indirectCountEnabled_ = vulkan12Features.drawIndirectCount == VK_TRUE &&
+                            features2.features.multiDrawIndirect == VK_TRUE &&
+                            features2.features.drawIndirectFirstInstance == VK_TRUE;
+    std::cout << "indirect count: " << (indirectCountEnabled_ ? "enabled" : "unsupported") << std::endl;
 }
 
 void Device::createLogicalDevice()
@@ -165,6 +283,8 @@ void Device::createLogicalDevice()
 
     VkPhysicalDeviceFeatures deviceFeatures = {};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
+    deviceFeatures.multiDrawIndirect = indirectCountEnabled_ ? VK_TRUE : VK_FALSE;
+    deviceFeatures.drawIndirectFirstInstance = indirectCountEnabled_ ? VK_TRUE : VK_FALSE;
 
     VkDeviceCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -172,9 +292,67 @@ void Device::createLogicalDevice()
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
-    createInfo.pEnabledFeatures = &deviceFeatures;
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    // Features beyond Vulkan 1.0 have to be enabled through the VkPhysicalDeviceFeatures2 chain.
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12Features.bufferDeviceAddress = bufferDeviceAddressEnabled_ ? VK_TRUE : VK_FALSE;
+    vulkan12Features.timelineSemaphore = timelineSemaphoreEnabled_ ? VK_TRUE : VK_FALSE;
+    vulkan12Features.drawIndirectCount = indirectCountEnabled_ ? VK_TRUE : VK_FALSE;
+
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+    presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    presentIdFeatures.presentId = VK_TRUE;
+
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+    presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    presentWaitFeatures.presentWait = VK_TRUE;
+
+    VkPhysicalDeviceVulkan13Features vulkan13Features{};
+    vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    vulkan13Features.dynamicRendering = VK_TRUE;
+
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+    dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+    dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
+
+    void *featureChain = nullptr;
+    if (apiVersion_ >= VK_API_VERSION_1_2)
+    {
+        featureChain = &vulkan12Features;
+    }
+    if (dynamicRenderingEnabled_)
+    {
+        // Core in 1.3, the extension's feature struct has to be used before that
+        void *dynamicRendering = &dynamicRenderingFeatures;
+        if (apiVersion_ >= VK_API_VERSION_1_3)
+        {
+            dynamicRendering = &vulkan13Features;
+        }
+        vulkan12Features.pNext = dynamicRendering;
+    }
+    if (presentWaitEnabled_)
+    {
+        presentIdFeatures.pNext = featureChain;
+        presentWaitFeatures.pNext = &presentIdFeatures;
+        featureChain = &presentWaitFeatures;
+    }
+
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.features = deviceFeatures;
+    features2.pNext = featureChain;
+
+    if (apiVersion_ >= VK_API_VERSION_1_1)
+    {
+        createInfo.pNext = &features2;
+        createInfo.pEnabledFeatures = nullptr;
+    }
+    else
+    {
+        createInfo.pEnabledFeatures = &deviceFeatures;
+    }
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions_.size());
+    createInfo.ppEnabledExtensionNames = enabledExtensions_.data();
 
     // might not really be necessary anymore because device specific validation layers
     // have been deprecated
@@ -195,6 +373,23 @@ void Device::createLogicalDevice()
 
     vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
     vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+
+    if (presentWaitEnabled_)
+    {
+        vkWaitForPresentKHR_ =
+          reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(device_, "vkWaitForPresentKHR"));
+        presentWaitEnabled_ = vkWaitForPresentKHR_ != nullptr;
+    }
+
+    if (dynamicRenderingEnabled_)
+    {
+        const bool core = apiVersion_ >= VK_API_VERSION_1_3;
+        vkCmdBeginRendering_ = reinterpret_cast<PFN_vkCmdBeginRendering>(
+          vkGetDeviceProcAddr(device_, core ? "vkCmdBeginRendering" : "vkCmdBeginRenderingKHR"));
+        vkCmdEndRendering_ = reinterpret_cast<PFN_vkCmdEndRendering>(
+          vkGetDeviceProcAddr(device_, core ? "vkCmdEndRendering" : "vkCmdEndRenderingKHR"));
+        dynamicRenderingEnabled_ = vkCmdBeginRendering_ != nullptr && vkCmdEndRendering_ != nullptr;
+    }
 }
 
 void Device::createCommandPool()
@@ -214,7 +409,10 @@ void Device::createCommandPool()
 
 void Device::createSurface()
 {
-    window.createWindowSurface(instance, &surface_);
+    if (window != nullptr)
+    {
+        window->createWindowSurface(instance, &surface_);
+    }
 }
 
 bool Device::isDeviceSuitable(VkPhysicalDevice device)
@@ -223,8 +421,9 @@ bool Device::isDeviceSuitable(VkPhysicalDevice device)
 
     bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-    bool swapChainAdequate = false;
-    if (extensionsSupported)
+    // Offscreen rendering does not present, so there is no swap chain to check for.
+    bool swapChainAdequate = isHeadless();
+    if (extensionsSupported && !isHeadless())
     {
         SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
         swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
@@ -293,11 +492,14 @@ bool Device::checkValidationLayerSupport()
 
 std::vector<const char *> Device::getRequiredExtensions()
 {
-    uint32_t glfwExtensionCount = 0;
-    const char **glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-    std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    std::vector<const char *> extensions;
+    if (!isHeadless())
+    {
+        uint32_t glfwExtensionCount = 0;
+        const char **glfwExtensions;
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     if (enableValidationLayers)
     {
@@ -307,6 +509,15 @@ std::vector<const char *> Device::getRequiredExtensions()
     return extensions;
 }
 
+std::vector<const char *> Device::getRequiredDeviceExtensions()
+{
+    if (isHeadless())
+    {
+        return {};
+    }
+    return deviceExtensions;
+}
+
 void Device::hasGflwRequiredInstanceExtensions()
 {
     uint32_t extensionCount = 0;
@@ -334,6 +545,33 @@ void Device::hasGflwRequiredInstanceExtensions()
     }
 }
 
+/**
+ * Waits until the presentation engine has displayed the image presented with presentId
+ *
+ * @param swapChain Swap chain the image was presented to
+ * @param presentId Id chained to the present through VkPresentIdKHR
+ * @param timeout Timeout in nanoseconds, 0 only polls
+ *
+ * @return VK_SUCCESS once displayed, VK_TIMEOUT if it was not yet, or an error
+ */
+VkResult Device::waitForPresent(VkSwapchainKHR swapChain, uint64_t presentId, uint64_t timeout)
+{
+    assert(presentWaitEnabled_ && "Present wait is not enabled on this device");
+    return vkWaitForPresentKHR_(device_, swapChain, presentId, timeout);
+}
+
+void Device::cmdBeginRendering(VkCommandBuffer commandBuffer, const VkRenderingInfo &renderingInfo)
+{
+    assert(dynamicRenderingEnabled_ && "Dynamic rendering is not enabled on this device");
+    vkCmdBeginRendering_(commandBuffer, &renderingInfo);
+}
+
+void Device::cmdEndRendering(VkCommandBuffer commandBuffer)
+{
+    assert(dynamicRenderingEnabled_ && "Dynamic rendering is not enabled on this device");
+    vkCmdEndRendering_(commandBuffer);
+}
+
 bool Device::checkDeviceExtensionSupport(VkPhysicalDevice device)
 {
     uint32_t extensionCount;
@@ -342,6 +580,7 @@ bool Device::checkDeviceExtensionSupport(VkPhysicalDevice device)
     std::vector<VkExtensionProperties> availableExtensions(extensionCount);
     vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
+    const auto deviceExtensions = getRequiredDeviceExtensions();
     std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
 
     for (const auto &extension : availableExtensions)
@@ -370,8 +609,16 @@ QueueFamilyIndices Device::findQueueFamilies(VkPhysicalDevice device)
             indices.graphicsFamily = i;
             indices.graphicsFamilyHasValue = true;
         }
+        // Without a surface nothing is presented, so the graphics queue stands in for the present queue.
         VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+        if (isHeadless())
+        {
+            presentSupport = queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT ? VK_TRUE : VK_FALSE;
+        }
+        else
+        {
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+        }
         if (queueFamily.queueCount > 0 && presentSupport)
         {
             indices.presentFamily = i;
@@ -419,14 +666,7 @@ VkFormat Device::findSupportedFormat(const std::vector<VkFormat> &candidates,
 {
     for (VkFormat format : candidates)
     {
-        VkFormatProperties props;
-        vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
-
-        if (tiling == VK_IMAGE_TILING_LINEAR && (props.linearTilingFeatures & features) == features)
-        {
-            return format;
-        }
-        else if (tiling == VK_IMAGE_TILING_OPTIMAL && (props.optimalTilingFeatures & features) == features)
+        if (isFormatSupported(format, tiling, features))
         {
             return format;
         }
@@ -434,7 +674,30 @@ VkFormat Device::findSupportedFormat(const std::vector<VkFormat> &candidates,
     throw std::runtime_error("failed to find supported format!");
 }
 
+bool Device::isFormatSupported(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features)
+{
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
+
+    if (tiling == VK_IMAGE_TILING_LINEAR)
+    {
+        return (props.linearTilingFeatures & features) == features;
+    }
+    return tiling == VK_IMAGE_TILING_OPTIMAL && (props.optimalTilingFeatures & features) == features;
+}
+
 uint32_t Device::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+{
+    uint32_t typeIndex;
+    if (tryFindMemoryType(typeFilter, properties, typeIndex))
+    {
+        return typeIndex;
+    }
+
+    throw std::runtime_error("failed to find suitable memory type!");
+}
+
+bool Device::tryFindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, uint32_t &typeIndex)
 {
     VkPhysicalDeviceMemoryProperties memProperties;
     vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
@@ -442,18 +705,14 @@ uint32_t Device::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags prope
     {
         if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
         {
-            return i;
+            typeIndex = i;
+            return true;
         }
     }
-
-    throw std::runtime_error("failed to find suitable memory type!");
+    return false;
 }
 
-void Device::createBuffer(VkDeviceSize size,
-                          VkBufferUsageFlags usage,
-                          VkMemoryPropertyFlags properties,
-                          VkBuffer &buffer,
-                          VkDeviceMemory &bufferMemory)
+VkBuffer Device::createBufferHandle(VkDeviceSize size, VkBufferUsageFlags usage)
 {
     VkBufferCreateInfo bufferInfo{};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -461,10 +720,21 @@ void Device::createBuffer(VkDeviceSize size,
     bufferInfo.usage = usage;
     bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+    VkBuffer buffer;
     if (vkCreateBuffer(device_, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
     {
         throw std::runtime_error("failed to create vertex buffer!");
     }
+    return buffer;
+}
+
+void Device::createBuffer(VkDeviceSize size,
+                          VkBufferUsageFlags usage,
+                          VkMemoryPropertyFlags properties,
+                          VkBuffer &buffer,
+                          VkDeviceMemory &bufferMemory)
+{
+    buffer = createBufferHandle(size, usage);
 
     VkMemoryRequirements memRequirements;
     vkGetBufferMemoryRequirements(device_, buffer, &memRequirements);
@@ -474,6 +744,19 @@ void Device::createBuffer(VkDeviceSize size,
     allocInfo.allocationSize = memRequirements.size;
     allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
 
+    // Buffers whose address is queried need memory allocated with the device address flag.
+    VkMemoryAllocateFlagsInfo allocFlagsInfo{};
+    allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+    allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+    if (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)
+    {
+        if (!bufferDeviceAddressEnabled_)
+        {
+            throw std::runtime_error("buffer device address requested, but not supported!");
+        }
+        allocInfo.pNext = &allocFlagsInfo;
+    }
+
     if (vkAllocateMemory(device_, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS)
     {
         throw std::runtime_error("failed to allocate vertex buffer memory!");
@@ -510,6 +793,11 @@ void Device::endSingleTimeCommands(VkCommandBuffer commandBuffer)
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &commandBuffer;
 
+    // The commands may read buffers whose staged uploads are still waiting to be submitted
+    if (stagingPool_ != nullptr)
+    {
+        stagingPool_->flush();
+    }
     vkQueueSubmit(graphicsQueue_, 1, &submitInfo, VK_NULL_HANDLE);
     vkQueueWaitIdle(graphicsQueue_);
 
@@ -553,7 +841,8 @@ void Device::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, u
 void Device::createImageWithInfo(const VkImageCreateInfo &imageInfo,
                                  VkMemoryPropertyFlags properties,
                                  VkImage &image,
-                                 VkDeviceMemory &imageMemory)
+                                 VkDeviceMemory &imageMemory,
+                                 VkMemoryPropertyFlags fallbackProperties)
 {
     if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS)
     {
@@ -566,7 +855,16 @@ void Device::createImageWithInfo(const VkImageCreateInfo &imageInfo,
     VkMemoryAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+
+    // The preferred properties (e.g. lazily allocated) are optional if a fallback is given.
+    if (!tryFindMemoryType(memRequirements.memoryTypeBits, properties, allocInfo.memoryTypeIndex))
+    {
+        if (fallbackProperties == 0)
+        {
+            throw std::runtime_error("failed to find suitable memory type!");
+        }
+        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, fallbackProperties);
+    }
 
     if (vkAllocateMemory(device_, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS)
     {
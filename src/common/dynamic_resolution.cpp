@@ -0,0 +1,74 @@
+#include "dynamic_resolution.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+DynamicResolution::DynamicResolution() : DynamicResolution(Settings{})
+{
+}
+
+DynamicResolution::DynamicResolution(const Settings &settings) : settings_{settings}
+{
+    if (settings_.minScale <= 0.0f || settings_.minScale > settings_.maxScale || settings_.maxScale > 1.0f)
+    {
+        throw std::runtime_error("dynamic resolution scales must satisfy 0 < min <= max <= 1!");
+    }
+    scale_ = settings_.maxScale;
+}
+
+/**
+ * Feeds the GPU time of a completed frame and adjusts the scale when the smoothed time has left the
+ * hysteresis band around the budget
+ *
+ * @param gpuFrameMs GPU time of the frame in milliseconds
+ *
+ * @return The scale to render the next frame at
+ */
+float DynamicResolution::update(double gpuFrameMs)
+{
+    if (!isEnabled() || gpuFrameMs <= 0.0)
+    {
+        return scale_;
+    }
+
+    if (settleFrames_ > 0)
+    {
+        settleFrames_--;
+        return scale_;
+    }
+
+    // The first sample after a change starts the average over, older ones were at another resolution
+    smoothedMs_ = hasSample_ ? smoothedMs_ + SMOOTHING * (gpuFrameMs - smoothedMs_) : gpuFrameMs;
+    hasSample_ = true;
+
+    const double budget = settings_.frameBudgetMs;
+    if (smoothedMs_ >= INCREASE_THRESHOLD * budget && smoothedMs_ <= DECREASE_THRESHOLD * budget)
+    {
+        return scale_;
+    }
+
+    const auto ideal = static_cast<float>(scale_ * std::sqrt(TARGET_FRACTION * budget / smoothedMs_));
+    float next = smoothedMs_ > budget ? std::min(ideal, scale_ - SCALE_GRANULARITY)
+                                      : std::max(std::min(ideal, scale_ + MAX_INCREASE), scale_ + SCALE_GRANULARITY);
+    next = std::round(next / SCALE_GRANULARITY) * SCALE_GRANULARITY;
+    next = std::clamp(next, settings_.minScale, settings_.maxScale);
+
+    if (next != scale_)
+    {
+        scale_ = next;
+        hasSample_ = false;
+        settleFrames_ = SETTLE_FRAMES;
+        changeCount_++;
+    }
+    return scale_;
+}
+
+VkExtent2D DynamicResolution::scaleExtent(VkExtent2D extent) const
+{
+    const auto scale = [this](uint32_t size) {
+        return std::max(1u, static_cast<uint32_t>(std::lround(static_cast<float>(size) * scale_)));
+    };
+    return {scale(extent.width), scale(extent.height)};
+}
@@ -0,0 +1,319 @@
+#include "frame_capture.hpp"
+#include "frame_timeline.hpp"
+#include "image_writer.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+constexpr uint32_t BYTES_PER_PIXEL = 4;
+
+bool isBgra(VkFormat format)
+{
+    return format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+}
+
+void imageBarrier(VkCommandBuffer commandBuffer,
+                  VkImage image,
+                  VkImageLayout oldLayout,
+                  VkImageLayout newLayout,
+                  VkPipelineStageFlags srcStage,
+                  VkAccessFlags srcAccess,
+                  VkPipelineStageFlags dstStage,
+                  VkAccessFlags dstAccess)
+{
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+} // namespace
+
+FrameCapture::FrameCapture(Device &device, const Settings &settings) : device_{device}, settings_{settings}
+{
+    if (settings_.readbackSlots < 1)
+    {
+        throw std::runtime_error("frame capture needs at least one readback buffer!");
+    }
+    if (!isEnabled())
+    {
+        return;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(settings_.directory, error);
+    if (error)
+    {
+        throw std::runtime_error("failed to create capture directory " + settings_.directory + "!");
+    }
+
+    // The CPU reads every byte of a capture, which is slow from uncached memory
+    uint32_t typeIndex;
+    readbackMemory_ = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    if (!device_.tryFindMemoryType(~0u, readbackMemory_, typeIndex))
+    {
+        readbackMemory_ = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    }
+
+    readbacks_.resize(settings_.readbackSlots);
+    writer_ = std::thread{&FrameCapture::writeLoop, this};
+}
+
+FrameCapture::~FrameCapture()
+{
+    if (!writer_.joinable())
+    {
+        return;
+    }
+
+    finish();
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stopping_ = true;
+    }
+    writeQueued_.notify_one();
+    writer_.join();
+}
+
+bool FrameCapture::isFormatSupported(VkFormat format)
+{
+    return isBgra(format) || format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB;
+}
+
+/**
+ * Copies the image into a free readback buffer at the end of a frame. The copy is read once the frame
+ * has completed on the GPU, see collect().
+ *
+ * @param commandBuffer Command buffer of the frame, outside of a render pass
+ * @param image Finished color image of the frame
+ * @param layout Layout the image is in, it is returned to it after the copy
+ * @param format One of the formats isFormatSupported() accepts
+ * @param extent Size of the image
+ * @param frameNumber Number the capture is named after
+ */
+void FrameCapture::record(VkCommandBuffer commandBuffer,
+                          VkImage image,
+                          VkImageLayout layout,
+                          VkFormat format,
+                          VkExtent2D extent,
+                          uint64_t frameNumber)
+{
+    assert(isCaptured(frameNumber) && "Recording a frame that is not captured");
+    assert(isFormatSupported(format) && "Capture format not supported");
+
+    auto readback = std::find_if(
+      readbacks_.begin(), readbacks_.end(), [](const Readback &slot) { return slot.timelineValue == 0; });
+    if (readback == readbacks_.end())
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stats_.dropped++;
+        return;
+    }
+
+    const uint32_t pixelCount = extent.width * extent.height;
+    if (readback->buffer == nullptr || readback->buffer->getBufferSize() < VkDeviceSize{pixelCount} * BYTES_PER_PIXEL)
+    {
+        readback->buffer = std::make_unique<Buffer>(
+          device_, BYTES_PER_PIXEL, pixelCount, VK_BUFFER_USAGE_TRANSFER_DST_BIT, readbackMemory_);
+        readback->buffer->map();
+    }
+
+    // The image was last written by the render pass or the upscaling blit
+    const bool present = layout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    imageBarrier(commandBuffer,
+                 image,
+                 layout,
+                 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                 VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+                 VK_PIPELINE_STAGE_TRANSFER_BIT,
+                 VK_ACCESS_TRANSFER_READ_BIT);
+
+    VkBufferImageCopy region{};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = {extent.width, extent.height, 1};
+    vkCmdCopyImageToBuffer(
+      commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback->buffer->getBuffer(), 1, &region);
+
+    imageBarrier(commandBuffer,
+                 image,
+                 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                 layout,
+                 VK_PIPELINE_STAGE_TRANSFER_BIT,
+                 0,
+                 present ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT,
+                 present ? 0 : VK_ACCESS_TRANSFER_READ_BIT);
+
+    VkBufferMemoryBarrier hostBarrier{};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.buffer = readback->buffer->getBuffer();
+    hostBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT,
+                         0,
+                         0,
+                         nullptr,
+                         1,
+                         &hostBarrier,
+                         0,
+                         nullptr);
+
+    // The command buffer is part of the next submission
+    readback->timelineValue = device_.frameTimeline().submittedValue() + 1;
+    readback->frameNumber = frameNumber;
+    readback->extent = extent;
+    readback->format = format;
+
+    std::lock_guard<std::mutex> lock{mutex_};
+    stats_.recorded++;
+}
+
+/**
+ * Hands the readbacks of completed frames to the writer thread without blocking. Called once per frame.
+ */
+void FrameCapture::collect()
+{
+    auto &timeline = device_.frameTimeline();
+    for (auto &readback : readbacks_)
+    {
+        if (readback.timelineValue != 0 && timeline.isComplete(readback.timelineValue))
+        {
+            enqueue(readback);
+        }
+    }
+}
+
+/**
+ * Waits for all recorded captures to be read back and written
+ */
+void FrameCapture::finish()
+{
+    auto &timeline = device_.frameTimeline();
+    for (auto &readback : readbacks_)
+    {
+        if (readback.timelineValue != 0 && readback.timelineValue <= timeline.submittedValue())
+        {
+            timeline.wait(readback.timelineValue);
+            enqueue(readback);
+        }
+    }
+
+    std::unique_lock<std::mutex> lock{mutex_};
+    writesDone_.wait(lock, [this] { return writes_.empty() && !writing_; });
+}
+
+FrameCapture::Stats FrameCapture::getStats() const
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    return stats_;
+}
+
+void FrameCapture::enqueue(Readback &readback)
+{
+    const bool full = [this] {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return writes_.size() >= MAX_QUEUED_WRITES;
+    }();
+
+    if (!full)
+    {
+        // Copied out so the buffer can take the next capture while this one is encoded
+        Write write{readback.frameNumber, readback.extent, readback.format, {}};
+        write.pixels.resize(static_cast<size_t>(readback.extent.width) * readback.extent.height * BYTES_PER_PIXEL);
+        readback.buffer->invalidate();
+        std::memcpy(write.pixels.data(), readback.buffer->getMappedMemory(), write.pixels.size());
+
+        std::lock_guard<std::mutex> lock{mutex_};
+        writes_.push_back(std::move(write));
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stats_.dropped++;
+    }
+
+    readback.timelineValue = 0;
+    writeQueued_.notify_one();
+}
+
+void FrameCapture::writeLoop()
+{
+    std::unique_lock<std::mutex> lock{mutex_};
+    while (true)
+    {
+        writeQueued_.wait(lock, [this] { return stopping_ || !writes_.empty(); });
+        if (writes_.empty())
+        {
+            return;
+        }
+
+        Write write = std::move(writes_.front());
+        writes_.pop_front();
+        writing_ = true;
+
+        lock.unlock();
+        const bool written = writeImage(write);
+        lock.lock();
+
+        if (written)
+        {
+            stats_.written++;
+        }
+        else
+        {
+            stats_.failed++;
+            std::cerr << "failed to write capture of frame " << write.frameNumber << std::endl;
+        }
+        writing_ = false;
+        writesDone_.notify_all();
+    }
+}
+
+bool FrameCapture::writeImage(Write &write) const
+{
+    const bool bgra = isBgra(write.format);
+    for (size_t i = 0; i < write.pixels.size(); i += BYTES_PER_PIXEL)
+    {
+        if (bgra)
+        {
+            std::swap(write.pixels[i], write.pixels[i + 2]);
+        }
+        // Presented images are opaque whatever the shaders wrote to alpha
+        write.pixels[i + 3] = 0xff;
+    }
+
+    std::ostringstream path;
+    path << settings_.directory << "/frame_" << std::setw(6) << std::setfill('0') << write.frameNumber;
+    if (settings_.format == CaptureFormat::Png)
+    {
+        path << ".png";
+        return image_writer::writePng(path.str(), write.extent.width, write.extent.height, write.pixels.data());
+    }
+
+    path << "_" << write.extent.width << "x" << write.extent.height << ".rgba";
+    return image_writer::writeRaw(path.str(), write.extent.width, write.extent.height, write.pixels.data());
+}
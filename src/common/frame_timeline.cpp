@@ -0,0 +1,185 @@
+#include "frame_timeline.hpp"
+#include "device.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+
+FrameTimeline::FrameTimeline(Device &device) : device_{device}
+{
+    if (!device_.timelineSemaphoreEnabled())
+    {
+        return;
+    }
+
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+
+    if (vkCreateSemaphore(device_.device(), &semaphoreInfo, nullptr, &semaphore_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create frame timeline semaphore!");
+    }
+}
+
+FrameTimeline::~FrameTimeline()
+{
+    wait(submitted_);
+
+    for (auto fence : freeFences_)
+    {
+        vkDestroyFence(device_.device(), fence, nullptr);
+    }
+    if (usesTimelineSemaphore())
+    {
+        vkDestroySemaphore(device_.device(), semaphore_, nullptr);
+    }
+}
+
+/**
+ * Polls the GPU for the highest value that has been signaled, without blocking
+ *
+ * @return All submissions up to and including this value have completed
+ */
+uint64_t FrameTimeline::completedValue()
+{
+    if (usesTimelineSemaphore())
+    {
+        uint64_t value = 0;
+        if (vkGetSemaphoreCounterValue(device_.device(), semaphore_, &value) == VK_SUCCESS)
+        {
+            completed_ = std::max(completed_, value);
+        }
+        return completed_;
+    }
+
+    // Submissions on one queue complete in order, so the first unsignaled fence ends the scan
+    while (!pendingFences_.empty() && vkGetFenceStatus(device_.device(), pendingFences_.front().fence) == VK_SUCCESS)
+    {
+        completed_ = pendingFences_.front().value;
+        freeFences_.push_back(pendingFences_.front().fence);
+        pendingFences_.pop_front();
+    }
+    return completed_;
+}
+
+/**
+ * Blocks until the submission that signals value has completed on the GPU
+ *
+ * @param value A value returned by submit(), values that were never submitted would wait forever
+ */
+void FrameTimeline::wait(uint64_t value)
+{
+    assert(value <= submitted_ && "Waiting for a frame that has not been submitted");
+    if (value <= completed_)
+    {
+        return;
+    }
+
+    if (usesTimelineSemaphore())
+    {
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &semaphore_;
+        waitInfo.pValues = &value;
+        if (vkWaitSemaphores(device_.device(), &waitInfo, std::numeric_limits<uint64_t>::max()) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to wait for frame timeline!");
+        }
+        completed_ = value;
+        return;
+    }
+
+    auto it = std::find_if(pendingFences_.begin(), pendingFences_.end(), [value](const PendingFence &pending) {
+        return pending.value >= value;
+    });
+    if (it != pendingFences_.end())
+    {
+        vkWaitForFences(device_.device(), 1, &it->fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+    }
+    completedValue();
+}
+
+/**
+ * Submits work that signals the next timeline value once it has completed, in addition to the
+ * semaphores of submitInfo, which have to be binary semaphores
+ *
+ * @param queue Queue to submit to
+ * @param submitInfo Submission without pNext chain
+ *
+ * @return The value the submission signals
+ */
+uint64_t FrameTimeline::submit(VkQueue queue, const VkSubmitInfo &submitInfo)
+{
+    assert(submitInfo.pNext == nullptr && "Submission already has a pNext chain");
+    const uint64_t value = submitted_ + 1;
+
+    VkSubmitInfo timelineSubmit = submitInfo;
+    VkFence fence = VK_NULL_HANDLE;
+
+    std::vector<VkSemaphore> signalSemaphores(submitInfo.pSignalSemaphores,
+                                              submitInfo.pSignalSemaphores + submitInfo.signalSemaphoreCount);
+    std::vector<uint64_t> signalValues(signalSemaphores.size(), 0);
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+
+    if (usesTimelineSemaphore())
+    {
+        // Values of binary semaphores are ignored
+        signalSemaphores.push_back(semaphore_);
+        signalValues.push_back(value);
+
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+        timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+        timelineSubmit.pNext = &timelineInfo;
+        timelineSubmit.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+        timelineSubmit.pSignalSemaphores = signalSemaphores.data();
+    }
+    else
+    {
+        fence = acquireFence();
+    }
+
+    if (vkQueueSubmit(queue, 1, &timelineSubmit, fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to submit draw command buffer!");
+    }
+
+    if (fence != VK_NULL_HANDLE)
+    {
+        pendingFences_.push_back({value, fence});
+    }
+    submitted_ = value;
+    return value;
+}
+
+VkFence FrameTimeline::acquireFence()
+{
+    completedValue();
+    if (!freeFences_.empty())
+    {
+        VkFence fence = freeFences_.back();
+        freeFences_.pop_back();
+        vkResetFences(device_.device(), 1, &fence);
+        return fence;
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VkFence fence;
+    if (vkCreateFence(device_.device(), &fenceInfo, nullptr, &fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create frame timeline fence!");
+    }
+    return fence;
+}
@@ -0,0 +1,40 @@
+#include "frustum.hpp"
+
+/**
+ * Extracts the planes from the rows of the matrix (Gribb and Hartmann), for clip space depth from 0 to 1
+ *
+ * @param projectionView Projection times view matrix
+ */
+Frustum Frustum::fromMatrix(const glm::mat4 &projectionView)
+{
+    const auto row = [&](int i) {
+        return glm::vec4{projectionView[0][i], projectionView[1][i], projectionView[2][i], projectionView[3][i]};
+    };
+
+    Frustum frustum;
+    frustum.planes[PLANE_LEFT] = row(3) + row(0);
+    frustum.planes[PLANE_RIGHT] = row(3) - row(0);
+    frustum.planes[PLANE_BOTTOM] = row(3) + row(1);
+    frustum.planes[PLANE_TOP] = row(3) - row(1);
+    frustum.planes[PLANE_NEAR] = row(2);
+    frustum.planes[PLANE_FAR] = row(3) - row(2);
+
+    for (auto &plane : frustum.planes)
+    {
+        plane /= glm::length(glm::vec3{plane});
+    }
+    return frustum;
+}
+
+// Conservative, spheres just outside of a corner are kept
+bool Frustum::intersectsSphere(const glm::vec3 &center, float radius) const
+{
+    for (const auto &plane : planes)
+    {
+        if (glm::dot(glm::vec3{plane}, center) + plane.w < -radius)
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,204 @@
+#include "frustum_culler.hpp"
+
+// std
+#include <algorithm>
+#include <bit>
+#include <numeric>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_CULLER_SSE
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+// Ranges start on a multiple of this, so no two threads write the same cache line of visibility flags
+constexpr size_t RANGE_ALIGNMENT = 64;
+
+struct Spheres
+{
+    const float *x;
+    const float *y;
+    const float *z;
+    const float *radius;
+    uint8_t *visible;
+};
+
+#if defined(__AVX__) || defined(FRUSTUM_CULLER_SSE)
+void writeLanes(uint8_t *visible, int mask, size_t lanes)
+{
+    for (size_t lane = 0; lane < lanes; lane++)
+    {
+        visible[lane] = static_cast<uint8_t>((mask >> lane) & 1);
+    }
+}
+#endif
+
+// cullLanes() tests whole groups of SIMD lanes from index on and advances it past the last sphere tested.
+// It returns the number of visible spheres, the remaining ones are left to the scalar loop.
+#if defined(__AVX__)
+size_t cullLanes(const Frustum &frustum, const Spheres &spheres, size_t &index, size_t end)
+{
+    constexpr size_t LANES = 8;
+    __m256 planeX[Frustum::PLANE_COUNT], planeY[Frustum::PLANE_COUNT], planeZ[Frustum::PLANE_COUNT],
+      planeW[Frustum::PLANE_COUNT];
+    for (int p = 0; p < Frustum::PLANE_COUNT; p++)
+    {
+        planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+        planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+        planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+        planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+    }
+
+    size_t visibleCount = 0;
+    for (; index + LANES <= end; index += LANES)
+    {
+        const __m256 x = _mm256_loadu_ps(spheres.x + index);
+        const __m256 y = _mm256_loadu_ps(spheres.y + index);
+        const __m256 z = _mm256_loadu_ps(spheres.z + index);
+        const __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(spheres.radius + index));
+
+        __m256 inside = _mm256_cmp_ps(negRadius, negRadius, _CMP_EQ_OQ);
+        for (int p = 0; p < Frustum::PLANE_COUNT; p++)
+        {
+            __m256 distance = _mm256_add_ps(_mm256_mul_ps(x, planeX[p]), planeW[p]);
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(y, planeY[p]));
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(z, planeZ[p]));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+        }
+
+        const int mask = _mm256_movemask_ps(inside);
+        writeLanes(spheres.visible + index, mask, LANES);
+        visibleCount += std::popcount(static_cast<unsigned>(mask));
+    }
+    return visibleCount;
+}
+#elif defined(FRUSTUM_CULLER_SSE)
+size_t cullLanes(const Frustum &frustum, const Spheres &spheres, size_t &index, size_t end)
+{
+    constexpr size_t LANES = 4;
+    __m128 planeX[Frustum::PLANE_COUNT], planeY[Frustum::PLANE_COUNT], planeZ[Frustum::PLANE_COUNT],
+      planeW[Frustum::PLANE_COUNT];
+    for (int p = 0; p < Frustum::PLANE_COUNT; p++)
+    {
+        planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+        planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+        planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+        planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+    }
+
+    size_t visibleCount = 0;
+    for (; index + LANES <= end; index += LANES)
+    {
+        const __m128 x = _mm_loadu_ps(spheres.x + index);
+        const __m128 y = _mm_loadu_ps(spheres.y + index);
+        const __m128 z = _mm_loadu_ps(spheres.z + index);
+        const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(spheres.radius + index));
+
+        __m128 inside = _mm_cmpeq_ps(negRadius, negRadius);
+        for (int p = 0; p < Frustum::PLANE_COUNT; p++)
+        {
+            __m128 distance = _mm_add_ps(_mm_mul_ps(x, planeX[p]), planeW[p]);
+            distance = _mm_add_ps(distance, _mm_mul_ps(y, planeY[p]));
+            distance = _mm_add_ps(distance, _mm_mul_ps(z, planeZ[p]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+        }
+
+        const int mask = _mm_movemask_ps(inside);
+        writeLanes(spheres.visible + index, mask, LANES);
+        visibleCount += std::popcount(static_cast<unsigned>(mask));
+    }
+    return visibleCount;
+}
+#else
+size_t cullLanes(const Frustum &, const Spheres &, size_t &, size_t)
+{
+    return 0;
+}
+#endif
+} // namespace
+
+FrustumCuller::FrustumCuller(WorkerPool &workers, uint32_t threadCount)
+  : workers_{workers}, threadCount_{std::max(1u, std::min(threadCount, workers.getThreadCount()))}
+{
+    ranges_.reserve(getThreadCount());
+    rangeVisible_.reserve(getThreadCount());
+}
+
+const char *FrustumCuller::getSimdName()
+{
+#if defined(__AVX__)
+    return "AVX";
+#elif defined(FRUSTUM_CULLER_SSE)
+    return "SSE";
+#else
+    return "scalar";
+#endif
+}
+
+void FrustumCuller::clear()
+{
+    centerX_.clear();
+    centerY_.clear();
+    centerZ_.clear();
+    radius_.clear();
+}
+
+void FrustumCuller::addSphere(const glm::vec3 &center, float radius)
+{
+    centerX_.push_back(center.x);
+    centerY_.push_back(center.y);
+    centerZ_.push_back(center.z);
+    radius_.push_back(radius);
+}
+
+/**
+ * Tests all spheres added since the last clear(), see isVisible() and getStats() for the results.
+ * Returns once all ranges are culled.
+ *
+ * @param frustum Frustum in the space of the sphere centers
+ */
+void FrustumCuller::cull(const Frustum &frustum)
+{
+    frustum_ = frustum;
+    const size_t count = getSphereCount();
+    visible_.resize(count);
+
+    const size_t maxRanges = (count + MIN_SPHERES_PER_RANGE - 1) / MIN_SPHERES_PER_RANGE;
+    const size_t rangeCount = std::min<size_t>(getThreadCount(), maxRanges);
+    if (rangeCount <= 1)
+    {
+        stats_ = {count, cullRange({0, count})};
+        return;
+    }
+
+    const size_t blocks = (count + RANGE_ALIGNMENT - 1) / RANGE_ALIGNMENT;
+    ranges_.clear();
+    for (size_t i = 0; i < rangeCount; i++)
+    {
+        const size_t begin = std::min(count, blocks * i / rangeCount * RANGE_ALIGNMENT);
+        const size_t end = std::min(count, blocks * (i + 1) / rangeCount * RANGE_ALIGNMENT);
+        ranges_.push_back({begin, end});
+    }
+    rangeVisible_.assign(rangeCount, 0);
+    workers_.run(static_cast<uint32_t>(rangeCount),
+                 [this](uint32_t thread) { rangeVisible_[thread] = cullRange(ranges_[thread]); });
+    stats_ = {count, std::accumulate(rangeVisible_.begin(), rangeVisible_.end(), size_t{0})};
+}
+
+size_t FrustumCuller::cullRange(const Range &range)
+{
+    const Spheres spheres{centerX_.data(), centerY_.data(), centerZ_.data(), radius_.data(), visible_.data()};
+    size_t index = range.begin;
+    size_t visibleCount = cullLanes(frustum_, spheres, index, range.end);
+    for (; index < range.end; index++)
+    {
+        const bool visible = frustum_.intersectsSphere({centerX_[index], centerY_[index], centerZ_[index]},
+                                                       radius_[index]);
+        visible_[index] = visible ? 1 : 0;
+        visibleCount += visible ? 1 : 0;
+    }
+    return visibleCount;
+}
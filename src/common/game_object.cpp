@@ -1,69 +1,35 @@
 #include "game_object.hpp"
 
-glm::mat4 TransformComponent::mat4()
+// Both matrices share the rotation, so the sines and cosines are computed once for the two
+void TransformComponent::updateMatrices() const
 {
-    const float c3 = glm::cos(rotation.z);
-    const float s3 = glm::sin(rotation.z);
-    const float c2 = glm::cos(rotation.x);
-    const float s2 = glm::sin(rotation.x);
-    const float c1 = glm::cos(rotation.y);
-    const float s1 = glm::sin(rotation.y);
-
-    return glm::mat4{{
-                       scale.x * (c1 * c3 + s1 * s2 * s3),
-                       scale.x * (c2 * s3),
-                       scale.x * (c1 * s2 * s3 - c3 * s1),
-                       0.0f,
-                     },
-                     {
-                       scale.y * (c3 * s1 * s2 - c1 * s3),
-                       scale.y * (c2 * c3),
-                       scale.y * (c1 * c3 * s2 + s1 * s3),
-                       0.0f,
-                     },
-                     {
-                       scale.z * (c2 * s1),
-                       scale.z * (-s2),
-                       scale.z * (c1 * c2),
-                       0.0f,
-                     },
-                     {translation.x, translation.y, translation.z, 1.0f}};
-}
-
-glm::mat3 TransformComponent::normalMatrix()
-{
-    const float c3 = glm::cos(rotation.z);
-    const float s3 = glm::sin(rotation.z);
-    const float c2 = glm::cos(rotation.x);
-    const float s2 = glm::sin(rotation.x);
-    const float c1 = glm::cos(rotation.y);
-    const float s1 = glm::sin(rotation.y);
-    const glm::vec3 invScale = 1.0f / scale;
-
-    return glm::mat3{
-      {
-        invScale.x * (c1 * c3 + s1 * s2 * s3),
-        invScale.x * (c2 * s3),
-        invScale.x * (c1 * s2 * s3 - c3 * s1),
-      },
-      {
-        invScale.y * (c3 * s1 * s2 - c1 * s3),
-        invScale.y * (c2 * c3),
-        invScale.y * (c1 * c3 * s2 + s1 * s3),
-      },
-      {
-        invScale.z * (c2 * s1),
-        invScale.z * (-s2),
-        invScale.z * (c1 * c2),
-      },
+    const float c3 = glm::cos(rotation_.z);
+    const float s3 = glm::sin(rotation_.z);
+    const float c2 = glm::cos(rotation_.x);
+    const float s2 = glm::sin(rotation_.x);
+    const float c1 = glm::cos(rotation_.y);
+    const float s1 = glm::sin(rotation_.y);
+    const glm::vec3 rotationColumns[3] = {
+      {c1 * c3 + s1 * s2 * s3, c2 * s3, c1 * s2 * s3 - c3 * s1},
+      {c3 * s1 * s2 - c1 * s3, c2 * c3, c1 * c3 * s2 + s1 * s3},
+      {c2 * s1, -s2, c1 * c2},
     };
+
+    const glm::vec3 invScale = 1.0f / scale_;
+    for (int column = 0; column < 3; column++)
+    {
+        matrix_[column] = glm::vec4{scale_[column] * rotationColumns[column], 0.0f};
+        normalMatrix_[column] = invScale[column] * rotationColumns[column];
+    }
+    matrix_[3] = glm::vec4{translation_, 1.0f};
+    dirty_ = false;
 }
 
 GameObject GameObject::makePointLight(float intensity, float radius, glm::vec3 color)
 {
     GameObject gameObj = GameObject::createGameObject();
     gameObj.color = color;
-    gameObj.transform.scale.x = radius;
+    gameObj.transform.setScale({radius, 1.f, 1.f});
     gameObj.pointLight = std::make_unique<PointLightComponent>();
     gameObj.pointLight->lightIntensity = intensity;
     return gameObj;
@@ -0,0 +1,615 @@
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include "frame_timeline.hpp"
+#include "frustum.hpp"
+#include "gpu_driven_render_system.hpp"
+
+namespace
+{
+// std430 layouts of gpu_cull.comp
+struct GpuObject
+{
+    glm::mat4 modelMatrix;
+    glm::mat4 normalMatrix;
+    glm::vec4 boundingSphere;
+    uint32_t group;
+    uint32_t padding[3];
+};
+
+struct GpuDrawGroup
+{
+    uint32_t indexCount;
+    uint32_t firstCommand;
+};
+
+struct CullPushConstantData
+{
+    glm::vec4 frustumPlanes[Frustum::PLANE_COUNT];
+    uint32_t objectCount;
+    uint32_t commandOffset;
+    uint32_t countOffset;
+};
+
+// std140 layout of the late phase's Occlusion block
+struct OcclusionUniforms
+{
+    glm::mat4 viewProjection;
+    uint32_t mipLevels;
+};
+
+static_assert(sizeof(GpuObject) == 160, "GpuObject must match ObjectData of gpu_cull.comp");
+
+constexpr uint32_t MIN_OBJECT_CAPACITY = 64;
+constexpr uint32_t MIN_GROUP_CAPACITY = 16;
+
+uint32_t grownCapacity(uint32_t capacity, size_t count)
+{
+    while (capacity < count)
+    {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+void bufferBarrier(VkCommandBuffer commandBuffer,
+                   VkBuffer buffer,
+                   VkPipelineStageFlags srcStage,
+                   VkAccessFlags srcAccess,
+                   VkPipelineStageFlags dstStage,
+                   VkAccessFlags dstAccess)
+{
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = buffer;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+CullPushConstantData cullPushConstants(const glm::mat4 &viewProjection, uint32_t objectCount)
+{
+    CullPushConstantData push{};
+    const auto frustum = Frustum::fromMatrix(viewProjection);
+    std::copy(frustum.planes.begin(), frustum.planes.end(), push.frustumPlanes);
+    push.objectCount = objectCount;
+    return push;
+}
+
+// The counts are also read back by the host once the frame completes
+void commandsBarrier(VkCommandBuffer commandBuffer, VkBuffer commands, VkBuffer counts)
+{
+    bufferBarrier(commandBuffer,
+                  commands,
+                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                  VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                  VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+    bufferBarrier(commandBuffer,
+                  counts,
+                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                  VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+                  VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT);
+}
+} // namespace
+
+GpuDrivenRenderSystem::GpuDrivenRenderSystem(Device &device,
+                                             const RenderTargetInfo &renderTarget,
+                                             VkDescriptorSetLayout globalSetLayout,
+                                             uint32_t framesInFlight,
+                                             bool occlusionCulling)
+  : device_{device}, phaseCount_{occlusionCulling ? 2u : 1u}
+{
+    if (!isSupported(device_))
+    {
+        throw std::runtime_error("gpu driven rendering needs indirect count draws!");
+    }
+    if (occlusionCulling)
+    {
+        hiZPyramid_ = std::make_unique<HiZPyramid>(device_, framesInFlight);
+    }
+    createDescriptors(framesInFlight);
+    createPipelineLayouts(globalSetLayout);
+    createPipelines(renderTarget);
+}
+
+GpuDrivenRenderSystem::~GpuDrivenRenderSystem()
+{
+    vkDestroyPipelineLayout(device_.device(), cullPipelineLayout_, nullptr);
+    vkDestroyPipelineLayout(device_.device(), drawPipelineLayout_, nullptr);
+}
+
+/**
+ * Uploads the objects of the frame and records the compute pass that culls them and writes the draw
+ * commands renderGameObjects() issues. The commands are written before the render pass starts. With
+ * occlusion culling this is the early phase, which keeps the objects visible in the previous frame.
+ *
+ * @param frameInfo Frame being recorded, outside of a render pass
+ */
+void GpuDrivenRenderSystem::cull(FrameInfo &frameInfo)
+{
+    auto &frame = frames_[frameInfo.frameIndex];
+
+    // The frame that last used the slot has completed, its counts are final
+    if (frame.counts != nullptr)
+    {
+        const auto *counts = static_cast<const uint32_t *>(frame.counts->getMappedMemory());
+        visibleCount_ = std::accumulate(counts, counts + phaseCount_ * frame.groupCount, 0u);
+    }
+    const glm::mat4 viewProjection = frameInfo.camera.getProjection() * frameInfo.camera.getView();
+    currentFrame_ = {frameInfo.frameIndex, frameInfo.globalDescriptorSet, frameInfo.renderExtent, viewProjection};
+
+    drawGroups_.clear();
+    std::unordered_map<Model *, uint32_t> groupIndices;
+    std::vector<GameObject *> objects;
+    objects.reserve(frameInfo.gameObjects.size());
+    for (auto &kv : frameInfo.gameObjects)
+    {
+        Model *model = kv.second.model.get();
+        // The generated commands are indexed draws
+        if (model == nullptr || !model->hasIndexBuffer())
+        {
+            continue;
+        }
+        auto inserted = groupIndices.try_emplace(model, static_cast<uint32_t>(drawGroups_.size()));
+        if (inserted.second)
+        {
+            drawGroups_.push_back({model, 0, 0});
+        }
+        drawGroups_[inserted.first->second].maxDraws++;
+        objects.push_back(&kv.second);
+    }
+
+    objectCount_ = static_cast<uint32_t>(objects.size());
+    frame.groupCount = static_cast<uint32_t>(drawGroups_.size());
+    if (objects.empty())
+    {
+        return;
+    }
+
+    // Every object of a group may be visible, so each group gets room for all of them
+    uint32_t firstCommand = 0;
+    for (auto &group : drawGroups_)
+    {
+        group.firstCommand = firstCommand;
+        firstCommand += group.maxDraws;
+    }
+
+    auto commandBuffer = frameInfo.commandBuffer;
+    reserve(frame, objects.size(), drawGroups_.size());
+    if (isOcclusionCullingEnabled())
+    {
+        reserveVisibility(commandBuffer, objects.size());
+    }
+    auto *groupData = static_cast<GpuDrawGroup *>(frame.groups->getMappedMemory());
+    for (size_t g = 0; g < drawGroups_.size(); g++)
+    {
+        groupData[g] = {drawGroups_[g].model->getIndexCount(), drawGroups_[g].firstCommand};
+    }
+    auto *objectData = static_cast<GpuObject *>(frame.objects->getMappedMemory());
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        auto &obj = *objects[i];
+        objectData[i].modelMatrix = obj.transform.mat4();
+        objectData[i].normalMatrix = obj.transform.normalMatrix();
+        objectData[i].boundingSphere = obj.model->getBoundingSphere();
+        objectData[i].group = groupIndices[obj.model.get()];
+    }
+    // Buffers may have been replaced or relocated by the defragmenter since the slot was last used
+    writeDescriptorSets(frame);
+
+    GpuProfiler::Scope profilerScope{frameInfo.profiler, commandBuffer, "gpu culling"};
+
+    const VkDeviceSize countsSize = sizeof(uint32_t) * phaseCount_ * drawGroups_.size();
+    vkCmdFillBuffer(commandBuffer, frame.counts->getBuffer(), 0, countsSize, 0);
+    bufferBarrier(commandBuffer,
+                  frame.counts->getBuffer(),
+                  VK_PIPELINE_STAGE_TRANSFER_BIT,
+                  VK_ACCESS_TRANSFER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                  VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    if (isOcclusionCullingEnabled())
+    {
+        // Written by the previous frame's late phase, or cleared by reserveVisibility()
+        bufferBarrier(commandBuffer,
+                      visibility_->getBuffer(),
+                      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                      VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+                      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                      VK_ACCESS_SHADER_READ_BIT);
+    }
+
+    const auto push = cullPushConstants(viewProjection, objectCount_);
+
+    cullPipeline_->bind(commandBuffer);
+    vkCmdBindDescriptorSets(
+      commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout_, 0, 1, &frame.cullSet, 0, nullptr);
+    vkCmdPushConstants(
+      commandBuffer, cullPipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstantData), &push);
+    vkCmdDispatch(commandBuffer, (objectCount_ + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+    commandsBarrier(commandBuffer, frame.commands->getBuffer(), frame.counts->getBuffer());
+}
+
+/**
+ * Draws the objects the cull() call of the same frame kept
+ *
+ * @param frameInfo Frame being recorded, inside of the render pass
+ */
+void GpuDrivenRenderSystem::renderGameObjects(FrameInfo &frameInfo)
+{
+    if (objectCount_ == 0)
+    {
+        return;
+    }
+
+    const auto &frame = frames_[frameInfo.frameIndex];
+    auto recordGroups = [&](VkCommandBuffer commandBuffer, size_t begin, size_t end) {
+        recordDraws(commandBuffer, frameInfo.globalDescriptorSet, frame, 0, begin, end);
+    };
+
+    if (frameInfo.recorder != nullptr && frameInfo.recorder->isInPass())
+    {
+        frameInfo.recorder->record(frameInfo.commandBuffer, drawGroups_.size(), recordGroups);
+        return;
+    }
+
+    GpuProfiler::Scope profilerScope{frameInfo.profiler, frameInfo.commandBuffer, "gpu driven render system"};
+    recordGroups(frameInfo.commandBuffer, 0, drawGroups_.size());
+}
+
+void GpuDrivenRenderSystem::createDescriptors(uint32_t framesInFlight)
+{
+    DescriptorSetLayout::Builder cullSetLayoutBuilder{device_};
+    cullSetLayoutBuilder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+      .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+      .addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+      .addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
+    if (isOcclusionCullingEnabled())
+    {
+        cullSetLayoutBuilder.addBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
+        occlusionSetLayout_ = DescriptorSetLayout::Builder(device_)
+                                .addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+                                .addBinding(1, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT)
+                                .build();
+    }
+    cullSetLayout_ = cullSetLayoutBuilder.build();
+    objectSetLayout_ = DescriptorSetLayout::Builder(device_)
+                         .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+                         .build();
+
+    // Four storage buffers for culling and one for drawing per frame, occlusion culling adds the visibility
+    // buffer and the occlusion set
+    const bool occlusion = isOcclusionCullingEnabled();
+    descriptorPool_ = DescriptorPool::Builder(device_)
+                        .setMaxSets((occlusion ? 3 : 2) * framesInFlight)
+                        .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, (occlusion ? 6 : 5) * framesInFlight)
+                        .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, framesInFlight)
+                        .addPoolSize(VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, framesInFlight)
+                        .build();
+
+    frames_.resize(framesInFlight);
+    for (auto &frame : frames_)
+    {
+        if (!descriptorPool_->allocateDescriptor(cullSetLayout_->getDescriptorSetLayout(), frame.cullSet) ||
+            !descriptorPool_->allocateDescriptor(objectSetLayout_->getDescriptorSetLayout(), frame.objectSet))
+        {
+            throw std::runtime_error("failed to allocate gpu culling descriptor sets!");
+        }
+        if (!occlusion)
+        {
+            continue;
+        }
+        if (!descriptorPool_->allocateDescriptor(occlusionSetLayout_->getDescriptorSetLayout(), frame.occlusionSet))
+        {
+            throw std::runtime_error("failed to allocate occlusion culling descriptor set!");
+        }
+        frame.occlusionUniforms = std::make_unique<Buffer>(device_,
+                                                           sizeof(OcclusionUniforms),
+                                                           1,
+                                                           VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                                                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        frame.occlusionUniforms->map();
+    }
+}
+
+void GpuDrivenRenderSystem::createPipelineLayouts(VkDescriptorSetLayout globalSetLayout)
+{
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullPushConstantData);
+
+    // The early phase doesn't use the occlusion set, but shares the layout with the late one
+    std::vector<VkDescriptorSetLayout> cullSetLayouts{cullSetLayout_->getDescriptorSetLayout()};
+    if (isOcclusionCullingEnabled())
+    {
+        cullSetLayouts.push_back(occlusionSetLayout_->getDescriptorSetLayout());
+    }
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(cullSetLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = cullSetLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(device_.device(), &pipelineLayoutInfo, nullptr, &cullPipelineLayout_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create culling pipeline layout!");
+    }
+
+    // The transforms come from the object buffer, there are no push constants
+    std::vector<VkDescriptorSetLayout> descriptorSetLayouts{globalSetLayout,
+                                                            objectSetLayout_->getDescriptorSetLayout()};
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    pipelineLayoutInfo.pPushConstantRanges = nullptr;
+    if (vkCreatePipelineLayout(device_.device(), &pipelineLayoutInfo, nullptr, &drawPipelineLayout_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+}
+
+void GpuDrivenRenderSystem::createPipelines(const RenderTargetInfo &renderTarget)
+{
+    assert(cullPipelineLayout_ != nullptr && drawPipelineLayout_ != nullptr &&
+           "Cannot create pipelines before pipeline layouts");
+
+    if (isOcclusionCullingEnabled())
+    {
+        cullPipeline_ = std::make_unique<ComputePipeline>(device_, "gpu_cull_early.comp.spv", cullPipelineLayout_);
+        lateCullPipeline_ =
+          std::make_unique<ComputePipeline>(device_, "gpu_cull_late.comp.spv", cullPipelineLayout_);
+    }
+    else
+    {
+        cullPipeline_ = std::make_unique<ComputePipeline>(device_, "gpu_cull.comp.spv", cullPipelineLayout_);
+    }
+
+    PipelineConfigInfo pipelineConfig{};
+    Pipeline::defaultPipelineConfigInfo(pipelineConfig);
+    pipelineConfig.renderTarget = renderTarget;
+    pipelineConfig.pipelineLayout = drawPipelineLayout_;
+    drawPipeline_ = std::make_unique<Pipeline>(
+      device_, "simple_shader_indirect.vert.spv", "simple_shader.frag.spv", pipelineConfig);
+}
+
+/**
+ * Makes sure the buffers of a frame slot hold enough objects and groups. The frame that last used the slot
+ * has completed, so outgrown buffers can be replaced right away.
+ */
+void GpuDrivenRenderSystem::reserve(FrameResources &frame, size_t objectCount, size_t groupCount)
+{
+    constexpr VkMemoryPropertyFlags hostVisible =
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    if (frame.objects == nullptr || frame.objects->getInstanceCount() < objectCount)
+    {
+        const uint32_t capacity = grownCapacity(MIN_OBJECT_CAPACITY, objectCount);
+        frame.objects = std::make_unique<Buffer>(
+          device_, sizeof(GpuObject), capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible);
+        frame.objects->map();
+        // Only the GPU writes the commands, one per object and phase at most
+        frame.commands = std::make_unique<Buffer>(device_,
+                                                  sizeof(VkDrawIndexedIndirectCommand),
+                                                  phaseCount_ * capacity,
+                                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                    VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                                                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+
+    if (frame.groups == nullptr || frame.groups->getInstanceCount() < groupCount)
+    {
+        const uint32_t capacity = grownCapacity(MIN_GROUP_CAPACITY, groupCount);
+        frame.groups = std::make_unique<Buffer>(
+          device_, sizeof(GpuDrawGroup), capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible);
+        frame.groups->map();
+        frame.counts = std::make_unique<Buffer>(device_,
+                                                sizeof(uint32_t),
+                                                phaseCount_ * capacity,
+                                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                  VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                                  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                hostVisible);
+        frame.counts->map();
+    }
+}
+
+/**
+ * Makes sure the visibility buffer holds every object. It is shared by the frames in flight, so the submitted
+ * ones are waited for before it is replaced, which only happens when the scene grows past a power of two.
+ */
+void GpuDrivenRenderSystem::reserveVisibility(VkCommandBuffer commandBuffer, size_t objectCount)
+{
+    if (visibility_ != nullptr && visibility_->getInstanceCount() >= objectCount)
+    {
+        return;
+    }
+
+    auto &timeline = device_.frameTimeline();
+    timeline.wait(timeline.submittedValue());
+    visibility_ = std::make_unique<Buffer>(device_,
+                                           sizeof(uint32_t),
+                                           grownCapacity(MIN_OBJECT_CAPACITY, objectCount),
+                                           VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    // Nothing counts as visible, so the late phase draws everything that is
+    vkCmdFillBuffer(commandBuffer, visibility_->getBuffer(), 0, VK_WHOLE_SIZE, 0);
+}
+
+void GpuDrivenRenderSystem::writeDescriptorSets(FrameResources &frame)
+{
+    auto objectsInfo = frame.objects->descriptorInfo();
+    auto groupsInfo = frame.groups->descriptorInfo();
+    auto commandsInfo = frame.commands->descriptorInfo();
+    auto countsInfo = frame.counts->descriptorInfo();
+
+    DescriptorWriter cullWriter{*cullSetLayout_, *descriptorPool_};
+    cullWriter.writeBuffer(0, &objectsInfo)
+      .writeBuffer(1, &groupsInfo)
+      .writeBuffer(2, &commandsInfo)
+      .writeBuffer(3, &countsInfo);
+    VkDescriptorBufferInfo visibilityInfo{};
+    if (visibility_ != nullptr)
+    {
+        visibilityInfo = visibility_->descriptorInfo();
+        cullWriter.writeBuffer(4, &visibilityInfo);
+    }
+    cullWriter.overwrite(frame.cullSet);
+    DescriptorWriter(*objectSetLayout_, *descriptorPool_).writeBuffer(0, &objectsInfo).overwrite(frame.objectSet);
+}
+
+/**
+ * Records the indirect count draws of one phase for a range of the draw groups
+ *
+ * @param phase 0 for the objects culled by cull(), 1 for the late phase of occlusion culling
+ */
+void GpuDrivenRenderSystem::recordDraws(VkCommandBuffer commandBuffer,
+                                        VkDescriptorSet globalDescriptorSet,
+                                        const FrameResources &frame,
+                                        uint32_t phase,
+                                        size_t begin,
+                                        size_t end)
+{
+    drawPipeline_->bind(commandBuffer);
+    VkDescriptorSet descriptorSets[] = {globalDescriptorSet, frame.objectSet};
+    vkCmdBindDescriptorSets(
+      commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawPipelineLayout_, 0, 2, descriptorSets, 0, nullptr);
+
+    const VkDeviceSize firstCommand = phase * objectCount_;
+    const VkDeviceSize firstCount = phase * frame.groupCount;
+    for (size_t g = begin; g < end; g++)
+    {
+        const auto &group = drawGroups_[g];
+        group.model->bind(commandBuffer);
+        vkCmdDrawIndexedIndirectCount(commandBuffer,
+                                      frame.commands->getBuffer(),
+                                      (firstCommand + group.firstCommand) * sizeof(VkDrawIndexedIndirectCommand),
+                                      frame.counts->getBuffer(),
+                                      (firstCount + g) * sizeof(uint32_t),
+                                      group.maxDraws,
+                                      sizeof(VkDrawIndexedIndirectCommand));
+    }
+}
+
+/**
+ * Adds the late phase of occlusion culling to the passes after the scene: building the depth pyramid from
+ * the depth of the objects drawn by the early phase, testing every object against it and drawing the ones
+ * that became visible on top of the scene. The pyramid is resized to the scene first.
+ *
+ * @param graph Graph of the passes after the scene, not compiled yet
+ * @param scene Scene images in the graph
+ */
+void GpuDrivenRenderSystem::addOcclusionPasses(RenderGraph &graph, const Renderer::SceneResources &scene)
+{
+    assert(isOcclusionCullingEnabled() && "Occlusion culling is not enabled");
+
+    hiZPyramid_->resize(scene.extent);
+    // Only needed within the frame, so the graph owns it
+    const auto pyramid = graph.createImage("depth pyramid", hiZPyramid_->getImageInfo());
+
+    const auto depth = scene.depth;
+    graph.addPass(
+      "hi-z build",
+      RenderGraph::PassType::Compute,
+      [&](RenderGraph::PassBuilder &pass) {
+          pass.sample(depth).writeStorage(pyramid, VK_ATTACHMENT_LOAD_OP_DONT_CARE);
+      },
+      [this, &graph, depth, pyramid](VkCommandBuffer commandBuffer) {
+          if (objectCount_ > 0)
+          {
+              hiZPyramid_->build(commandBuffer,
+                                 currentFrame_.frameIndex,
+                                 graph.getImage(pyramid),
+                                 graph.getImageView(depth),
+                                 currentFrame_.renderExtent);
+          }
+      });
+    graph.addPass(
+      "occlusion culling",
+      RenderGraph::PassType::Compute,
+      [&](RenderGraph::PassBuilder &pass) { pass.sample(pyramid).sideEffect(); },
+      [this, &graph, pyramid](VkCommandBuffer commandBuffer) { cullLate(commandBuffer, graph.getImageView(pyramid)); });
+    graph.addPass(
+      "occlusion draws",
+      RenderGraph::PassType::Graphics,
+      [&](RenderGraph::PassBuilder &pass) {
+          pass.writeColor(scene.color, VK_ATTACHMENT_LOAD_OP_LOAD).writeDepth(depth, VK_ATTACHMENT_LOAD_OP_LOAD);
+      },
+      [this](VkCommandBuffer commandBuffer) { drawLate(commandBuffer); });
+}
+
+void GpuDrivenRenderSystem::cullLate(VkCommandBuffer commandBuffer, VkImageView pyramidView)
+{
+    if (objectCount_ == 0)
+    {
+        return;
+    }
+
+    // The graph, and with it the pyramid, may have been rebuilt since the slot was last used
+    auto &frame = frames_[currentFrame_.frameIndex];
+    OcclusionUniforms uniforms{currentFrame_.viewProjection, hiZPyramid_->getMipLevels()};
+    frame.occlusionUniforms->writeToBuffer(&uniforms);
+    auto uniformsInfo = frame.occlusionUniforms->descriptorInfo();
+    VkDescriptorImageInfo pyramidInfo{VK_NULL_HANDLE, pyramidView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    DescriptorWriter(*occlusionSetLayout_, *descriptorPool_)
+      .writeBuffer(0, &uniformsInfo)
+      .writeImage(1, &pyramidInfo)
+      .overwrite(frame.occlusionSet);
+
+    // The early phase read the visibility this phase overwrites
+    bufferBarrier(commandBuffer,
+                  visibility_->getBuffer(),
+                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                  0,
+                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                  VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    auto push = cullPushConstants(currentFrame_.viewProjection, objectCount_);
+    push.commandOffset = objectCount_;
+    push.countOffset = frame.groupCount;
+
+    lateCullPipeline_->bind(commandBuffer);
+    VkDescriptorSet descriptorSets[] = {frame.cullSet, frame.occlusionSet};
+    vkCmdBindDescriptorSets(
+      commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout_, 0, 2, descriptorSets, 0, nullptr);
+    vkCmdPushConstants(
+      commandBuffer, cullPipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstantData), &push);
+    vkCmdDispatch(commandBuffer, (objectCount_ + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+    commandsBarrier(commandBuffer, frame.commands->getBuffer(), frame.counts->getBuffer());
+}
+
+void GpuDrivenRenderSystem::drawLate(VkCommandBuffer commandBuffer)
+{
+    if (objectCount_ == 0)
+    {
+        return;
+    }
+
+    // The pass covers the whole scene, the frame only renders into part of it
+    const auto extent = currentFrame_.renderExtent;
+    VkViewport viewport{0.f, 0.f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.f, 1.f};
+    VkRect2D scissor{{0, 0}, extent};
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    recordDraws(commandBuffer,
+                currentFrame_.globalDescriptorSet,
+                frames_[currentFrame_.frameIndex],
+                1,
+                0,
+                drawGroups_.size());
+}
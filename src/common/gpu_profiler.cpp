@@ -0,0 +1,232 @@
+#include "gpu_profiler.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace
+{
+// Value at fraction p of the sorted samples, without interpolation
+double percentile(const std::vector<double> &sorted, double p)
+{
+    const size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+} // namespace
+
+GpuProfiler::Scope::Scope(GpuProfiler *profiler, VkCommandBuffer commandBuffer, const char *name)
+  : profiler_{profiler}, commandBuffer_{commandBuffer}, scope_{INVALID_SCOPE}
+{
+    if (profiler_ != nullptr)
+    {
+        scope_ = profiler_->beginScope(commandBuffer_, name);
+    }
+}
+
+GpuProfiler::Scope::~Scope()
+{
+    if (profiler_ != nullptr)
+    {
+        profiler_->endScope(commandBuffer_, scope_);
+    }
+}
+
+GpuProfiler::GpuProfiler(Device &device, uint32_t framesInFlight) : device_{device}, frames_(framesInFlight)
+{
+    const uint32_t validBits = device_.timestampValidBits();
+    timestampMask_ = validBits >= 64 ? UINT64_MAX : (uint64_t{1} << validBits) - 1;
+
+    if (!isSupported())
+    {
+        return;
+    }
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = 2 * MAX_SCOPES;
+
+    for (auto &frame : frames_)
+    {
+        if (vkCreateQueryPool(device_.device(), &queryPoolInfo, nullptr, &frame.queryPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create timestamp query pool!");
+        }
+    }
+}
+
+GpuProfiler::~GpuProfiler()
+{
+    for (auto &frame : frames_)
+    {
+        if (frame.queryPool != VK_NULL_HANDLE)
+        {
+            vkDestroyQueryPool(device_.device(), frame.queryPool, nullptr);
+        }
+    }
+}
+
+/**
+ * Reads back the timestamps this frame slot recorded last time around and starts recording a new frame.
+ * Must be called outside of a render pass, after the fence of the slot has been waited on.
+ *
+ * @param commandBuffer Command buffer of the frame, in the recording state
+ * @param frameIndex Index of the frame in flight
+ */
+void GpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+    assert(frameIndex < frames_.size() && "Frame index out of range");
+    if (!isSupported())
+    {
+        return;
+    }
+
+    auto &frame = frames_[frameIndex];
+    if (frame.submitted)
+    {
+        collect(frame);
+    }
+
+    vkCmdResetQueryPool(commandBuffer, frame.queryPool, 0, 2 * MAX_SCOPES);
+    frame.scopeNames.clear();
+    frame.scopeEnded.clear();
+    frame.submitted = true;
+
+    currentFrame_ = &frame;
+    frameScope_ = beginScope(commandBuffer, FRAME_SCOPE);
+}
+
+void GpuProfiler::endFrame(VkCommandBuffer commandBuffer)
+{
+    if (currentFrame_ == nullptr)
+    {
+        return;
+    }
+
+    endScope(commandBuffer, frameScope_);
+    currentFrame_ = nullptr;
+    frameScope_ = INVALID_SCOPE;
+}
+
+/**
+ * Writes the start timestamp of a scope
+ *
+ * @param commandBuffer Command buffer of the current frame
+ * @param name Name the timings are reported under. Scopes sharing a name within a frame are summed up.
+ *
+ * @return Handle to pass to endScope(), INVALID_SCOPE once a frame ran out of queries
+ */
+uint32_t GpuProfiler::beginScope(VkCommandBuffer commandBuffer, const char *name)
+{
+    if (currentFrame_ == nullptr || currentFrame_->scopeNames.size() >= MAX_SCOPES)
+    {
+        return INVALID_SCOPE;
+    }
+
+    const auto scope = static_cast<uint32_t>(currentFrame_->scopeNames.size());
+    currentFrame_->scopeNames.emplace_back(name);
+    currentFrame_->scopeEnded.push_back(false);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, currentFrame_->queryPool, 2 * scope);
+    return scope;
+}
+
+void GpuProfiler::endScope(VkCommandBuffer commandBuffer, uint32_t scope)
+{
+    if (currentFrame_ == nullptr || scope == INVALID_SCOPE)
+    {
+        return;
+    }
+
+    assert(!currentFrame_->scopeEnded[scope] && "Scope ended twice");
+    currentFrame_->scopeEnded[scope] = true;
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, currentFrame_->queryPool, 2 * scope + 1);
+}
+
+std::vector<GpuProfiler::ScopeStats> GpuProfiler::getStats() const
+{
+    std::vector<ScopeStats> stats;
+    for (const auto &[name, history] : history_)
+    {
+        if (history.samples.empty())
+        {
+            continue;
+        }
+
+        auto sorted = history.samples;
+        std::sort(sorted.begin(), sorted.end());
+
+        ScopeStats scopeStats{};
+        scopeStats.name = name;
+        scopeStats.sampleCount = sorted.size();
+        scopeStats.lastMs = history.last;
+        for (auto sample : sorted)
+        {
+            scopeStats.averageMs += sample;
+        }
+        scopeStats.averageMs /= static_cast<double>(sorted.size());
+        scopeStats.p50Ms = percentile(sorted, 0.50);
+        scopeStats.p95Ms = percentile(sorted, 0.95);
+        scopeStats.p99Ms = percentile(sorted, 0.99);
+        stats.push_back(scopeStats);
+    }
+    return stats;
+}
+
+double GpuProfiler::getLastFrameMs() const
+{
+    const auto it = history_.find(FRAME_SCOPE);
+    return it != history_.end() ? it->second.last : 0.0;
+}
+
+void GpuProfiler::collect(FrameQueries &frame)
+{
+    const auto queryCount = static_cast<uint32_t>(2 * frame.scopeNames.size());
+    if (queryCount == 0)
+    {
+        return;
+    }
+
+    // The slot's fence has signaled, so this does not wait. Anything else means the frame never ran.
+    std::vector<uint64_t> timestamps(queryCount);
+    if (vkGetQueryPoolResults(device_.device(),
+                              frame.queryPool,
+                              0,
+                              queryCount,
+                              timestamps.size() * sizeof(uint64_t),
+                              timestamps.data(),
+                              sizeof(uint64_t),
+                              VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+    {
+        return;
+    }
+
+    const double nanosecondsPerTick = static_cast<double>(device_.properties.limits.timestampPeriod);
+
+    std::map<std::string, double> frameTimes;
+    for (size_t i = 0; i < frame.scopeNames.size(); i++)
+    {
+        if (!frame.scopeEnded[i])
+        {
+            continue;
+        }
+        const uint64_t ticks = (timestamps[2 * i + 1] - timestamps[2 * i]) & timestampMask_;
+        frameTimes[frame.scopeNames[i]] += static_cast<double>(ticks) * nanosecondsPerTick * 1e-6;
+    }
+
+    for (const auto &[name, milliseconds] : frameTimes)
+    {
+        auto &history = history_[name];
+        if (history.samples.size() < HISTORY_SIZE)
+        {
+            history.samples.push_back(milliseconds);
+        }
+        else
+        {
+            history.samples[history.next] = milliseconds;
+        }
+        history.next = (history.next + 1) % HISTORY_SIZE;
+        history.last = milliseconds;
+    }
+    collectedFrames_++;
+}
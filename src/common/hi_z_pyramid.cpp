@@ -0,0 +1,218 @@
+#include "hi_z_pyramid.hpp"
+#include "frame_timeline.hpp"
+
+// std
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <stdexcept>
+
+namespace
+{
+struct BuildPushConstantData
+{
+    // Part of the source that is reduced into the destination
+    int32_t sourceWidth;
+    int32_t sourceHeight;
+};
+
+VkExtent2D mipExtent(VkExtent2D extent, uint32_t level)
+{
+    return {std::max(extent.width >> level, 1u), std::max(extent.height >> level, 1u)};
+}
+} // namespace
+
+HiZPyramid::HiZPyramid(Device &device, uint32_t framesInFlight) : device_{device}, framesInFlight_{framesInFlight}
+{
+    createPipeline();
+}
+
+HiZPyramid::~HiZPyramid()
+{
+    destroyViews();
+    vkDestroyPipelineLayout(device_.device(), pipelineLayout_, nullptr);
+}
+
+/**
+ * Sizes the pyramid for a new render graph, whose image it is built into from then on. The views of the
+ * previous graph's image may still be used by submitted frames, so they are waited for first, which only
+ * happens when the graph is rebuilt.
+ *
+ * @param sceneExtent Extent of the scene's depth images
+ */
+void HiZPyramid::resize(VkExtent2D sceneExtent)
+{
+    if (image_ != VK_NULL_HANDLE)
+    {
+        auto &timeline = device_.frameTimeline();
+        timeline.wait(timeline.submittedValue());
+        destroyViews();
+    }
+
+    extent_ = {std::bit_floor(sceneExtent.width), std::bit_floor(sceneExtent.height)};
+    mipLevels_ = static_cast<uint32_t>(std::bit_width(std::max(extent_.width, extent_.height)));
+}
+
+/**
+ * Records the reduction of the depth image into mip 0 and of every mip into the next one
+ *
+ * @param commandBuffer Command buffer of the current frame, outside of a render pass
+ * @param frameIndex Frame in flight, whose descriptor set is rewritten for depthView
+ * @param pyramid Image created with getImageInfo() since the last resize(), in VK_IMAGE_LAYOUT_GENERAL
+ * @param depthView Depth-only view of the scene's depth, in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+ * @param renderExtent Part of the depth image the current frame rendered
+ */
+void HiZPyramid::build(VkCommandBuffer commandBuffer,
+                       int frameIndex,
+                       VkImage pyramid,
+                       VkImageView depthView,
+                       VkExtent2D renderExtent)
+{
+    assert(mipLevels_ > 0 && "Depth pyramid has not been sized");
+    if (image_ == VK_NULL_HANDLE)
+    {
+        createViews(pyramid);
+    }
+    assert(image_ == pyramid && "Depth pyramid image changed without a resize");
+
+    auto &depthSet = depthSets_[frameIndex];
+    VkDescriptorImageInfo depthInfo{VK_NULL_HANDLE, depthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkDescriptorImageInfo mip0Info{VK_NULL_HANDLE, mipViews_[0], VK_IMAGE_LAYOUT_GENERAL};
+    DescriptorWriter(*setLayout_, *descriptorPool_)
+      .writeImage(0, &depthInfo)
+      .writeImage(1, &mip0Info)
+      .overwrite(depthSet);
+
+    pipeline_->bind(commandBuffer);
+    for (uint32_t level = 0; level < mipLevels_; level++)
+    {
+        if (level > 0)
+        {
+            // The previous mip is read as soon as it is written
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = image_;
+            barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 1, 0, 1};
+            vkCmdPipelineBarrier(commandBuffer,
+                                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                 0,
+                                 0,
+                                 nullptr,
+                                 0,
+                                 nullptr,
+                                 1,
+                                 &barrier);
+        }
+
+        const VkExtent2D source = level == 0 ? renderExtent : mipExtent(extent_, level - 1);
+        const BuildPushConstantData push{static_cast<int32_t>(source.width), static_cast<int32_t>(source.height)};
+        VkDescriptorSet set = level == 0 ? depthSet : mipSets_[level];
+        vkCmdBindDescriptorSets(
+          commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout_, 0, 1, &set, 0, nullptr);
+        vkCmdPushConstants(
+          commandBuffer, pipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BuildPushConstantData), &push);
+
+        const VkExtent2D destination = mipExtent(extent_, level);
+        vkCmdDispatch(commandBuffer,
+                      (destination.width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+                      (destination.height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+                      1);
+    }
+}
+
+void HiZPyramid::createPipeline()
+{
+    setLayout_ = DescriptorSetLayout::Builder(device_)
+                   .addBinding(0, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT)
+                   .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT)
+                   .build();
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(BuildPushConstantData);
+
+    VkDescriptorSetLayout setLayout = setLayout_->getDescriptorSetLayout();
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(device_.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create depth pyramid pipeline layout!");
+    }
+
+    pipeline_ = std::make_unique<ComputePipeline>(device_, "hi_z_build.comp.spv", pipelineLayout_);
+}
+
+void HiZPyramid::createViews(VkImage pyramid)
+{
+    image_ = pyramid;
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image_;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = FORMAT;
+    mipViews_.resize(mipLevels_);
+    for (uint32_t level = 0; level < mipLevels_; level++)
+    {
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+        if (vkCreateImageView(device_.device(), &viewInfo, nullptr, &mipViews_[level]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create depth pyramid view!");
+        }
+    }
+
+    const uint32_t setCount = framesInFlight_ + mipLevels_;
+    descriptorPool_ = DescriptorPool::Builder(device_)
+                        .setMaxSets(setCount)
+                        .addPoolSize(VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, setCount)
+                        .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, setCount)
+                        .build();
+
+    // The depth sets are written by build(), the depth image is only known then
+    depthSets_.resize(framesInFlight_);
+    for (auto &set : depthSets_)
+    {
+        if (!descriptorPool_->allocateDescriptor(setLayout_->getDescriptorSetLayout(), set))
+        {
+            throw std::runtime_error("failed to allocate depth pyramid descriptor set!");
+        }
+    }
+    mipSets_.resize(mipLevels_);
+    for (uint32_t level = 1; level < mipLevels_; level++)
+    {
+        VkDescriptorImageInfo sourceInfo{VK_NULL_HANDLE, mipViews_[level - 1], VK_IMAGE_LAYOUT_GENERAL};
+        VkDescriptorImageInfo destinationInfo{VK_NULL_HANDLE, mipViews_[level], VK_IMAGE_LAYOUT_GENERAL};
+        if (!DescriptorWriter(*setLayout_, *descriptorPool_)
+               .writeImage(0, &sourceInfo)
+               .writeImage(1, &destinationInfo)
+               .build(mipSets_[level]))
+        {
+            throw std::runtime_error("failed to allocate depth pyramid descriptor set!");
+        }
+    }
+}
+
+void HiZPyramid::destroyViews()
+{
+    depthSets_.clear();
+    mipSets_.clear();
+    descriptorPool_.reset();
+    for (auto view : mipViews_)
+    {
+        vkDestroyImageView(device_.device(), view, nullptr);
+    }
+    mipViews_.clear();
+    image_ = VK_NULL_HANDLE;
+}
@@ -0,0 +1,153 @@
+#include "image_writer.hpp"
+
+// std
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <vector>
+
+namespace
+{
+constexpr uint32_t BYTES_PER_PIXEL = 4;
+// Largest payload of a stored deflate block
+constexpr size_t MAX_STORED_BLOCK = 65535;
+
+const std::array<uint32_t, 256> &crcTable()
+{
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> result{};
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+            {
+                c = (c & 1) != 0 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            result[n] = c;
+        }
+        return result;
+    }();
+    return table;
+}
+
+uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0)
+{
+    const auto &table = crcTable();
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void appendBigEndian(std::vector<uint8_t> &out, uint32_t value)
+{
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void appendChunk(std::vector<uint8_t> &out, const char *type, const std::vector<uint8_t> &data)
+{
+    appendBigEndian(out, static_cast<uint32_t>(data.size()));
+    const size_t typeOffset = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    appendBigEndian(out, crc32(out.data() + typeOffset, out.size() - typeOffset));
+}
+
+// zlib stream of stored blocks over the scanlines, each prefixed with filter type 0
+std::vector<uint8_t> storedZlibStream(uint32_t width, uint32_t height, const uint8_t *rgba)
+{
+    const size_t rowSize = static_cast<size_t>(width) * BYTES_PER_PIXEL;
+    std::vector<uint8_t> scanlines;
+    scanlines.reserve((rowSize + 1) * height);
+    for (uint32_t y = 0; y < height; y++)
+    {
+        scanlines.push_back(0);
+        scanlines.insert(scanlines.end(), rgba + y * rowSize, rgba + (y + 1) * rowSize);
+    }
+
+    std::vector<uint8_t> stream;
+    stream.reserve(scanlines.size() + scanlines.size() / MAX_STORED_BLOCK * 5 + 16);
+    // deflate, 32K window, no preset dictionary, check bits for the header
+    stream.push_back(0x78);
+    stream.push_back(0x01);
+
+    uint32_t adlerA = 1;
+    uint32_t adlerB = 0;
+    size_t offset = 0;
+    do
+    {
+        const size_t blockSize = std::min(MAX_STORED_BLOCK, scanlines.size() - offset);
+        const bool last = offset + blockSize == scanlines.size();
+        const auto length = static_cast<uint16_t>(blockSize);
+        const auto inverted = static_cast<uint16_t>(~length);
+        stream.push_back(last ? 1 : 0);
+        stream.push_back(static_cast<uint8_t>(length));
+        stream.push_back(static_cast<uint8_t>(length >> 8));
+        stream.push_back(static_cast<uint8_t>(inverted));
+        stream.push_back(static_cast<uint8_t>(inverted >> 8));
+        stream.insert(stream.end(), scanlines.begin() + offset, scanlines.begin() + offset + blockSize);
+
+        for (size_t i = offset; i < offset + blockSize; i++)
+        {
+            adlerA = (adlerA + scanlines[i]) % 65521;
+            adlerB = (adlerB + adlerA) % 65521;
+        }
+        offset += blockSize;
+    } while (offset < scanlines.size());
+
+    appendBigEndian(stream, (adlerB << 16) | adlerA);
+    return stream;
+}
+
+bool writeFile(const std::string &path, const uint8_t *data, size_t size)
+{
+    std::ofstream file{path, std::ios::binary | std::ios::trunc};
+    if (!file)
+    {
+        return false;
+    }
+    file.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(size));
+    return static_cast<bool>(file);
+}
+} // namespace
+
+namespace image_writer
+{
+/**
+ * Writes an 8-bit RGBA PNG
+ *
+ * @param path File to create or overwrite
+ * @param width Width in pixels
+ * @param height Height in pixels
+ * @param rgba width * height tightly packed pixels, top row first
+ *
+ * @return False if the file could not be written
+ */
+bool writePng(const std::string &path, uint32_t width, uint32_t height, const uint8_t *rgba)
+{
+    static constexpr uint8_t SIGNATURE[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+    std::vector<uint8_t> header;
+    appendBigEndian(header, width);
+    appendBigEndian(header, height);
+    // 8 bits per channel, truecolor with alpha, deflate, adaptive filtering, no interlace
+    header.insert(header.end(), {8, 6, 0, 0, 0});
+
+    std::vector<uint8_t> png(std::begin(SIGNATURE), std::end(SIGNATURE));
+    appendChunk(png, "IHDR", header);
+    appendChunk(png, "IDAT", storedZlibStream(width, height, rgba));
+    appendChunk(png, "IEND", {});
+
+    return writeFile(path, png.data(), png.size());
+}
+
+bool writeRaw(const std::string &path, uint32_t width, uint32_t height, const uint8_t *rgba)
+{
+    return writeFile(path, rgba, static_cast<size_t>(width) * height * BYTES_PER_PIXEL);
+}
+} // namespace image_writer
@@ -2,6 +2,10 @@
 #define SRC_COMMON_INCLUDE_BUFFER
 
 #include "device.hpp"
+#include "memory_allocator.hpp"
+
+// std
+#include <cassert>
 
 class Buffer
 {
@@ -25,6 +29,15 @@ class Buffer
     VkDescriptorBufferInfo descriptorInfo(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
     VkResult invalidate(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
 
+    // Points this buffer at a relocated copy of its contents and hands back the previous binding so the
+    // caller can release it once the GPU no longer uses it. Only valid for sub-allocated buffers.
+    struct Binding
+    {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        MemoryAllocator::Allocation allocation{};
+    };
+    Binding rebind(const Binding &binding);
+
     void writeToIndex(void *data, int index);
     VkResult flushIndex(int index);
     VkDescriptorBufferInfo descriptorInfoForIndex(int index);
@@ -58,18 +71,41 @@ class Buffer
     {
         return memoryPropertyFlags_;
     }
+    bool isSubAllocated() const
+    {
+        return subAllocated_;
+    }
+    const MemoryAllocator::Allocation &getAllocation() const
+    {
+        return allocation_;
+    }
     VkDeviceSize getBufferSize() const
     {
         return bufferSize_;
     }
+    VkDeviceAddress getDeviceAddress() const
+    {
+        assert(deviceAddress_ != 0 && "Buffer was not created with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT");
+        return deviceAddress_;
+    }
+    VkDeviceAddress getDeviceAddressForIndex(uint32_t index) const
+    {
+        assert(index < instanceCount_ && "Index out of range");
+        return getDeviceAddress() + index * alignmentSize_;
+    }
 
   private:
     static VkDeviceSize getAlignment(VkDeviceSize instanceSize, VkDeviceSize minOffsetAlignment);
+    void createSubAllocatedBuffer();
+    void updateDeviceAddress();
 
     Device &device_;
     void *mapped_ = nullptr;
     VkBuffer buffer_ = VK_NULL_HANDLE;
     VkDeviceMemory memory_ = VK_NULL_HANDLE;
+    VkDeviceAddress deviceAddress_ = 0;
+    bool subAllocated_ = false;
+    MemoryAllocator::Allocation allocation_{};
 
     VkDeviceSize bufferSize_;
     uint32_t instanceCount_;
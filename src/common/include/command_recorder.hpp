@@ -0,0 +1,117 @@
+#ifndef SRC_COMMON_INCLUDE_COMMAND_RECORDER
+#define SRC_COMMON_INCLUDE_COMMAND_RECORDER
+
+#include "device.hpp"
+#include "worker_pool.hpp"
+
+// std
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// What secondary command buffers executed inside the Renderer's pass have to know about it
+struct PassInheritance
+{
+    // Null with dynamic rendering, the formats are inherited instead
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    VkFramebuffer framebuffer = VK_NULL_HANDLE;
+    VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+    // Viewport and scissor, dynamic state is not inherited from the primary
+    VkExtent2D extent{};
+};
+
+// Records the draws of a pass on several threads. The items are split into contiguous ranges, each range is
+// recorded into a secondary command buffer by one thread, and the primary executes them in range order, so
+// the result is the same as recording all items in order. Every thread allocates from its own command pool
+// per frame in flight, which is reset as a whole when the frame slot comes around again.
+//
+// A pass whose draws only change with the scene can instead be cached: it is recorded once per frame slot into
+// a secondary command buffer that outlives the frame, and replayed until the scene version or the pass changes.
+class CommandRecorder
+{
+  public:
+    // Smaller ranges cost more to hand to a thread than to record
+    static constexpr size_t MIN_ITEMS_PER_RANGE = 256;
+
+    // Records the items [begin, end) into commandBuffer, which is already begun with the pass state
+    using RecordRange = std::function<void(VkCommandBuffer commandBuffer, size_t begin, size_t end)>;
+
+    // Records on up to threadCount of the workers' threads, the calling thread records the first range. Without
+    // workers everything is recorded on the calling thread.
+    CommandRecorder(Device &device, uint32_t framesInFlight, WorkerPool *workers, uint32_t threadCount);
+    ~CommandRecorder();
+
+    CommandRecorder(const CommandRecorder &) = delete;
+    CommandRecorder &operator=(const CommandRecorder &) = delete;
+
+    uint32_t getThreadCount() const
+    {
+        return static_cast<uint32_t>(pools_.size());
+    }
+
+    bool isInPass() const
+    {
+        return inPass_;
+    }
+
+    void beginFrame(int frameIndex);
+    void beginPass(const PassInheritance &inheritance);
+    void endPass();
+    void record(VkCommandBuffer primary, size_t count, const RecordRange &recordRange);
+
+    bool replayCached(VkCommandBuffer primary, uint64_t sceneVersion);
+    void recordCached(VkCommandBuffer primary, uint64_t sceneVersion, size_t count, const RecordRange &recordRange);
+    // Called when the targets are replaced, the cached command buffers may refer to their render passes
+    void invalidateCache();
+
+  private:
+    struct ThreadPool
+    {
+        VkCommandPool pool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> commandBuffers;
+        // Command buffers handed out since the pool was last reset
+        size_t used = 0;
+    };
+
+    // Commands of a frame slot that are replayed while nothing they depend on changes
+    struct CachedPass
+    {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        bool valid = false;
+        uint64_t sceneVersion = 0;
+        PassInheritance inheritance{};
+    };
+
+    struct Range
+    {
+        size_t begin;
+        size_t end;
+    };
+
+    ThreadPool &threadPool(uint32_t thread)
+    {
+        return pools_[thread][frameIndex_];
+    }
+
+    VkCommandBuffer recordSecondary(uint32_t thread, const Range &range, const RecordRange &recordRange);
+    void beginSecondary(VkCommandBuffer commandBuffer, VkCommandBufferUsageFlags flags, VkFramebuffer framebuffer);
+    bool isCacheCompatible(const PassInheritance &cached) const;
+
+    Device &device_;
+    WorkerPool *workers_;
+    // pools_[thread][frame]
+    std::vector<std::vector<ThreadPool>> pools_;
+    int frameIndex_ = 0;
+    bool inPass_ = false;
+    PassInheritance inheritance_{};
+    // Command buffers are reset one by one, the pool is never reset as a whole
+    VkCommandPool cachePool_ = VK_NULL_HANDLE;
+    std::vector<CachedPass> cachedPasses_;
+
+    // Ranges of the current record() call and their command buffers, one per thread
+    std::vector<Range> ranges_;
+    std::vector<VkCommandBuffer> secondaries_;
+};
+
+#endif /* SRC_COMMON_INCLUDE_COMMAND_RECORDER */
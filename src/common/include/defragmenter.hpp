@@ -0,0 +1,109 @@
+#ifndef SRC_COMMON_INCLUDE_DEFRAGMENTER
+#define SRC_COMMON_INCLUDE_DEFRAGMENTER
+
+#include "buffer.hpp"
+#include "device.hpp"
+#include "frame_timeline.hpp"
+#include "memory_allocator.hpp"
+
+// std
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Incrementally compacts sub-allocated device-local buffers. A pass picks sparsely used memory blocks,
+// copies their live allocations into other blocks a few megabytes per frame and patches the owning
+// Buffers once the copies have completed on the GPU. The evacuated blocks are released when empty.
+class Defragmenter
+{
+  public:
+    struct Settings
+    {
+        // Blocks with a smaller fraction of live bytes are evacuated
+        float maxSourceUtilization = 0.5f;
+        // Upper bound of bytes copied per frame
+        VkDeviceSize bytesPerFrame = 8 * 1024 * 1024;
+    };
+
+    struct Stats
+    {
+        MemoryAllocator::Metrics before{};
+        MemoryAllocator::Metrics after{};
+        uint32_t evacuatedBlocks = 0;
+        uint32_t movedAllocations = 0;
+        uint32_t skippedAllocations = 0;
+        VkDeviceSize movedBytes = 0;
+        uint64_t startFrame = 0;
+        uint64_t endFrame = 0;
+    };
+
+    explicit Defragmenter(Device &device);
+    Defragmenter(Device &device, Settings settings);
+    ~Defragmenter();
+
+    Defragmenter(const Defragmenter &) = delete;
+    Defragmenter &operator=(const Defragmenter &) = delete;
+
+    bool begin(uint64_t frameNumber);
+    bool update(VkCommandBuffer commandBuffer, uint64_t frameNumber);
+
+    bool isActive() const
+    {
+        return !moves_.empty() || awaitingMetrics_;
+    }
+
+    const Stats &getStats() const
+    {
+        return stats_;
+    }
+
+    // Changes whenever update() rebinds buffers to new VkBuffers, so commands recorded before that reference
+    // buffers that are about to be destroyed
+    uint64_t getBindingGeneration() const
+    {
+        return bindingGeneration_;
+    }
+
+  private:
+    enum class MoveState
+    {
+        Queued,
+        Copied
+    };
+
+    struct Move
+    {
+        Buffer *owner = nullptr;
+        MemoryAllocator::Allocation source{};
+        Buffer::Binding destination{};
+        // Frame timeline value of the frame that recorded the copy
+        uint64_t copyValue = 0;
+        MoveState state = MoveState::Queued;
+    };
+
+    struct RetiredBinding
+    {
+        Buffer::Binding binding{};
+        uint64_t releaseValue = 0;
+    };
+
+    void recordCopies(VkCommandBuffer commandBuffer);
+    void applyCompletedMoves();
+    void releaseRetired(bool force);
+    void finishPass();
+    void destroyBinding(const Buffer::Binding &binding);
+
+    Device &device_;
+    MemoryAllocator &allocator_;
+    FrameTimeline &timeline_;
+    Settings settings_;
+
+    std::vector<uint32_t> sourceBlocks_;
+    std::deque<Move> moves_;
+    std::vector<RetiredBinding> retired_;
+    bool awaitingMetrics_ = false;
+    uint64_t bindingGeneration_ = 0;
+    Stats stats_{};
+};
+
+#endif /* SRC_COMMON_INCLUDE_DEFRAGMENTER */
@@ -6,9 +6,14 @@
 #include "window.hpp"
 
 // std lib headers
+#include <memory>
 #include <string>
 #include <vector>
 
+class FrameTimeline;
+class MemoryAllocator;
+class StagingPool;
+
 struct SwapChainSupportDetails
 {
     VkSurfaceCapabilitiesKHR capabilities;
@@ -37,7 +42,8 @@ class Device
     const bool enableValidationLayers = true;
 #endif
 
-    Device(Window &window);
+    // A null window creates a headless device without a surface, which can only render offscreen
+    explicit Device(Window *window);
     ~Device();
 
     // Not copyable or movable
@@ -58,6 +64,10 @@ class Device
     {
         return surface_;
     }
+    bool isHeadless() const
+    {
+        return window == nullptr;
+    }
     VkQueue graphicsQueue()
     {
         return graphicsQueue_;
@@ -66,20 +76,35 @@ class Device
     {
         return presentQueue_;
     }
+    StagingPool &stagingPool()
+    {
+        return *stagingPool_;
+    }
+    MemoryAllocator &memoryAllocator()
+    {
+        return *memoryAllocator_;
+    }
+    FrameTimeline &frameTimeline()
+    {
+        return *frameTimeline_;
+    }
 
     SwapChainSupportDetails getSwapChainSupport()
     {
         return querySwapChainSupport(physicalDevice);
     }
     uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+    bool tryFindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, uint32_t &typeIndex);
     QueueFamilyIndices findPhysicalQueueFamilies()
     {
         return findQueueFamilies(physicalDevice);
     }
     VkFormat
       findSupportedFormat(const std::vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
+    bool isFormatSupported(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features);
 
     // Buffer Helper Functions
+    VkBuffer createBufferHandle(VkDeviceSize size, VkBufferUsageFlags usage);
     void createBuffer(VkDeviceSize size,
                       VkBufferUsageFlags usage,
                       VkMemoryPropertyFlags properties,
@@ -93,7 +118,44 @@ class Device
     void createImageWithInfo(const VkImageCreateInfo &imageInfo,
                              VkMemoryPropertyFlags properties,
                              VkImage &image,
-                             VkDeviceMemory &imageMemory);
+                             VkDeviceMemory &imageMemory,
+                             VkMemoryPropertyFlags fallbackProperties = 0);
+
+    // Optional features, enabled at device creation when the physical device supports them
+    uint32_t apiVersion() const
+    {
+        return apiVersion_;
+    }
+    bool bufferDeviceAddressEnabled() const
+    {
+        return bufferDeviceAddressEnabled_;
+    }
+    bool timelineSemaphoreEnabled() const
+    {
+        return timelineSemaphoreEnabled_;
+    }
+    // Number of meaningful bits in timestamps written on the graphics queue, 0 if timestamps are unsupported
+    uint32_t timestampValidBits() const
+    {
+        return timestampValidBits_;
+    }
+    bool presentWaitEnabled() const
+    {
+        return presentWaitEnabled_;
+    }
+    VkResult waitForPresent(VkSwapchainKHR swapChain, uint64_t presentId, uint64_t timeout);
+    // Rendering straight into image views without render pass and framebuffer objects, core in 1.3
+    bool dynamicRenderingEnabled() const
+    {
+        return dynamicRenderingEnabled_;
+    }
+    void cmdBeginRendering(VkCommandBuffer commandBuffer, const VkRenderingInfo &renderingInfo);
+    void cmdEndRendering(VkCommandBuffer commandBuffer);
+    // vkCmdDrawIndexedIndirectCount with multi draw and first instance, so draws can be generated on the GPU
+    bool indirectCountEnabled() const
+    {
+        return indirectCountEnabled_;
+    }
 
     VkPhysicalDeviceProperties properties;
 
@@ -104,10 +166,12 @@ class Device
     void pickPhysicalDevice();
     void createLogicalDevice();
     void createCommandPool();
+    void queryOptionalFeatures();
 
     // helper functions
     bool isDeviceSuitable(VkPhysicalDevice device);
     std::vector<const char *> getRequiredExtensions();
+    std::vector<const char *> getRequiredDeviceExtensions();
     bool checkValidationLayerSupport();
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
     void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo);
@@ -116,18 +180,35 @@ class Device
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
     VkInstance instance;
+    uint32_t instanceApiVersion_ = VK_API_VERSION_1_0;
+    uint32_t apiVersion_ = VK_API_VERSION_1_0;
+    bool bufferDeviceAddressEnabled_ = false;
+    bool timelineSemaphoreEnabled_ = false;
+    bool presentWaitEnabled_ = false;
+    bool dynamicRenderingEnabled_ = false;
+    bool indirectCountEnabled_ = false;
+    uint32_t timestampValidBits_ = 0;
+    PFN_vkWaitForPresentKHR vkWaitForPresentKHR_ = nullptr;
+    PFN_vkCmdBeginRendering vkCmdBeginRendering_ = nullptr;
+    PFN_vkCmdEndRendering vkCmdEndRendering_ = nullptr;
     VkDebugUtilsMessengerEXT debugMessenger;
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-    Window &window;
+    Window *window;
     VkCommandPool commandPool;
 
     VkDevice device_;
-    VkSurfaceKHR surface_;
+    VkSurfaceKHR surface_ = VK_NULL_HANDLE;
     VkQueue graphicsQueue_;
     VkQueue presentQueue_;
 
+    std::unique_ptr<FrameTimeline> frameTimeline_;
+    std::unique_ptr<MemoryAllocator> memoryAllocator_;
+    std::unique_ptr<StagingPool> stagingPool_;
+
     const std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
     const std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    // deviceExtensions plus the optional extensions the physical device supports
+    std::vector<const char *> enabledExtensions_;
 };
 
 #endif /* SRC_COMMON_INCLUDE_DEVICE */
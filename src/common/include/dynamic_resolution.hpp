@@ -0,0 +1,81 @@
+#ifndef SRC_COMMON_INCLUDE_DYNAMIC_RESOLUTION
+#define SRC_COMMON_INCLUDE_DYNAMIC_RESOLUTION
+
+// vulkan headers
+#include <vulkan/vulkan.h>
+
+// std lib headers
+#include <cstdint>
+
+// Picks the fraction of the output extent the scene is rendered at, so that the measured GPU frame time
+// stays within a budget. GPU time is assumed to grow with the number of pixels, i.e. with the square of
+// the scale.
+class DynamicResolution
+{
+  public:
+    struct Settings
+    {
+        // GPU frame time to aim for, 0 disables scaling
+        double frameBudgetMs = 0.0;
+        float minScale = 0.5f;
+        float maxScale = 1.0f;
+    };
+
+    // Weight of a new sample in the smoothed frame time
+    static constexpr double SMOOTHING = 0.1;
+    // The scale only grows while the smoothed time is below INCREASE_THRESHOLD of the budget and only
+    // shrinks above DECREASE_THRESHOLD, the band in between keeps it from oscillating
+    static constexpr double INCREASE_THRESHOLD = 0.85;
+    static constexpr double DECREASE_THRESHOLD = 1.0;
+    // Changes aim for this fraction of the budget, inside the band
+    static constexpr double TARGET_FRACTION = 0.92;
+    // Frames recorded before a change are still in flight, their times are not acted on
+    static constexpr uint32_t SETTLE_FRAMES = 8;
+    // Growing is done in small steps, shrinking as far as needed at once
+    static constexpr float MAX_INCREASE = 0.05f;
+    // Scales are rounded to multiples of this
+    static constexpr float SCALE_GRANULARITY = 1.0f / 64.0f;
+
+    // Disabled, always renders at the full extent
+    DynamicResolution();
+    explicit DynamicResolution(const Settings &settings);
+
+    bool isEnabled() const
+    {
+        return settings_.frameBudgetMs > 0.0;
+    }
+
+    const Settings &getSettings() const
+    {
+        return settings_;
+    }
+
+    float getScale() const
+    {
+        return scale_;
+    }
+
+    double getSmoothedFrameMs() const
+    {
+        return smoothedMs_;
+    }
+
+    // Number of times the scale has changed, to check the hysteresis
+    uint64_t getChangeCount() const
+    {
+        return changeCount_;
+    }
+
+    float update(double gpuFrameMs);
+    VkExtent2D scaleExtent(VkExtent2D extent) const;
+
+  private:
+    Settings settings_;
+    float scale_;
+    double smoothedMs_ = 0.0;
+    bool hasSample_ = false;
+    uint32_t settleFrames_ = 0;
+    uint64_t changeCount_ = 0;
+};
+
+#endif /* SRC_COMMON_INCLUDE_DYNAMIC_RESOLUTION */
@@ -0,0 +1,128 @@
+#ifndef SRC_COMMON_INCLUDE_FRAME_CAPTURE
+#define SRC_COMMON_INCLUDE_FRAME_CAPTURE
+
+#include "buffer.hpp"
+#include "device.hpp"
+
+// std
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class CaptureFormat
+{
+    Png,
+    Raw
+};
+
+// Copies rendered images into host-visible readback buffers and writes them to disk on a worker thread.
+// A ring of readback buffers holds the captures the GPU has not finished yet. A frame that finds all of
+// them in use is skipped instead of waited for, so capturing never stalls the render loop.
+class FrameCapture
+{
+  public:
+    static constexpr uint32_t DEFAULT_READBACK_SLOTS = 4;
+    // Captures read back but not written yet, further ones are dropped rather than piling up in memory
+    static constexpr size_t MAX_QUEUED_WRITES = 8;
+
+    struct Settings
+    {
+        std::string directory = "captures";
+        CaptureFormat format = CaptureFormat::Png;
+        // Every interval-th frame from firstFrame to lastFrame is captured, 0 disables capturing
+        uint64_t interval = 0;
+        uint64_t firstFrame = 0;
+        uint64_t lastFrame = UINT64_MAX;
+        // Frames of latency the readback ring covers
+        uint32_t readbackSlots = DEFAULT_READBACK_SLOTS;
+    };
+
+    struct Stats
+    {
+        uint64_t recorded = 0;
+        uint64_t written = 0;
+        // Skipped because all readback buffers were in use or too many writes were queued
+        uint64_t dropped = 0;
+        uint64_t failed = 0;
+    };
+
+    FrameCapture(Device &device, const Settings &settings);
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture &) = delete;
+    FrameCapture &operator=(const FrameCapture &) = delete;
+
+    static bool isFormatSupported(VkFormat format);
+
+    bool isEnabled() const
+    {
+        return settings_.interval > 0;
+    }
+
+    const Settings &getSettings() const
+    {
+        return settings_;
+    }
+
+    bool isCaptured(uint64_t frameNumber) const
+    {
+        return isEnabled() && frameNumber >= settings_.firstFrame && frameNumber <= settings_.lastFrame &&
+               (frameNumber - settings_.firstFrame) % settings_.interval == 0;
+    }
+
+    void record(VkCommandBuffer commandBuffer,
+                VkImage image,
+                VkImageLayout layout,
+                VkFormat format,
+                VkExtent2D extent,
+                uint64_t frameNumber);
+    void collect();
+    void finish();
+    Stats getStats() const;
+
+  private:
+    struct Readback
+    {
+        std::unique_ptr<Buffer> buffer;
+        // Frame timeline value of the frame that copies into the buffer, 0 while it is free
+        uint64_t timelineValue = 0;
+        uint64_t frameNumber = 0;
+        VkExtent2D extent{};
+        VkFormat format = VK_FORMAT_UNDEFINED;
+    };
+
+    struct Write
+    {
+        uint64_t frameNumber;
+        VkExtent2D extent;
+        VkFormat format;
+        std::vector<uint8_t> pixels;
+    };
+
+    void enqueue(Readback &readback);
+    void writeLoop();
+    bool writeImage(Write &write) const;
+
+    Device &device_;
+    Settings settings_;
+    VkMemoryPropertyFlags readbackMemory_ = 0;
+    std::vector<Readback> readbacks_;
+
+    // Shared with the writer thread
+    mutable std::mutex mutex_;
+    std::condition_variable writeQueued_;
+    std::condition_variable writesDone_;
+    std::deque<Write> writes_;
+    bool writing_ = false;
+    bool stopping_ = false;
+    Stats stats_{};
+
+    std::thread writer_;
+};
+
+#endif /* SRC_COMMON_INCLUDE_FRAME_CAPTURE */
@@ -2,7 +2,9 @@
 #define SRC_COMMON_INCLUDE_FRAME_INFO
 
 #include "camera.hpp"
+#include "command_recorder.hpp"
 #include "game_object.hpp"
+#include "gpu_profiler.hpp"
 
 // lib
 #include <vulkan/vulkan.h>
@@ -34,6 +36,16 @@ struct FrameInfo
     Camera &camera;
     VkDescriptorSet globalDescriptorSet;
     GameObject::Map &gameObjects;
+    GpuProfiler *profiler = nullptr;
+    // Set if the render pass is recorded in secondary command buffers on several threads
+    CommandRecorder *recorder = nullptr;
+    // Part of the target the scene is rendered into, see Renderer::getRenderExtent()
+    VkExtent2D renderExtent{};
+    // Set if the draws are recorded into the recorder's cache and replayed by later frames, which see the scene
+    // from elsewhere. Systems then draw without culling and reach per-frame data only through the global UBO.
+    bool cachedPass = false;
+    // Changes whenever the cached draws would, see CommandRecorder::replayCached()
+    uint64_t sceneVersion = 0;
 };
 
 #endif /* SRC_COMMON_INCLUDE_FRAME_INFO */
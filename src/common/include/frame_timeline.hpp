@@ -0,0 +1,66 @@
+#ifndef SRC_COMMON_INCLUDE_FRAME_TIMELINE
+#define SRC_COMMON_INCLUDE_FRAME_TIMELINE
+
+// vulkan headers
+#include <vulkan/vulkan.h>
+
+// std
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+class Device;
+
+// Counts frames on the GPU. Every frame submission signals the next value of one timeline semaphore, so
+// whether frame N has finished is a single comparison, and anything that has to outlive the frames using
+// it (staging memory, retired resources, readbacks) can be keyed on the value of the last frame that used it.
+// Devices without timeline semaphores get the same interface backed by one fence per submission.
+class FrameTimeline
+{
+  public:
+    explicit FrameTimeline(Device &device);
+    ~FrameTimeline();
+
+    FrameTimeline(const FrameTimeline &) = delete;
+    FrameTimeline &operator=(const FrameTimeline &) = delete;
+
+    // Value signaled by the most recent submission, 0 before the first one
+    uint64_t submittedValue() const
+    {
+        return submitted_;
+    }
+
+    uint64_t completedValue();
+
+    bool isComplete(uint64_t value)
+    {
+        return value <= completed_ || value <= completedValue();
+    }
+
+    void wait(uint64_t value);
+    uint64_t submit(VkQueue queue, const VkSubmitInfo &submitInfo);
+
+  private:
+    struct PendingFence
+    {
+        uint64_t value;
+        VkFence fence;
+    };
+
+    bool usesTimelineSemaphore() const
+    {
+        return semaphore_ != VK_NULL_HANDLE;
+    }
+
+    VkFence acquireFence();
+
+    Device &device_;
+    VkSemaphore semaphore_ = VK_NULL_HANDLE;
+    uint64_t submitted_ = 0;
+    uint64_t completed_ = 0;
+    // Only used without timeline semaphores, in submission order
+    std::deque<PendingFence> pendingFences_;
+    std::vector<VkFence> freeFences_;
+};
+
+#endif /* SRC_COMMON_INCLUDE_FRAME_TIMELINE */
@@ -0,0 +1,33 @@
+#ifndef SRC_COMMON_INCLUDE_FRUSTUM
+#define SRC_COMMON_INCLUDE_FRUSTUM
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <array>
+
+// The six planes bounding what a projection * view matrix maps into the clip volume. Plane normals point
+// inwards and are normalized, so dot(plane.xyz, p) + plane.w is the signed distance of p.
+struct Frustum
+{
+    enum Plane
+    {
+        PLANE_LEFT,
+        PLANE_RIGHT,
+        PLANE_BOTTOM,
+        PLANE_TOP,
+        PLANE_NEAR,
+        PLANE_FAR,
+        PLANE_COUNT
+    };
+
+    std::array<glm::vec4, PLANE_COUNT> planes{};
+
+    static Frustum fromMatrix(const glm::mat4 &projectionView);
+
+    bool intersectsSphere(const glm::vec3 &center, float radius) const;
+};
+
+#endif /* SRC_COMMON_INCLUDE_FRUSTUM */
@@ -0,0 +1,84 @@
+#ifndef SRC_COMMON_INCLUDE_FRUSTUM_CULLER
+#define SRC_COMMON_INCLUDE_FRUSTUM_CULLER
+
+#include "frustum.hpp"
+#include "worker_pool.hpp"
+
+// std
+#include <cstdint>
+#include <vector>
+
+// Tests world space bounding spheres against a Frustum. The spheres are stored as separate x, y, z and
+// radius arrays so that several of them are tested at once with SSE or AVX, whichever the compiler targets
+// (see USE_AVX in src/common/CMakeLists.txt). Large sets are split into ranges culled on several threads.
+class FrustumCuller
+{
+  public:
+    // Smaller ranges cost more to hand to a thread than to cull
+    static constexpr size_t MIN_SPHERES_PER_RANGE = 4096;
+
+    struct Stats
+    {
+        size_t tested = 0;
+        size_t visible = 0;
+    };
+
+    // Culls on up to threadCount of the workers' threads, the calling thread culls the first range
+    FrustumCuller(WorkerPool &workers, uint32_t threadCount);
+
+    FrustumCuller(const FrustumCuller &) = delete;
+    FrustumCuller &operator=(const FrustumCuller &) = delete;
+
+    // Instruction set the spheres are tested with
+    static const char *getSimdName();
+
+    uint32_t getThreadCount() const
+    {
+        return threadCount_;
+    }
+
+    size_t getSphereCount() const
+    {
+        return radius_.size();
+    }
+
+    bool isVisible(size_t index) const
+    {
+        return visible_[index] != 0;
+    }
+
+    // Of the last cull() call
+    const Stats &getStats() const
+    {
+        return stats_;
+    }
+
+    void clear();
+    void addSphere(const glm::vec3 &center, float radius);
+    void cull(const Frustum &frustum);
+
+  private:
+    struct Range
+    {
+        size_t begin;
+        size_t end;
+    };
+
+    size_t cullRange(const Range &range);
+
+    std::vector<float> centerX_;
+    std::vector<float> centerY_;
+    std::vector<float> centerZ_;
+    std::vector<float> radius_;
+    std::vector<uint8_t> visible_;
+    Frustum frustum_{};
+    Stats stats_{};
+
+    WorkerPool &workers_;
+    uint32_t threadCount_;
+    // Ranges of the current cull() call and their visible spheres, one per thread
+    std::vector<Range> ranges_;
+    std::vector<size_t> rangeVisible_;
+};
+
+#endif /* SRC_COMMON_INCLUDE_FRUSTUM_CULLER */
@@ -8,17 +8,84 @@
 #include <memory>
 #include <unordered_map>
 
-struct TransformComponent
+// The matrices are computed on first use after a change and cached, so objects that don't move cost nothing.
+// Reading them isn't thread safe while the transform is dirty.
+class TransformComponent
 {
-    glm::vec3 translation{}; // (position offset)
-    glm::vec3 scale{1.f, 1.f, 1.f};
-    glm::vec3 rotation;
+  public:
+    const glm::vec3 &getTranslation() const
+    {
+        return translation_;
+    }
+
+    void setTranslation(const glm::vec3 &translation)
+    {
+        translation_ = translation;
+        dirty_ = true;
+    }
+
+    const glm::vec3 &getScale() const
+    {
+        return scale_;
+    }
+
+    void setScale(const glm::vec3 &scale)
+    {
+        scale_ = scale;
+        dirty_ = true;
+    }
+
+    // Tait-Bryan angles, see mat4()
+    const glm::vec3 &getRotation() const
+    {
+        return rotation_;
+    }
+
+    void setRotation(const glm::vec3 &rotation)
+    {
+        rotation_ = rotation;
+        dirty_ = true;
+    }
 
     // Matrix corrsponds to Translate * Ry * Rx * Rz * Scale
     // Rotations correspond to Tait-bryan angles of Y(1), X(2), Z(3)
     // https://en.wikipedia.org/wiki/Euler_angles#Rotation_matrix
-    glm::mat4 mat4();
-    glm::mat3 normalMatrix();
+    const glm::mat4 &mat4() const
+    {
+        if (dirty_)
+        {
+            updateMatrices();
+        }
+        return matrix_;
+    }
+
+    const glm::mat3 &normalMatrix() const
+    {
+        if (dirty_)
+        {
+            updateMatrices();
+        }
+        return normalMatrix_;
+    }
+
+    // Whether the matrices are recomputed on the next read, e.g. to batch them in a TransformStore first
+    bool isDirty() const
+    {
+        return dirty_;
+    }
+
+  private:
+    friend class TransformStore;
+
+    void updateMatrices() const;
+
+    glm::vec3 translation_{}; // (position offset)
+    glm::vec3 scale_{1.f, 1.f, 1.f};
+    glm::vec3 rotation_{};
+
+    mutable glm::mat4 matrix_{1.f};
+    mutable glm::mat3 normalMatrix_{1.f};
+    mutable bool dirty_ = true;
 };
 
 struct PointLightComponent
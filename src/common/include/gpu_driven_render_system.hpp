@@ -0,0 +1,143 @@
+#ifndef SRC_COMMON_INCLUDE_GPU_DRIVEN_RENDER_SYSTEM
+#define SRC_COMMON_INCLUDE_GPU_DRIVEN_RENDER_SYSTEM
+
+#include <memory>
+#include <vector>
+
+#include <buffer.hpp>
+#include <descriptors.hpp>
+#include <device.hpp>
+#include <pipeline.hpp>
+
+#include "frame_info.hpp"
+#include "hi_z_pyramid.hpp"
+#include "renderer.hpp"
+
+// Draws every GameObject with an indexed model like SimpleRenderSystem, but leaves culling to the GPU. A
+// compute pass tests each object's bounding sphere against the view frustum and appends a draw command for
+// the visible ones, and the render pass issues one indirect count draw per model, so the CPU neither knows
+// nor waits for what is visible. Needs Device::indirectCountEnabled().
+//
+// With occlusion culling the render pass only draws the objects that were visible in the previous frame. A
+// depth pyramid is then built from their depth, every object is tested against it and those that became
+// visible are drawn on top, so an object is never missed for a frame. The second phase runs in passes after
+// the scene, see addOcclusionPasses(). Objects are told apart by their position in the scene, so adding or
+// removing objects makes the first phase guess wrong for one frame, which the second one makes up for.
+class GpuDrivenRenderSystem
+{
+  public:
+    // Must match local_size_x of gpu_cull.comp
+    static constexpr uint32_t WORKGROUP_SIZE = 64;
+
+    static bool isSupported(Device &device)
+    {
+        return device.indirectCountEnabled();
+    }
+
+    GpuDrivenRenderSystem(Device &device,
+                          const RenderTargetInfo &renderTarget,
+                          VkDescriptorSetLayout globalSetLayout,
+                          uint32_t framesInFlight,
+                          bool occlusionCulling = false);
+    ~GpuDrivenRenderSystem();
+
+    GpuDrivenRenderSystem(const GpuDrivenRenderSystem &) = delete;
+    GpuDrivenRenderSystem &operator=(const GpuDrivenRenderSystem &) = delete;
+
+    void cull(FrameInfo &frameInfo);
+    void renderGameObjects(FrameInfo &frameInfo);
+    void addOcclusionPasses(RenderGraph &graph, const Renderer::SceneResources &scene);
+
+    bool isOcclusionCullingEnabled() const
+    {
+        return hiZPyramid_ != nullptr;
+    }
+
+    // Objects drawn by either phase in the last completed frame of the current frame slot
+    uint32_t getVisibleCount() const
+    {
+        return visibleCount_;
+    }
+    uint32_t getObjectCount() const
+    {
+        return objectCount_;
+    }
+
+  private:
+    // Resources of one frame in flight, grown in powers of two when the scene outgrows them
+    struct FrameResources
+    {
+        std::unique_ptr<Buffer> objects;
+        std::unique_ptr<Buffer> groups;
+        std::unique_ptr<Buffer> commands;
+        // Host visible, so the counts of the frame can be read back once it has completed
+        std::unique_ptr<Buffer> counts;
+        VkDescriptorSet cullSet = VK_NULL_HANDLE;
+        VkDescriptorSet objectSet = VK_NULL_HANDLE;
+        // Occlusion culling only
+        std::unique_ptr<Buffer> occlusionUniforms;
+        VkDescriptorSet occlusionSet = VK_NULL_HANDLE;
+        // Groups the counts buffer holds counts for, per phase
+        uint32_t groupCount = 0;
+    };
+
+    // What cull() recorded, for the passes after the scene of the same frame
+    struct CurrentFrame
+    {
+        int frameIndex = 0;
+        VkDescriptorSet globalDescriptorSet = VK_NULL_HANDLE;
+        VkExtent2D renderExtent{};
+        glm::mat4 viewProjection{1.f};
+    };
+
+    // Draws of one model, their commands are contiguous in the commands buffer
+    struct DrawGroup
+    {
+        Model *model;
+        uint32_t firstCommand;
+        uint32_t maxDraws;
+    };
+
+    void createDescriptors(uint32_t framesInFlight);
+    void createPipelineLayouts(VkDescriptorSetLayout globalSetLayout);
+    void createPipelines(const RenderTargetInfo &renderTarget);
+    void reserve(FrameResources &frame, size_t objectCount, size_t groupCount);
+    void reserveVisibility(VkCommandBuffer commandBuffer, size_t objectCount);
+    void writeDescriptorSets(FrameResources &frame);
+    void recordDraws(VkCommandBuffer commandBuffer,
+                     VkDescriptorSet globalDescriptorSet,
+                     const FrameResources &frame,
+                     uint32_t phase,
+                     size_t begin,
+                     size_t end);
+    void cullLate(VkCommandBuffer commandBuffer, VkImageView pyramidView);
+    void drawLate(VkCommandBuffer commandBuffer);
+
+    Device &device_;
+
+    std::unique_ptr<DescriptorPool> descriptorPool_{};
+    std::unique_ptr<DescriptorSetLayout> cullSetLayout_{};
+    std::unique_ptr<DescriptorSetLayout> objectSetLayout_{};
+    std::unique_ptr<DescriptorSetLayout> occlusionSetLayout_{};
+    VkPipelineLayout cullPipelineLayout_{};
+    VkPipelineLayout drawPipelineLayout_{};
+    // The early phase's with occlusion culling
+    std::unique_ptr<ComputePipeline> cullPipeline_{};
+    std::unique_ptr<ComputePipeline> lateCullPipeline_{};
+    std::unique_ptr<Pipeline> drawPipeline_{};
+
+    // Each phase has its own commands and counts, the late phase's follow the early phase's
+    uint32_t phaseCount_ = 1;
+    std::unique_ptr<HiZPyramid> hiZPyramid_{};
+    // Per object, whether the late phase found it visible. Shared by the frames in flight, which run in order.
+    std::unique_ptr<Buffer> visibility_{};
+    CurrentFrame currentFrame_{};
+
+    std::vector<FrameResources> frames_{};
+    // Filled by cull() for the renderGameObjects() call of the same frame
+    std::vector<DrawGroup> drawGroups_{};
+    uint32_t visibleCount_ = 0;
+    uint32_t objectCount_ = 0;
+};
+
+#endif /* SRC_COMMON_INCLUDE_GPU_DRIVEN_RENDER_SYSTEM */
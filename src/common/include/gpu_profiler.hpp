@@ -0,0 +1,106 @@
+#ifndef SRC_COMMON_INCLUDE_GPU_PROFILER
+#define SRC_COMMON_INCLUDE_GPU_PROFILER
+
+#include "device.hpp"
+
+// std
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Measures GPU time of named scopes with timestamp queries. Every frame in flight has its own query pool,
+// so the results of a frame are read back without waiting when its slot comes around again.
+class GpuProfiler
+{
+  public:
+    static constexpr uint32_t MAX_SCOPES = 32;
+    static constexpr size_t HISTORY_SIZE = 240;
+    static constexpr const char *FRAME_SCOPE = "frame";
+
+    struct ScopeStats
+    {
+        std::string name;
+        size_t sampleCount = 0;
+        double lastMs = 0.0;
+        double averageMs = 0.0;
+        double p50Ms = 0.0;
+        double p95Ms = 0.0;
+        double p99Ms = 0.0;
+    };
+
+    // Writes a timestamp when created and another when destroyed. A null profiler records nothing.
+    class Scope
+    {
+      public:
+        Scope(GpuProfiler *profiler, VkCommandBuffer commandBuffer, const char *name);
+        ~Scope();
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+      private:
+        GpuProfiler *profiler_;
+        VkCommandBuffer commandBuffer_;
+        uint32_t scope_;
+    };
+
+    GpuProfiler(Device &device, uint32_t framesInFlight);
+    ~GpuProfiler();
+
+    GpuProfiler(const GpuProfiler &) = delete;
+    GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+    bool isSupported() const
+    {
+        return device_.timestampValidBits() != 0;
+    }
+
+    void beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+    void endFrame(VkCommandBuffer commandBuffer);
+
+    uint32_t beginScope(VkCommandBuffer commandBuffer, const char *name);
+    void endScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+    // Rolling statistics over the last HISTORY_SIZE frames of every scope, sorted by name
+    std::vector<ScopeStats> getStats() const;
+
+    // GPU time of the most recently read back frame, 0 before the first one
+    double getLastFrameMs() const;
+
+    // Number of frames read back so far, changes whenever getLastFrameMs() has a new value
+    uint64_t getCollectedFrames() const
+    {
+        return collectedFrames_;
+    }
+
+  private:
+    static constexpr uint32_t INVALID_SCOPE = UINT32_MAX;
+
+    struct FrameQueries
+    {
+        VkQueryPool queryPool = VK_NULL_HANDLE;
+        std::vector<std::string> scopeNames;
+        std::vector<bool> scopeEnded;
+        bool submitted = false;
+    };
+
+    struct History
+    {
+        std::vector<double> samples;
+        size_t next = 0;
+        double last = 0.0;
+    };
+
+    void collect(FrameQueries &frame);
+
+    Device &device_;
+    std::vector<FrameQueries> frames_;
+    FrameQueries *currentFrame_ = nullptr;
+    uint32_t frameScope_ = INVALID_SCOPE;
+    uint64_t timestampMask_;
+    std::map<std::string, History> history_;
+    uint64_t collectedFrames_ = 0;
+};
+
+#endif /* SRC_COMMON_INCLUDE_GPU_PROFILER */
@@ -0,0 +1,75 @@
+#ifndef SRC_COMMON_INCLUDE_HI_Z_PYRAMID
+#define SRC_COMMON_INCLUDE_HI_Z_PYRAMID
+
+#include "descriptors.hpp"
+#include "device.hpp"
+#include "pipeline.hpp"
+#include "render_graph.hpp"
+
+// std
+#include <memory>
+#include <vector>
+
+// Hierarchical depth buffer for occlusion culling. Every texel holds the farthest depth of the texels it covers
+// in the mip below, mip 0 covers the rendered part of the scene's depth at the largest power of two size that
+// fits into the scene. Sizes that don't divide evenly are reduced over every texel a texel overlaps, so the
+// pyramid never claims anything is nearer than it is.
+//
+// The image is a transient of the render graph the pyramid is built in, it is only needed within a frame. The
+// pyramid keeps the per-mip views and descriptor sets of the image it was last built into.
+class HiZPyramid
+{
+  public:
+    // Must match local_size_x and local_size_y of hi_z_build.comp
+    static constexpr uint32_t WORKGROUP_SIZE = 8;
+    static constexpr VkFormat FORMAT = VK_FORMAT_R32_SFLOAT;
+
+    HiZPyramid(Device &device, uint32_t framesInFlight);
+    ~HiZPyramid();
+
+    HiZPyramid(const HiZPyramid &) = delete;
+    HiZPyramid &operator=(const HiZPyramid &) = delete;
+
+    void resize(VkExtent2D sceneExtent);
+    void build(VkCommandBuffer commandBuffer,
+               int frameIndex,
+               VkImage pyramid,
+               VkImageView depthView,
+               VkExtent2D renderExtent);
+
+    // Of the image to create for the scene extent of the last resize()
+    RenderGraph::ImageInfo getImageInfo() const
+    {
+        return {FORMAT, extent_, mipLevels_};
+    }
+
+    uint32_t getMipLevels() const
+    {
+        return mipLevels_;
+    }
+
+  private:
+    void createPipeline();
+    void createViews(VkImage pyramid);
+    void destroyViews();
+
+    Device &device_;
+    uint32_t framesInFlight_;
+
+    std::unique_ptr<DescriptorSetLayout> setLayout_{};
+    std::unique_ptr<DescriptorPool> descriptorPool_{};
+    VkPipelineLayout pipelineLayout_{};
+    std::unique_ptr<ComputePipeline> pipeline_{};
+
+    VkExtent2D extent_{};
+    uint32_t mipLevels_ = 0;
+    // Image the views below were created for, owned by the render graph
+    VkImage image_ = VK_NULL_HANDLE;
+    std::vector<VkImageView> mipViews_{};
+    // Reduce the depth image into mip 0, one per frame in flight as the depth image differs between frames
+    std::vector<VkDescriptorSet> depthSets_{};
+    // Reduce mip i - 1 into mip i, the first one is unused
+    std::vector<VkDescriptorSet> mipSets_{};
+};
+
+#endif /* SRC_COMMON_INCLUDE_HI_Z_PYRAMID */
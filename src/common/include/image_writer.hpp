@@ -0,0 +1,20 @@
+#ifndef SRC_COMMON_INCLUDE_IMAGE_WRITER
+#define SRC_COMMON_INCLUDE_IMAGE_WRITER
+
+// std
+#include <cstdint>
+#include <string>
+
+// Writers for tightly packed 8-bit RGBA pixels, top row first. They return false if the file could not be
+// written, so callers on worker threads can report failures without exceptions.
+namespace image_writer
+{
+// PNG with stored (uncompressed) deflate blocks. Files are as large as the raw pixels, but any decoder reads
+// them and writing costs little more than a copy.
+bool writePng(const std::string &path, uint32_t width, uint32_t height, const uint8_t *rgba);
+
+// The pixels as they are, the size has to be known to read them
+bool writeRaw(const std::string &path, uint32_t width, uint32_t height, const uint8_t *rgba);
+} // namespace image_writer
+
+#endif /* SRC_COMMON_INCLUDE_IMAGE_WRITER */
@@ -0,0 +1,96 @@
+#ifndef SRC_COMMON_INCLUDE_MEMORY_ALLOCATOR
+#define SRC_COMMON_INCLUDE_MEMORY_ALLOCATOR
+
+#include "device.hpp"
+
+// std
+#include <cstdint>
+#include <map>
+#include <vector>
+
+class Buffer;
+
+// Sub-allocates device-local buffer memory out of large VkDeviceMemory blocks instead of giving every
+// buffer its own vkAllocateMemory. Every live allocation remembers the Buffer owning it so that the
+// Defragmenter can move it and patch the owner afterwards.
+class MemoryAllocator
+{
+  public:
+    static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+
+    struct Allocation
+    {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        uint32_t block = 0;
+    };
+
+    struct BlockInfo
+    {
+        uint32_t index = 0;
+        VkDeviceSize size = 0;
+        VkDeviceSize usedBytes = 0;
+        VkDeviceSize largestFreeRange = 0;
+        uint32_t allocationCount = 0;
+        bool evacuating = false;
+    };
+
+    struct Metrics
+    {
+        uint32_t blockCount = 0;
+        uint32_t allocationCount = 0;
+        uint32_t freeRangeCount = 0;
+        VkDeviceSize totalBytes = 0;
+        VkDeviceSize usedBytes = 0;
+        VkDeviceSize largestFreeRange = 0;
+
+        // 0 when all free memory is one contiguous range, approaching 1 as it splinters
+        float fragmentation() const;
+        // Fraction of the reserved memory that holds live allocations
+        float utilization() const;
+    };
+
+    MemoryAllocator(Device &device, VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE);
+    ~MemoryAllocator();
+
+    MemoryAllocator(const MemoryAllocator &) = delete;
+    MemoryAllocator &operator=(const MemoryAllocator &) = delete;
+
+    Allocation allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties, Buffer *owner);
+    void free(const Allocation &allocation);
+
+    void setOwner(const Allocation &allocation, Buffer *owner);
+    Buffer *getOwner(const Allocation &allocation) const;
+
+    // Blocks marked as evacuating receive no new allocations, so the defragmenter can empty them
+    void setEvacuating(uint32_t block, bool evacuating);
+    std::vector<BlockInfo> getBlockInfos() const;
+    std::vector<std::pair<Allocation, Buffer *>> getAllocations(uint32_t block) const;
+
+    Metrics getMetrics() const;
+
+  private:
+    struct Block
+    {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        uint32_t memoryTypeIndex = 0;
+        VkDeviceSize usedBytes = 0;
+        bool evacuating = false;
+        // offset -> size of every free range, kept coalesced
+        std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+        // offset -> (size, owner) of every live allocation
+        std::map<VkDeviceSize, std::pair<VkDeviceSize, Buffer *>> allocations;
+    };
+
+    bool tryAllocateFromBlock(uint32_t index, const VkMemoryRequirements &requirements, Allocation &allocation);
+    uint32_t createBlock(VkDeviceSize size, uint32_t memoryTypeIndex);
+    void destroyBlock(uint32_t index);
+
+    Device &device_;
+    VkDeviceSize blockSize_;
+    std::vector<Block> blocks_;
+};
+
+#endif /* SRC_COMMON_INCLUDE_MEMORY_ALLOCATOR */
@@ -46,11 +46,28 @@ class Model
     static std::unique_ptr<Model> createModelFromFile(Device &device, const std::string &filepath);
 
     void bind(VkCommandBuffer commandBuffer);
-    void draw(VkCommandBuffer commandBuffer);
+    void draw(VkCommandBuffer commandBuffer, uint32_t instanceCount = 1, uint32_t firstInstance = 0);
+
+    // Sphere in model space enclosing all vertices, center in xyz and radius in w
+    const glm::vec4 &getBoundingSphere() const
+    {
+        return boundingSphere_;
+    }
+
+    bool hasIndexBuffer() const
+    {
+        return hasIndexBuffer_;
+    }
+
+    uint32_t getIndexCount() const
+    {
+        return indexCount_;
+    }
 
   private:
     void createVertexBuffers(const std::vector<Vertex> &vertices);
     void createIndexBuffers(const std::vector<uint32_t> &indices);
+    void computeBoundingSphere(const std::vector<Vertex> &vertices);
 
     Device &device_;
     std::unique_ptr<Buffer> vertexBuffer_;
@@ -59,6 +76,8 @@ class Model
     bool hasIndexBuffer_ = false;
     std::unique_ptr<Buffer> indexBuffer_;
     uint32_t indexCount_;
+
+    glm::vec4 boundingSphere_{};
 };
 
 #endif /* SRC_COMMON_INCLUDE_MODEL */
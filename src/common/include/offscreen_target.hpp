@@ -0,0 +1,119 @@
+#ifndef SRC_COMMON_INCLUDE_OFFSCREEN_TARGET
+#define SRC_COMMON_INCLUDE_OFFSCREEN_TARGET
+
+#include "device.hpp"
+#include "render_target.hpp"
+
+// std lib headers
+#include <vector>
+
+// Renders into a ring of color + depth images owned by the application instead of a swap chain, so
+// frames can be produced without a window or display. Finished color images are left in
+// VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL to be copied out. The Renderer also uses one as the lower resolution
+// scene target that is blitted into the presented image.
+class OffscreenTarget : public RenderTarget
+{
+  public:
+    // An imageCount of 0 uses one image more than there are frames in flight, a colorFormat of
+    // VK_FORMAT_UNDEFINED picks an 8 bit sRGB format. readableDepth keeps the depth after the render pass and
+    // lets shaders sample it, otherwise it is a transient attachment.
+    OffscreenTarget(Device &device,
+                    VkExtent2D extent,
+                    uint32_t framesInFlight,
+                    uint32_t imageCount = 0,
+                    VkFormat colorFormat = VK_FORMAT_UNDEFINED,
+                    bool readableDepth = false);
+    ~OffscreenTarget() override;
+
+    OffscreenTarget(const OffscreenTarget &) = delete;
+    OffscreenTarget &operator=(const OffscreenTarget &) = delete;
+
+    VkRenderPass getRenderPass() override
+    {
+        return renderPass_;
+    }
+
+    VkFramebuffer getFrameBuffer(int index) override
+    {
+        return framebuffers_[index];
+    }
+
+    VkExtent2D getExtent() override
+    {
+        return extent_;
+    }
+
+    size_t imageCount() override
+    {
+        return colorAttachments_.size();
+    }
+
+    VkImage getColorImage(int index)
+    {
+        return colorAttachments_[index].image;
+    }
+
+    VkFormat getColorFormat() const override
+    {
+        return colorFormat_;
+    }
+
+    VkFormat getDepthFormat() const override
+    {
+        return depthFormat_;
+    }
+
+    RenderTargetAttachments getAttachments(int index) override
+    {
+        return {colorAttachments_[index].image,
+                colorAttachments_[index].view,
+                depthAttachments_[index].image,
+                depthAttachments_[index].view};
+    }
+
+    VkImageLayout getFinalColorLayout() const override
+    {
+        return VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    }
+
+    VkResult acquireNextImage(uint32_t *imageIndex) override;
+    VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex) override;
+
+  private:
+    struct Attachment
+    {
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+    };
+
+    void createRenderPass();
+    void createAttachments(uint32_t imageCount);
+    void createFramebuffers();
+
+    Attachment createAttachment(VkFormat format,
+                                VkImageUsageFlags usage,
+                                VkImageAspectFlags aspect,
+                                VkMemoryPropertyFlags properties,
+                                VkMemoryPropertyFlags fallbackProperties);
+    void destroyAttachment(Attachment &attachment);
+
+    Device &device_;
+    VkExtent2D extent_;
+    VkFormat colorFormat_;
+    VkFormat depthFormat_;
+    bool readableDepth_;
+
+    VkRenderPass renderPass_ = VK_NULL_HANDLE;
+    std::vector<Attachment> colorAttachments_;
+    std::vector<Attachment> depthAttachments_;
+    std::vector<VkFramebuffer> framebuffers_;
+
+    // Frame timeline values of the last frame submitted from each frame slot and to each image
+    std::vector<uint64_t> frameValues_;
+    std::vector<uint64_t> imageValues_;
+    size_t currentFrame_ = 0;
+    uint32_t nextImage_ = 0;
+};
+
+#endif /* SRC_COMMON_INCLUDE_OFFSCREEN_TARGET */
@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "device.hpp"
+#include "render_target.hpp"
 
 struct PipelineConfigInfo
 {
@@ -24,13 +25,15 @@ struct PipelineConfigInfo
     std::vector<VkDynamicState> dynamicStateEnables{};
     VkPipelineDynamicStateCreateInfo dynamicStateInfo{};
     VkPipelineLayout pipelineLayout = nullptr;
-    VkRenderPass renderPass = nullptr;
+    // Render pass, or only the attachment formats when the target uses dynamic rendering
+    RenderTargetInfo renderTarget{};
     uint32_t subpass = 0;
 };
 
 class Pipeline
 {
   public:
+    // An empty fragFilepath creates a pipeline without a fragment shader
     Pipeline(Device &device,
              const std::string &vertFilepath,
              const std::string &fragFilepath,
@@ -59,4 +62,22 @@ class Pipeline
     VkShaderModule fragmentShaderModule_{};
 };
 
+// Pipeline of a single compute shader, dispatched outside of render passes
+class ComputePipeline
+{
+  public:
+    ComputePipeline(Device &device, const std::string &compFilepath, VkPipelineLayout pipelineLayout);
+    ~ComputePipeline();
+
+    ComputePipeline(const ComputePipeline &) = delete;
+    ComputePipeline &operator=(const ComputePipeline &) = delete;
+
+    void bind(VkCommandBuffer commandBuffer);
+
+  private:
+    Device &device_;
+    VkPipeline computePipeline_{};
+    VkShaderModule computeShaderModule_{};
+};
+
 #endif /* SRC_COMMON_INCLUDE_PIPELINE */
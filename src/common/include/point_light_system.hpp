@@ -7,6 +7,7 @@
 #include "frame_info.hpp"
 #include "game_object.hpp"
 #include "pipeline.hpp"
+#include "render_queue.hpp"
 
 // std
 #include <memory>
@@ -16,18 +17,18 @@
 class PointLightSystem
 {
   public:
-    PointLightSystem(Device &device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
+    PointLightSystem(Device &device, const RenderTargetInfo &renderTarget, VkDescriptorSetLayout globalSetLayout);
     ~PointLightSystem();
 
     PointLightSystem(const PointLightSystem &) = delete;
     PointLightSystem &operator=(const PointLightSystem &) = delete;
 
     void update(FrameInfo &frameInfo, GlobalUbo &ubo);
-    void render(FrameInfo &frameInfo);
+    void submit(FrameInfo &frameInfo, RenderQueue &renderQueue);
 
   private:
     void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
-    void createPipeline(VkRenderPass renderPass);
+    void createPipeline(const RenderTargetInfo &renderTarget);
 
     Device &device_;
     std::unique_ptr<Pipeline> pipeline_;
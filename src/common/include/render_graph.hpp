@@ -0,0 +1,231 @@
+#ifndef SRC_COMMON_INCLUDE_RENDER_GRAPH
+#define SRC_COMMON_INCLUDE_RENDER_GRAPH
+
+#include "device.hpp"
+#include "gpu_profiler.hpp"
+
+// std
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// How a pass uses an image, which determines the layout, stages and accesses the graph synchronizes
+enum class ImageUsage
+{
+    ColorAttachment,
+    DepthAttachment,
+    // Depth tested, but not written
+    DepthReadOnly,
+    Sampled,
+    StorageRead,
+    StorageWrite,
+    TransferSrc,
+    TransferDst
+};
+
+// Layout of an image and the stages and accesses that last used it, or that have to wait for it
+struct ImageState
+{
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags stages = 0;
+    VkAccessFlags access = 0;
+};
+
+// Describes a frame as passes that declare the images they read and write. compile() drops passes nothing
+// depends on, works out the layout transitions and barriers between the remaining ones, creates the
+// transient images and lets those whose lifetimes don't overlap share memory. execute() then records the
+// passes with their barriers, beginning and ending rendering around graphics passes. Imported images are
+// owned by someone else and may change every frame, see setImportedImage().
+//
+// A compiled graph is not changed anymore, a different frame is described by a new graph. Its transient
+// images and render passes are destroyed with it, which the owner must only do once no submitted frame
+// uses them anymore.
+class RenderGraph
+{
+  public:
+    using ResourceId = uint32_t;
+    using Execute = std::function<void(VkCommandBuffer commandBuffer)>;
+
+    enum class PassType
+    {
+        Graphics,
+        Compute,
+        Transfer
+    };
+
+    struct ImageInfo
+    {
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkExtent2D extent{};
+        uint32_t mipLevels = 1;
+    };
+
+    struct Stats
+    {
+        uint32_t passes = 0;
+        uint32_t culledPasses = 0;
+        uint32_t imageBarriers = 0;
+        uint32_t transientImages = 0;
+        uint32_t memorySlots = 0;
+        // Memory the transient images would take without aliasing, and what they take with it
+        VkDeviceSize transientBytes = 0;
+        VkDeviceSize allocatedBytes = 0;
+    };
+
+    // Declares the images one pass uses, each image at most once per pass
+    class PassBuilder
+    {
+      public:
+        PassBuilder &writeColor(ResourceId image, VkAttachmentLoadOp loadOp, VkClearColorValue clear = {});
+        PassBuilder &writeDepth(ResourceId image, VkAttachmentLoadOp loadOp, VkClearDepthStencilValue clear = {1.f, 0});
+        PassBuilder &readDepth(ResourceId image);
+        PassBuilder &sample(ResourceId image);
+        PassBuilder &readStorage(ResourceId image);
+        // DONT_CARE if the pass writes every texel, so it doesn't depend on the previous contents
+        PassBuilder &writeStorage(ResourceId image, VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_LOAD);
+        PassBuilder &copyFrom(ResourceId image);
+        PassBuilder &copyTo(ResourceId image);
+        // Keeps the pass even if nothing the graph knows about depends on it, e.g. when it writes buffers
+        PassBuilder &sideEffect();
+
+      private:
+        friend class RenderGraph;
+
+        PassBuilder(RenderGraph &graph, uint32_t pass) : graph_{graph}, pass_{pass}
+        {
+        }
+
+        PassBuilder &use(ResourceId image, ImageUsage usage, VkAttachmentLoadOp loadOp, VkClearValue clear);
+
+        RenderGraph &graph_;
+        uint32_t pass_;
+    };
+
+    explicit RenderGraph(Device &device);
+    ~RenderGraph();
+
+    RenderGraph(const RenderGraph &) = delete;
+    RenderGraph &operator=(const RenderGraph &) = delete;
+
+    ResourceId createImage(const std::string &name, const ImageInfo &info);
+    ResourceId importImage(const std::string &name,
+                           const ImageInfo &info,
+                           const ImageState &initialState,
+                           const ImageState &finalState);
+    void setImportedImage(ResourceId image, VkImage handle, VkImageView view);
+    void addPass(const std::string &name,
+                 PassType type,
+                 const std::function<void(PassBuilder &)> &setup,
+                 Execute execute);
+    void markOutput(ResourceId image);
+
+    void compile();
+    void execute(VkCommandBuffer commandBuffer, GpuProfiler *profiler = nullptr);
+    std::string dump() const;
+
+    bool isCompiled() const
+    {
+        return compiled_;
+    }
+
+    const Stats &getStats() const
+    {
+        return stats_;
+    }
+
+    VkImage getImage(ResourceId image) const
+    {
+        return resources_[image].image;
+    }
+
+    VkImageView getImageView(ResourceId image) const
+    {
+        return resources_[image].view;
+    }
+
+  private:
+    struct Use
+    {
+        ResourceId image;
+        ImageUsage usage;
+        VkAttachmentLoadOp loadOp;
+        VkClearValue clear;
+        // Whether the attachment's contents are kept for a later use
+        VkAttachmentStoreOp storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    };
+
+    struct Barrier
+    {
+        ResourceId image;
+        ImageState before;
+        ImageState after;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        PassType type;
+        Execute execute;
+        std::vector<Use> uses;
+        bool sideEffect = false;
+        bool culled = false;
+        std::vector<Barrier> barriers;
+        VkExtent2D extent{};
+        // Only without dynamic rendering, one framebuffer per combination of attachment views
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        std::map<std::vector<VkImageView>, VkFramebuffer> framebuffers;
+    };
+
+    struct Resource
+    {
+        std::string name;
+        ImageInfo info;
+        VkImageAspectFlags aspect = 0;
+        bool imported = false;
+        bool output = false;
+        // Used by a pass that was not culled
+        bool used = false;
+        ImageState initialState{};
+        ImageState finalState{};
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        // Transient images only
+        VkImageUsageFlags usage = 0;
+        VkMemoryRequirements memoryRequirements{};
+        int slot = -1;
+        uint32_t firstPass = 0;
+        uint32_t lastPass = 0;
+    };
+
+    // Memory shared by transient images whose lifetimes don't overlap
+    struct MemorySlot
+    {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        uint32_t memoryTypeBits = ~0u;
+        std::vector<ResourceId> images;
+    };
+
+    void cullPasses();
+    void computeLifetimes();
+    void createTransientImage(Resource &resource);
+    void createTransientImages();
+    void computeBarriers();
+    void createRenderPasses();
+    void recordBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier> &barriers) const;
+    void beginRendering(VkCommandBuffer commandBuffer, Pass &pass);
+    void endRendering(VkCommandBuffer commandBuffer, const Pass &pass);
+
+    Device &device_;
+    std::vector<Resource> resources_;
+    std::vector<Pass> passes_;
+    std::vector<MemorySlot> slots_;
+    // Into the final states of the imported images
+    std::vector<Barrier> finalBarriers_;
+    bool compiled_ = false;
+    Stats stats_{};
+};
+
+#endif /* SRC_COMMON_INCLUDE_RENDER_GRAPH */
@@ -0,0 +1,132 @@
+#ifndef SRC_COMMON_INCLUDE_RENDER_QUEUE
+#define SRC_COMMON_INCLUDE_RENDER_QUEUE
+
+#include "frame_info.hpp"
+#include "model.hpp"
+#include "pipeline.hpp"
+
+// std
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Part of the frame a packet is drawn in, earlier phases are drawn first
+enum class RenderPhase : uint8_t
+{
+    // Depth-only draws that let the opaque draws shade each pixel once
+    DepthPrepass,
+    Opaque,
+    Transparent
+};
+
+// Everything needed to record one draw
+struct DrawPacket
+{
+    // The minimum every device supports
+    static constexpr uint32_t MAX_PUSH_CONSTANT_SIZE = 128;
+
+    RenderPhase phase = RenderPhase::Opaque;
+    // Distance from the camera, depth prepass and opaque packets are drawn front to back and transparent ones
+    // back to front
+    float depth = 0.f;
+
+    Pipeline *pipeline = nullptr;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    // Bound to set 0
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    // Optional, bound to set 1, e.g. per-object data the draw indexes with firstInstance
+    VkDescriptorSet objectDescriptorSet = VK_NULL_HANDLE;
+
+    // Null for draws without vertex input, which draw vertexCount vertices
+    Model *model = nullptr;
+    uint32_t vertexCount = 0;
+    // Optional per-instance vertex buffer
+    VkBuffer instanceBuffer = VK_NULL_HANDLE;
+    uint32_t instanceBinding = 1;
+    uint32_t instanceCount = 1;
+    uint32_t firstInstance = 0;
+
+    VkShaderStageFlags pushConstantStages = 0;
+    uint32_t pushConstantSize = 0;
+    std::array<uint8_t, MAX_PUSH_CONSTANT_SIZE> pushConstants{};
+
+    template <typename T>
+    void setPushConstants(VkShaderStageFlags stages, const T &data)
+    {
+        static_assert(sizeof(T) <= MAX_PUSH_CONSTANT_SIZE, "Push constants too large for a draw packet");
+        pushConstantStages = stages;
+        pushConstantSize = sizeof(T);
+        std::memcpy(pushConstants.data(), &data, sizeof(T));
+    }
+};
+
+// Collects the draws of a frame from the render systems, radix sorts them by a 64-bit key of phase,
+// pipeline, material (descriptor set), model and depth, and records them in that order. A state tracker
+// skips the pipeline, descriptor set and vertex buffer binds the previous draw already made.
+class RenderQueue
+{
+  public:
+    struct BindCounts
+    {
+        size_t pipelines = 0;
+        size_t descriptorSets = 0;
+        size_t vertexBuffers = 0;
+    };
+
+    struct Stats
+    {
+        size_t packets = 0;
+        // What binding all of each packet's state would have taken
+        BindCounts requested{};
+        BindCounts issued{};
+    };
+
+    RenderQueue() = default;
+
+    RenderQueue(const RenderQueue &) = delete;
+    RenderQueue &operator=(const RenderQueue &) = delete;
+
+    size_t size() const
+    {
+        return packets_.size();
+    }
+
+    // Of the last execute() call
+    const Stats &getStats() const
+    {
+        return stats_;
+    }
+
+    void clear();
+    void submit(const DrawPacket &packet);
+    void execute(FrameInfo &frameInfo);
+
+  private:
+    struct SortEntry
+    {
+        uint64_t key;
+        uint32_t packet;
+    };
+
+    uint64_t sortKey(const DrawPacket &packet);
+    void sort();
+    void recordRange(VkCommandBuffer commandBuffer, size_t begin, size_t end);
+
+    std::vector<DrawPacket> packets_;
+    std::vector<SortEntry> entries_;
+    std::vector<SortEntry> scratch_;
+
+    // Small ids of the state the keys are built from, kept across frames so keys stay stable
+    std::unordered_map<uint64_t, uint32_t> pipelineIds_;
+    std::unordered_map<uint64_t, uint32_t> materialIds_;
+    std::unordered_map<uint64_t, uint32_t> modelIds_;
+
+    // Ranges may be recorded concurrently
+    std::mutex statsMutex_;
+    Stats stats_{};
+};
+
+#endif /* SRC_COMMON_INCLUDE_RENDER_QUEUE */
@@ -0,0 +1,82 @@
+#ifndef SRC_COMMON_INCLUDE_RENDER_TARGET
+#define SRC_COMMON_INCLUDE_RENDER_TARGET
+
+// vulkan headers
+#include <vulkan/vulkan.h>
+
+// std lib headers
+#include <cstddef>
+#include <cstdint>
+
+// What a pipeline has to know about the attachments it renders into. Without a render pass (dynamic
+// rendering) the pipeline is created for the attachment formats instead.
+struct RenderTargetInfo
+{
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+};
+
+// The images behind one framebuffer, rendered into directly when dynamic rendering is used
+struct RenderTargetAttachments
+{
+    VkImage colorImage = VK_NULL_HANDLE;
+    VkImageView colorView = VK_NULL_HANDLE;
+    VkImage depthImage = VK_NULL_HANDLE;
+    VkImageView depthView = VK_NULL_HANDLE;
+};
+
+// What the Renderer draws into: a render pass with one framebuffer per image, and a way to get the next
+// image and hand the recorded frame back. Implemented by the SwapChain and by OffscreenTarget. When the
+// device supports dynamic rendering the targets create neither render pass nor framebuffers, and
+// getRenderPass() returns VK_NULL_HANDLE.
+class RenderTarget
+{
+  public:
+    // Frames in flight are chosen at runtime, these bound and default the choice
+    static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+    static constexpr uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+
+    explicit RenderTarget(uint32_t framesInFlight) : framesInFlight_{framesInFlight}
+    {
+    }
+    virtual ~RenderTarget() = default;
+
+    // Number of frames the CPU may record ahead of the GPU, each with its own sync objects
+    uint32_t framesInFlight() const
+    {
+        return framesInFlight_;
+    }
+
+    virtual VkRenderPass getRenderPass() = 0;
+    virtual VkFramebuffer getFrameBuffer(int index) = 0;
+    virtual VkExtent2D getExtent() = 0;
+    virtual size_t imageCount() = 0;
+    virtual VkFormat getColorFormat() const = 0;
+    virtual VkFormat getDepthFormat() const = 0;
+    // Attachments of the framebuffer getFrameBuffer(index) would return
+    virtual RenderTargetAttachments getAttachments(int index) = 0;
+    // Layout the color image has to be in once the frame has been rendered
+    virtual VkImageLayout getFinalColorLayout() const = 0;
+
+    RenderTargetInfo getInfo()
+    {
+        return {getRenderPass(), getColorFormat(), getDepthFormat()};
+    }
+
+    float extentAspectRatio()
+    {
+        const VkExtent2D extent = getExtent();
+        return static_cast<float>(extent.width) / static_cast<float>(extent.height);
+    }
+
+    // Waits for the frame slot to become free and picks the image to render into
+    virtual VkResult acquireNextImage(uint32_t *imageIndex) = 0;
+    // Submits the frame's command buffer and hands the image on, e.g. to the presentation engine
+    virtual VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex) = 0;
+
+  protected:
+    uint32_t framesInFlight_;
+};
+
+#endif /* SRC_COMMON_INCLUDE_RENDER_TARGET */
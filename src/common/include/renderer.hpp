@@ -2,27 +2,94 @@
 #define SRC_COMMON_INCLUDE_RENDERER
 
 #include <cassert>
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <vector>
 
+#include "command_recorder.hpp"
 #include "device.hpp"
+#include "dynamic_resolution.hpp"
+#include "frame_capture.hpp"
+#include "gpu_profiler.hpp"
+#include "offscreen_target.hpp"
+#include "render_graph.hpp"
 #include "swap_chain.hpp"
 #include "window.hpp"
 
 class Renderer
 {
   public:
-    Renderer(Window &window, Device &device);
+    // Images of the scene that passes added through setPostScenePasses() can use
+    struct SceneResources
+    {
+        RenderGraph::ResourceId color;
+        RenderGraph::ResourceId depth;
+        // Of the images, the current frame only renders into the getRenderExtent() part of them
+        VkExtent2D extent;
+    };
+    using PostScenePasses = std::function<void(RenderGraph &graph, const SceneResources &scene)>;
+
+    // A burst of resize events only recreates the swap chain once the size has been stable for
+    // RESIZE_DEBOUNCE, or RESIZE_MAX_DELAY after the first event at the latest
+    static constexpr std::chrono::milliseconds RESIZE_DEBOUNCE{50};
+    static constexpr std::chrono::milliseconds RESIZE_MAX_DELAY{250};
+
+    // readableDepth keeps the scene's depth for passes added through setPostScenePasses(), without it the depth
+    // is a transient attachment that may never be backed by memory
+    Renderer(Window &window,
+             Device &device,
+             const PresentPolicy &presentPolicy = PresentPolicy{},
+             uint32_t framesInFlight = RenderTarget::DEFAULT_FRAMES_IN_FLIGHT,
+             bool readableDepth = false);
+    // Headless renderer drawing into offscreen images instead of a window
+    Renderer(Device &device,
+             VkExtent2D extent,
+             uint32_t framesInFlight = RenderTarget::DEFAULT_FRAMES_IN_FLIGHT,
+             bool readableDepth = false);
     Renderer(const Renderer &) = delete;
     Renderer &operator=(const Renderer &) = delete;
 
-    VkRenderPass getSwapChainRenderPass() const
+    // What pipelines drawing between beginSwapChainRenderPass and endSwapChainRenderPass are created for
+    RenderTargetInfo getRenderTargetInfo() const
     {
-        return swapChain_->getRenderPass();
+        return drawTarget().getInfo();
     }
 
     float getAspectRatio() const
     {
-        return swapChain_->extentAspectRatio();
+        return renderTarget_->extentAspectRatio();
+    }
+
+    RenderTarget &getRenderTarget() const
+    {
+        return *renderTarget_;
+    }
+
+    GpuProfiler &getProfiler() const
+    {
+        return *profiler_;
+    }
+
+    bool isHeadless() const
+    {
+        return window_ == nullptr;
+    }
+
+    // Nothing is rendered while the window has no area, beginFrame() returns nullptr then
+    bool isMinimized() const
+    {
+        if (isHeadless())
+        {
+            return false;
+        }
+        const auto extent = window_->getExtent();
+        return extent.width == 0 || extent.height == 0;
+    }
+
+    bool isDepthReadable() const
+    {
+        return readableDepth_;
     }
 
     bool isFrameInProgress() const
@@ -42,6 +109,81 @@ class Renderer
         return currentFrameIndex_;
     }
 
+    // Per-frame resources (uniform buffers, descriptor sets, ...) have to be created this many times
+    uint32_t getFramesInFlight() const
+    {
+        return framesInFlight_;
+    }
+
+    // Number of frames submitted so far, which is also the number of the frame in progress
+    uint64_t getFrameNumber() const
+    {
+        return frameNumber_;
+    }
+
+    // Recreates the swap chain with the new policy, so it must not be called while a frame is in progress
+    void setPresentPolicy(const PresentPolicy &presentPolicy);
+
+    const PresentPolicy &getPresentPolicy() const
+    {
+        return presentPolicy_;
+    }
+
+    PresentStats getPresentStats() const
+    {
+        return swapChain_ != nullptr ? swapChain_->getPresentStats() : PresentStats{};
+    }
+
+    // Renders the scene into an internal target whose resolution follows the measured GPU frame time, and
+    // blits it into the target's image at the end of the pass. Disabled settings render at full size again.
+    void setDynamicResolution(const DynamicResolution::Settings &settings);
+
+    const DynamicResolution &getDynamicResolution() const
+    {
+        return dynamicResolution_;
+    }
+
+    // Extent the current frame's scene is rendered at
+    VkExtent2D getRenderExtent() const
+    {
+        return renderExtent_;
+    }
+
+    // Reads back the presented (or offscreen) images of the frames the settings select and writes them to
+    // disk on a worker thread. Captures still in flight are finished first.
+    void setFrameCapture(const FrameCapture::Settings &settings);
+
+    // Null while capturing is disabled
+    FrameCapture *getFrameCapture() const
+    {
+        return frameCapture_.get();
+    }
+
+    // With more than one thread, the pass between beginSwapChainRenderPass and endSwapChainRenderPass only
+    // contains secondary command buffers, which are recorded through getCommandRecorder() on the workers'
+    // threads. The workers have to outlive the renderer.
+    void setRecordingThreads(WorkerPool &workers, uint32_t threadCount);
+
+    // Keeps a command recorder even with one thread, so the pass can be replayed from the recorder's cache
+    void setCommandCaching(bool enabled);
+
+    // Null while everything is recorded into the primary command buffer
+    CommandRecorder *getCommandRecorder() const
+    {
+        return commandRecorder_.get();
+    }
+
+    // Prints the compiled graph of the passes after the scene whenever it is rebuilt
+    void setRenderGraphDump(bool dump)
+    {
+        dumpRenderGraph_ = dump;
+    }
+
+    // Adds passes to the graph recorded after the scene, before it is upscaled. They may draw on top of the
+    // scene's depth, and read it if the renderer was created with readableDepth. Called again whenever the
+    // graph is rebuilt for new targets.
+    void setPostScenePasses(PostScenePasses passes);
+
     VkCommandBuffer beginFrame();
     void endFrame();
     void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
@@ -52,14 +194,87 @@ class Renderer
   private:
     void createCommandBuffers();
     void freeCommandBuffers();
-    void recreateSwapChain();
+    void createCommandRecorder();
+    bool recreateSwapChain();
+    void scheduleSwapChainRecreation(bool resized);
+    bool isSwapChainRecreationDue() const;
+    void retireTarget(std::shared_ptr<RenderTarget> target);
+    void releaseRetiredTargets(bool force);
+    void beginRendering(VkCommandBuffer commandBuffer,
+                        VkClearValue colorClear,
+                        VkClearValue depthClear,
+                        VkRenderingFlags flags);
+    void endRendering(VkCommandBuffer commandBuffer);
+    bool canScaleResolution() const;
+    bool canCapture() const;
+    void createSceneTarget();
+    void buildPostSceneGraph();
+    void retirePostSceneGraph();
+    void executePostSceneGraph(VkCommandBuffer commandBuffer);
+    void blitSceneTarget(VkCommandBuffer commandBuffer);
+
+    // The scene target while the resolution is scaled, else the target that is presented or read back
+    RenderTarget &drawTarget() const
+    {
+        return sceneTarget_ != nullptr ? *sceneTarget_ : *renderTarget_;
+    }
+
+    // The scene target has one image per frame in flight
+    int drawImageIndex() const
+    {
+        return sceneTarget_ != nullptr ? currentFrameIndex_ : static_cast<int>(currentImageIndex_);
+    }
+
+    struct RetiredTarget
+    {
+        std::shared_ptr<RenderTarget> target;
+        // Frame timeline value after which nothing uses the target anymore
+        uint64_t releaseValue;
+    };
+
+    struct RetiredGraph
+    {
+        std::unique_ptr<RenderGraph> graph;
+        uint64_t releaseValue;
+    };
 
-    Window &window_;
+    Window *window_;
     Device &device_;
+    PresentPolicy presentPolicy_;
+    uint32_t framesInFlight_;
+    bool readableDepth_;
+    // Exactly one of the two targets exists, renderTarget_ points at it
     std::unique_ptr<SwapChain> swapChain_{};
+    std::unique_ptr<OffscreenTarget> offscreenTarget_{};
+    RenderTarget *renderTarget_ = nullptr;
+    // Scene rendered at a lower resolution, only exists while dynamic resolution is enabled
+    std::shared_ptr<OffscreenTarget> sceneTarget_{};
+    DynamicResolution dynamicResolution_{};
+    VkExtent2D renderExtent_{};
+    uint64_t resolutionSamples_{0};
+    // Replaced swap chains and scene targets, kept alive until the frames that used them have completed
+    std::vector<RetiredTarget> retiredTargets_{};
+    // Passes recorded after the scene, built for the current targets on first use
+    std::unique_ptr<RenderGraph> postSceneGraph_{};
+    RenderGraph::ResourceId sceneColor_{0};
+    RenderGraph::ResourceId sceneDepth_{0};
+    RenderGraph::ResourceId targetColor_{0};
+    PostScenePasses postScenePasses_{};
+    std::vector<RetiredGraph> retiredGraphs_{};
+    bool dumpRenderGraph_{false};
+    bool recreationPending_{false};
+    std::chrono::steady_clock::time_point firstResizeTime_{};
+    std::chrono::steady_clock::time_point lastResizeTime_{};
     std::vector<VkCommandBuffer> commandBuffers_{};
+    std::unique_ptr<GpuProfiler> profiler_{};
+    std::unique_ptr<FrameCapture> frameCapture_{};
+    std::unique_ptr<CommandRecorder> commandRecorder_{};
+    WorkerPool *workers_{nullptr};
+    uint32_t recordingThreads_{1};
+    bool commandCaching_{false};
     uint32_t currentImageIndex_;
     int currentFrameIndex_{0};
+    uint64_t frameNumber_{0};
     bool isFrameStarted_{false};
 };
 
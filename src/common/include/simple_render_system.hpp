@@ -2,33 +2,94 @@
 #define SRC_COMMON_INCLUDE_SIMPLE_RENDER_SYSTEM
 
 #include <memory>
+#include <vector>
 
+#include <buffer.hpp>
+#include <descriptors.hpp>
 #include <device.hpp>
 #include <game_object.hpp>
 #include <pipeline.hpp>
 
 #include "camera.hpp"
 #include "frame_info.hpp"
+#include "frustum_culler.hpp"
+#include "render_queue.hpp"
+#include "transform_store.hpp"
 
+// Submits a draw for every GameObject with a model whose bounding sphere intersects the view frustum.
+// The transforms of the visible objects are written once per frame into a storage buffer, and the objects
+// sharing a model are drawn with one instanced draw that finds them through firstInstance. With the depth
+// prepass enabled every draw is submitted twice: depth-only first, then shaded with an EQUAL depth test so
+// each pixel is shaded once.
 class SimpleRenderSystem
 {
   public:
-    SimpleRenderSystem(Device &device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
+    // Culls on up to cullingThreads of the workers' threads, including the recording thread. They also build
+    // the matrices of moved objects.
+    SimpleRenderSystem(Device &device,
+                       const RenderTargetInfo &renderTarget,
+                       VkDescriptorSetLayout globalSetLayout,
+                       uint32_t framesInFlight,
+                       WorkerPool &workers,
+                       uint32_t cullingThreads = 1);
     SimpleRenderSystem(const SimpleRenderSystem &) = delete;
     SimpleRenderSystem &operator=(const SimpleRenderSystem &) = delete;
 
-    void renderGameObjects(FrameInfo &frameInfo);
+    void submitGameObjects(FrameInfo &frameInfo, RenderQueue &renderQueue);
+
+    // Takes effect with the next submitGameObjects()
+    void setDepthPrepass(bool enabled)
+    {
+        depthPrepass_ = enabled;
+    }
+
+    bool isDepthPrepassEnabled() const
+    {
+        return depthPrepass_;
+    }
+
+    const FrustumCuller &getCuller() const
+    {
+        return culler_;
+    }
 
     ~SimpleRenderSystem();
 
   private:
+    // Per-object data of the draws of one frame in flight
+    struct FrameResources
+    {
+        std::unique_ptr<Buffer> objects;
+        VkDescriptorSet objectSet = VK_NULL_HANDLE;
+    };
+
+    void createObjectSets(uint32_t framesInFlight);
     void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
-    void createPipeline(VkRenderPass renderPass);
+    void createPipeline(const RenderTargetInfo &renderTarget);
+    Buffer &objectBuffer(int frameIndex, size_t objectCount);
+
+    // Objects drawn with the same model, contiguous in the sorted object list
+    struct ModelGroup
+    {
+        Model *model;
+        uint32_t first;
+        uint32_t count;
+    };
 
     Device &device_;
+    FrustumCuller culler_;
+    TransformStore transforms_;
 
     std::unique_ptr<Pipeline> pipeline_{};
+    // Depth-only pipeline of the prepass, and the shading one that tests against its depth
+    std::unique_ptr<Pipeline> depthPipeline_{};
+    std::unique_ptr<Pipeline> equalPipeline_{};
+    bool depthPrepass_{false};
     VkPipelineLayout pipelineLayout_{};
+    std::unique_ptr<DescriptorSetLayout> objectSetLayout_{};
+    std::unique_ptr<DescriptorPool> descriptorPool_{};
+    // The object buffers are replaced by larger ones when the scene outgrows them
+    std::vector<FrameResources> frames_{};
 };
 
 #endif /* SRC_COMMON_INCLUDE_SIMPLE_RENDER_SYSTEM */
@@ -0,0 +1,122 @@
+#ifndef SRC_COMMON_INCLUDE_STAGING_POOL
+#define SRC_COMMON_INCLUDE_STAGING_POOL
+
+#include "buffer.hpp"
+#include "device.hpp"
+
+// std
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Pool of persistently mapped, host-visible staging blocks with power-of-two sizes. Spans handed out by
+// acquire() are bumped off a block until it is full, and the block is reused once all its spans are
+// released and the fences they were released with have signaled. upload() records its copy into a batch
+// that flush() submits with a single fence. Blocks that stay unused for a number of ticks are given back to
+// the driver so the pool shrinks again after bulk loads.
+class StagingPool
+{
+  public:
+    static constexpr VkDeviceSize MIN_BLOCK_SIZE = 64 * 1024;
+    static constexpr VkDeviceSize SPAN_ALIGNMENT = 16;
+    static constexpr uint32_t DEFAULT_IDLE_TICKS = 300;
+    // Submitted batches of uploads in flight at once, the next batch waits for one of them to complete
+    static constexpr uint32_t MAX_TRANSFERS = 4;
+
+    struct Span
+    {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        void *mapped = nullptr;
+        uint32_t block = 0;
+    };
+
+    struct Stats
+    {
+        VkDeviceSize bytesAllocated = 0;
+        VkDeviceSize bytesInUse = 0;
+        VkDeviceSize highWaterBytesAllocated = 0;
+        VkDeviceSize highWaterBytesInUse = 0;
+        uint32_t blockCount = 0;
+        uint32_t highWaterBlockCount = 0;
+        uint64_t acquireCount = 0;
+        uint64_t reuseCount = 0;
+        uint64_t shrinkCount = 0;
+        uint64_t submitCount = 0;
+    };
+
+    StagingPool(Device &device, uint32_t idleTicksBeforeShrink = DEFAULT_IDLE_TICKS);
+    ~StagingPool();
+
+    StagingPool(const StagingPool &) = delete;
+    StagingPool &operator=(const StagingPool &) = delete;
+
+    Span acquire(VkDeviceSize size);
+    void release(const Span &span, VkFence fence = VK_NULL_HANDLE);
+
+    void upload(const void *data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset = 0);
+    void flush();
+
+    void tick();
+    void waitIdle();
+
+    const Stats &getStats() const
+    {
+        return stats_;
+    }
+
+  private:
+    enum class BlockState
+    {
+        Free,
+        InUse,
+        Released
+    };
+
+    struct Block
+    {
+        std::unique_ptr<Buffer> buffer;
+        VkDeviceSize size = 0;
+        // Bytes handed out since the block was last free, spans are bumped off the rest
+        VkDeviceSize used = 0;
+        uint32_t liveSpans = 0;
+        // Signaled once the GPU is done with the released spans
+        std::vector<VkFence> fences;
+        BlockState state = BlockState::Released;
+        uint64_t lastUsedTick = 0;
+    };
+
+    struct Transfer
+    {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        // Submitted and not seen complete yet
+        bool pending = false;
+    };
+
+    static constexpr size_t NO_TRANSFER = SIZE_MAX;
+
+    static VkDeviceSize blockSizeFor(VkDeviceSize size);
+
+    uint32_t findBlock(VkDeviceSize size);
+    uint32_t createBlock(VkDeviceSize size);
+    void destroyBlock(Block &block);
+    void freeIfUnused(Block &block);
+    void recycleCompleted();
+    void shrinkIdle();
+    Transfer &recordingTransfer();
+    size_t acquireTransfer();
+
+    Device &device_;
+    uint32_t idleTicksBeforeShrink_;
+    uint64_t tick_ = 0;
+
+    std::vector<Block> blocks_;
+    std::vector<Transfer> transfers_;
+    // Transfer the uploads since the last flush() are recorded into
+    size_t recording_ = NO_TRANSFER;
+    Stats stats_{};
+};
+
+#endif /* SRC_COMMON_INCLUDE_STAGING_POOL */
@@ -2,35 +2,72 @@
 #define SRC_COMMON_INCLUDE_SWAP_CHAIN
 
 #include "device.hpp"
+#include "render_target.hpp"
 
 // vulkan headers
 #include <vulkan/vulkan.h>
 
 // std lib headers
+#include <chrono>
+#include <deque>
 #include <memory>
 #include <string>
 #include <vector>
 
-
-class SwapChain
+// How frames are handed to the presentation engine
+struct PresentPolicy
 {
-  public:
-    static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+    // Falls back to FIFO, which every surface supports, when the mode is unavailable
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+    // Requested number of swapchain images, 0 picks minImageCount + 1. Clamped to the surface limits.
+    uint32_t imageCount = 0;
+    // Presented frames allowed to wait for display before the CPU blocks, 0 means unlimited
+    uint32_t maxQueuedFrames = 0;
+
+    // Uncapped frame rate for benchmarking, may tear
+    static PresentPolicy throughput();
+    // Tear-free, and the CPU never runs more than one frame ahead of the display
+    static PresentPolicy lowLatency();
+};
 
-    SwapChain(Device &deviceRef, VkExtent2D windowExtent);
-    SwapChain(Device &deviceRef, VkExtent2D windowExtent, std::shared_ptr<SwapChain> previous);
+// Time from vkQueuePresentKHR until the image was displayed, measured with VK_KHR_present_wait
+struct PresentStats
+{
+    uint64_t presentedFrames = 0;
+    uint64_t measuredFrames = 0;
+    double lastLatencyMs = 0.0;
+    double averageLatencyMs = 0.0;
+    double maxLatencyMs = 0.0;
+};
 
-    ~SwapChain();
+class SwapChain : public RenderTarget
+{
+  public:
+    // readableDepth keeps the depth after the render pass and lets shaders sample it, otherwise it is a
+    // transient attachment. A swap chain recreated from a previous one keeps the previous one's choice.
+    SwapChain(Device &deviceRef,
+              VkExtent2D windowExtent,
+              const PresentPolicy &policy,
+              uint32_t framesInFlight,
+              bool readableDepth = false);
+    SwapChain(Device &deviceRef,
+              VkExtent2D windowExtent,
+              const PresentPolicy &policy,
+              uint32_t framesInFlight,
+              std::shared_ptr<SwapChain> previous);
+
+    ~SwapChain() override;
 
     SwapChain(const SwapChain &) = delete;
     SwapChain &operator=(const SwapChain &) = delete;
 
-    VkFramebuffer getFrameBuffer(int index)
+    // Framebuffer for the acquired image, paired with the depth attachment of the current frame slot
+    VkFramebuffer getFrameBuffer(int index) override
     {
-        return swapChainFramebuffers[index];
+        return swapChainFramebuffers[currentFrame * imageCount() + index];
     }
 
-    VkRenderPass getRenderPass()
+    VkRenderPass getRenderPass() override
     {
         return renderPass;
     }
@@ -40,7 +77,7 @@ class SwapChain
         return swapChainImageViews[index];
     }
 
-    size_t imageCount()
+    size_t imageCount() override
     {
         return swapChainImages.size();
     }
@@ -55,6 +92,40 @@ class SwapChain
         return swapChainExtent;
     }
 
+    VkExtent2D getExtent() override
+    {
+        return swapChainExtent;
+    }
+
+    VkFormat getColorFormat() const override
+    {
+        return swapChainImageFormat;
+    }
+
+    VkFormat getDepthFormat() const override
+    {
+        return swapChainDepthFormat;
+    }
+
+    // Like getFrameBuffer, the depth attachment is the current frame slot's
+    RenderTargetAttachments getAttachments(int index) override
+    {
+        return {swapChainImages[index],
+                swapChainImageViews[index],
+                depthImages[currentFrame],
+                depthImageViews[currentFrame]};
+    }
+
+    VkImageLayout getFinalColorLayout() const override
+    {
+        return VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    }
+
+    VkImageUsageFlags getImageUsage() const
+    {
+        return imageUsage_;
+    }
+
     uint32_t width()
     {
         return swapChainExtent.width;
@@ -65,14 +136,10 @@ class SwapChain
         return swapChainExtent.height;
     }
 
-    float extentAspectRatio()
-    {
-        return static_cast<float>(swapChainExtent.width) / static_cast<float>(swapChainExtent.height);
-    }
     VkFormat findDepthFormat();
 
-    VkResult acquireNextImage(uint32_t *imageIndex);
-    VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex);
+    VkResult acquireNextImage(uint32_t *imageIndex) override;
+    VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex) override;
 
     bool compareSwapFormats(const SwapChain &swapChain) const
     {
@@ -80,6 +147,16 @@ class SwapChain
                swapChain.swapChainImageFormat == swapChainImageFormat;
     }
 
+    VkPresentModeKHR getPresentMode() const
+    {
+        return presentMode_;
+    }
+
+    const PresentStats &getPresentStats() const
+    {
+        return presentStats_;
+    }
+
   private:
     void init();
     void createSwapChain();
@@ -93,17 +170,21 @@ class SwapChain
     VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR> &availableFormats);
     VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes);
     VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities);
+    uint32_t chooseImageCount(const VkSurfaceCapabilitiesKHR &capabilities);
+    void limitQueuedFrames();
+    void collectPresentLatencies(uint64_t timeout);
 
     VkFormat swapChainImageFormat;
     VkFormat swapChainDepthFormat;
     VkExtent2D swapChainExtent;
 
     std::vector<VkFramebuffer> swapChainFramebuffers;
-    VkRenderPass renderPass;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
 
     std::vector<VkImage> depthImages;
     std::vector<VkDeviceMemory> depthImageMemorys;
     std::vector<VkImageView> depthImageViews;
+    VkExtent2D depthExtent_{};
     std::vector<VkImage> swapChainImages;
     std::vector<VkImageView> swapChainImageViews;
 
@@ -115,9 +196,24 @@ class SwapChain
 
     std::vector<VkSemaphore> imageAvailableSemaphores;
     std::vector<VkSemaphore> renderFinishedSemaphores;
-    std::vector<VkFence> inFlightFences;
-    std::vector<VkFence> imagesInFlight;
+    // Frame timeline values of the last frame submitted from each frame slot and to each image
+    std::vector<uint64_t> frameValues_;
+    std::vector<uint64_t> imageValues_;
     size_t currentFrame = 0;
+
+    struct PendingPresent
+    {
+        uint64_t presentId;
+        std::chrono::steady_clock::time_point presentTime;
+    };
+
+    PresentPolicy policy_;
+    bool readableDepth_ = false;
+    VkPresentModeKHR presentMode_ = VK_PRESENT_MODE_FIFO_KHR;
+    VkImageUsageFlags imageUsage_ = 0;
+    uint64_t presentId_ = 0;
+    std::deque<PendingPresent> pendingPresents_;
+    PresentStats presentStats_{};
 };
 
 #endif /* SRC_COMMON_INCLUDE_SWAP_CHAIN */
@@ -0,0 +1,33 @@
+#ifndef SRC_COMMON_INCLUDE_TRANSFORM_LANES
+#define SRC_COMMON_INCLUDE_TRANSFORM_LANES
+
+// std
+#include <cstddef>
+
+// Separate arrays of the transforms TransformStore builds with its SIMD kernels, and the matrices they
+// build. Free of glm, as the kernels are compiled for other instruction sets than the code calling them.
+struct TransformLanes
+{
+    const float *translationX;
+    const float *translationY;
+    const float *translationZ;
+    const float *rotationX;
+    const float *rotationY;
+    const float *rotationZ;
+    const float *scaleX;
+    const float *scaleY;
+    const float *scaleZ;
+    // 16 floats per transform, column-major like glm::mat4
+    float *matrices;
+    // 9 floats per transform, column-major like glm::mat3
+    float *normalMatrices;
+};
+
+// Build the matrices of whole groups of lanes from begin on and return the index after the last transform
+// built. They stop at the first group with an angle of 8192 radians or more, which their sines and cosines
+// can't reduce. Only the kernels of the instruction sets the library was built for exist, see
+// TransformStore::isSimdAvailable().
+size_t buildTransformLanesSse(const TransformLanes &lanes, size_t begin, size_t end);
+size_t buildTransformLanesAvx(const TransformLanes &lanes, size_t begin, size_t end);
+
+#endif /* SRC_COMMON_INCLUDE_TRANSFORM_LANES */
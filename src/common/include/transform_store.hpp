@@ -0,0 +1,98 @@
+#ifndef SRC_COMMON_INCLUDE_TRANSFORM_STORE
+#define SRC_COMMON_INCLUDE_TRANSFORM_STORE
+
+#include "game_object.hpp"
+#include "transform_lanes.hpp"
+#include "worker_pool.hpp"
+
+// std
+#include <cstdint>
+#include <vector>
+
+// Builds the matrices of many TransformComponents in one batch. The translations, rotations and scales of
+// the added transforms are gathered into separate arrays so that the sines and cosines and both matrices are
+// computed for several transforms at once with SSE or AVX. The AVX kernel is used on CPUs that support it,
+// unless the compiler can't build it (see src/common/CMakeLists.txt). The results are written back into the
+// transforms' caches. Large batches are split into ranges built on several threads.
+//
+// The sines and cosines are a polynomial approximation accurate to about one ulp, so the matrices can
+// differ from TransformComponent::mat4() in the last bits of an element. Transforms with angles of 8192
+// radians or more, where the approximation's range reduction fails, are built by TransformComponent itself.
+class TransformStore
+{
+  public:
+    // Smaller ranges cost more to hand to a thread than to build
+    static constexpr size_t MIN_TRANSFORMS_PER_RANGE = 2048;
+
+    // Builds on up to threadCount of the workers' threads, the calling thread builds the first range
+    TransformStore(WorkerPool &workers, uint32_t threadCount);
+
+    TransformStore(const TransformStore &) = delete;
+    TransformStore &operator=(const TransformStore &) = delete;
+
+    enum class Simd
+    {
+        Scalar,
+        Sse,
+        Avx
+    };
+
+    static bool isSimdAvailable(Simd simd);
+    // Widest available instruction set, which new stores build with
+    static Simd getSupportedSimd();
+    static const char *getSimdName(Simd simd);
+
+    void setSimd(Simd simd);
+
+    Simd getSimd() const
+    {
+        return simd_;
+    }
+
+    uint32_t getThreadCount() const
+    {
+        return threadCount_;
+    }
+
+    size_t size() const
+    {
+        return transforms_.size();
+    }
+
+    void clear();
+    void add(TransformComponent &transform);
+    void update();
+
+  private:
+    struct Range
+    {
+        size_t begin;
+        size_t end;
+    };
+
+    void buildRange(const Range &range);
+
+    WorkerPool &workers_;
+    uint32_t threadCount_;
+    Simd simd_ = Simd::Scalar;
+    // Null for Simd::Scalar
+    size_t (*kernel_)(const TransformLanes &lanes, size_t begin, size_t end) = nullptr;
+    size_t laneCount_ = 1;
+
+    std::vector<TransformComponent *> transforms_;
+    std::vector<float> translationX_;
+    std::vector<float> translationY_;
+    std::vector<float> translationZ_;
+    std::vector<float> rotationX_;
+    std::vector<float> rotationY_;
+    std::vector<float> rotationZ_;
+    std::vector<float> scaleX_;
+    std::vector<float> scaleY_;
+    std::vector<float> scaleZ_;
+    // Built by the kernel, before they are written into the transforms
+    std::vector<float> matrices_;
+    std::vector<float> normalMatrices_;
+    std::vector<Range> ranges_;
+};
+
+#endif /* SRC_COMMON_INCLUDE_TRANSFORM_STORE */
@@ -0,0 +1,55 @@
+#ifndef SRC_COMMON_INCLUDE_WORKER_POOL
+#define SRC_COMMON_INCLUDE_WORKER_POOL
+
+// std
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads that run the tasks of one job at a time, shared by everything that splits its work into ranges. The
+// thread calling run() runs task 0 itself, so a pool of one thread starts no threads at all. Task i always
+// runs on thread i, which lets callers keep per-thread resources.
+//
+// run() is called from one thread at a time and not from within a task.
+class WorkerPool
+{
+  public:
+    // Called with the index of the task, which is also the index of the thread running it
+    using Task = std::function<void(uint32_t thread)>;
+
+    // threadCount includes the calling thread
+    explicit WorkerPool(uint32_t threadCount);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    uint32_t getThreadCount() const
+    {
+        return static_cast<uint32_t>(workers_.size() + 1);
+    }
+
+    void run(uint32_t taskCount, const Task &task);
+
+  private:
+    void workLoop(uint32_t thread);
+
+    // The job of the current run() call, shared with the workers
+    std::mutex mutex_;
+    std::condition_variable jobStarted_;
+    std::condition_variable jobFinished_;
+    uint64_t job_ = 0;
+    uint32_t taskCount_ = 0;
+    uint32_t pendingWorkers_ = 0;
+    bool stopping_ = false;
+    const Task *task_ = nullptr;
+    std::exception_ptr error_;
+
+    std::vector<std::thread> workers_;
+};
+
+#endif /* SRC_COMMON_INCLUDE_WORKER_POOL */
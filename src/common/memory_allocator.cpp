@@ -0,0 +1,316 @@
+#include "memory_allocator.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <stdexcept>
+
+namespace
+{
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return alignment > 1 ? (value + alignment - 1) & ~(alignment - 1) : value;
+}
+} // namespace
+
+float MemoryAllocator::Metrics::fragmentation() const
+{
+    const VkDeviceSize freeBytes = totalBytes - usedBytes;
+    if (freeBytes == 0)
+    {
+        return 0.f;
+    }
+    return 1.f - static_cast<float>(largestFreeRange) / static_cast<float>(freeBytes);
+}
+
+float MemoryAllocator::Metrics::utilization() const
+{
+    if (totalBytes == 0)
+    {
+        return 1.f;
+    }
+    return static_cast<float>(usedBytes) / static_cast<float>(totalBytes);
+}
+
+MemoryAllocator::MemoryAllocator(Device &device, VkDeviceSize blockSize) : device_{device}, blockSize_{blockSize}
+{
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+    for (uint32_t i = 0; i < blocks_.size(); i++)
+    {
+        assert(blocks_[i].allocations.empty() && "Memory allocator destroyed while buffers are still alive");
+        destroyBlock(i);
+    }
+}
+
+/**
+ * Finds space for a buffer in an existing block, or reserves a new block when none fits
+ *
+ * @param requirements Memory requirements of the buffer
+ * @param properties Memory properties the backing memory type must have
+ * @param owner Buffer the allocation is bound to
+ *
+ * @return Allocation describing the memory and offset to bind the buffer at
+ */
+MemoryAllocator::Allocation MemoryAllocator::allocate(const VkMemoryRequirements &requirements,
+                                                      VkMemoryPropertyFlags properties,
+                                                      Buffer *owner)
+{
+    const uint32_t memoryTypeIndex = device_.findMemoryType(requirements.memoryTypeBits, properties);
+
+    Allocation allocation{};
+    bool found = false;
+    for (uint32_t i = 0; i < blocks_.size() && !found; i++)
+    {
+        if (blocks_[i].memory != VK_NULL_HANDLE && !blocks_[i].evacuating &&
+            blocks_[i].memoryTypeIndex == memoryTypeIndex)
+        {
+            found = tryAllocateFromBlock(i, requirements, allocation);
+        }
+    }
+
+    if (!found)
+    {
+        const uint32_t index = createBlock(std::max(blockSize_, requirements.size), memoryTypeIndex);
+        found = tryAllocateFromBlock(index, requirements, allocation);
+        assert(found && "Fresh memory block cannot hold the allocation");
+    }
+
+    blocks_[allocation.block].allocations[allocation.offset] = {allocation.size, owner};
+    return allocation;
+}
+
+/**
+ * Returns an allocation to its block. Blocks left without allocations are released to the driver.
+ *
+ * @param allocation Allocation previously returned by allocate()
+ */
+void MemoryAllocator::free(const Allocation &allocation)
+{
+    assert(allocation.block < blocks_.size() && "Invalid allocation block");
+    auto &block = blocks_[allocation.block];
+
+    auto allocationIt = block.allocations.find(allocation.offset);
+    assert(allocationIt != block.allocations.end() && "Freeing an allocation that is not alive");
+    block.allocations.erase(allocationIt);
+    block.usedBytes -= allocation.size;
+
+    if (block.allocations.empty())
+    {
+        destroyBlock(allocation.block);
+        return;
+    }
+
+    VkDeviceSize offset = allocation.offset;
+    VkDeviceSize size = allocation.size;
+
+    // merge with the following free range
+    auto next = block.freeRanges.lower_bound(offset);
+    if (next != block.freeRanges.end() && offset + size == next->first)
+    {
+        size += next->second;
+        next = block.freeRanges.erase(next);
+    }
+
+    // merge with the preceding free range
+    if (next != block.freeRanges.begin())
+    {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset)
+        {
+            prev->second += size;
+            return;
+        }
+    }
+
+    block.freeRanges[offset] = size;
+}
+
+void MemoryAllocator::setOwner(const Allocation &allocation, Buffer *owner)
+{
+    auto &allocations = blocks_[allocation.block].allocations;
+    auto it = allocations.find(allocation.offset);
+    assert(it != allocations.end() && "Setting the owner of an allocation that is not alive");
+    it->second.second = owner;
+}
+
+Buffer *MemoryAllocator::getOwner(const Allocation &allocation) const
+{
+    if (allocation.block >= blocks_.size())
+    {
+        return nullptr;
+    }
+
+    const auto &block = blocks_[allocation.block];
+    if (block.memory != allocation.memory)
+    {
+        return nullptr;
+    }
+
+    auto it = block.allocations.find(allocation.offset);
+    return it == block.allocations.end() ? nullptr : it->second.second;
+}
+
+void MemoryAllocator::setEvacuating(uint32_t block, bool evacuating)
+{
+    if (block < blocks_.size())
+    {
+        blocks_[block].evacuating = evacuating;
+    }
+}
+
+std::vector<MemoryAllocator::BlockInfo> MemoryAllocator::getBlockInfos() const
+{
+    std::vector<BlockInfo> infos;
+    for (uint32_t i = 0; i < blocks_.size(); i++)
+    {
+        const auto &block = blocks_[i];
+        if (block.memory == VK_NULL_HANDLE)
+        {
+            continue;
+        }
+
+        BlockInfo info{};
+        info.index = i;
+        info.size = block.size;
+        info.usedBytes = block.usedBytes;
+        info.allocationCount = static_cast<uint32_t>(block.allocations.size());
+        info.evacuating = block.evacuating;
+        for (const auto &range : block.freeRanges)
+        {
+            info.largestFreeRange = std::max(info.largestFreeRange, range.second);
+        }
+        infos.push_back(info);
+    }
+    return infos;
+}
+
+std::vector<std::pair<MemoryAllocator::Allocation, Buffer *>> MemoryAllocator::getAllocations(uint32_t block) const
+{
+    std::vector<std::pair<Allocation, Buffer *>> result;
+    if (block >= blocks_.size())
+    {
+        return result;
+    }
+
+    for (const auto &kv : blocks_[block].allocations)
+    {
+        Allocation allocation{};
+        allocation.memory = blocks_[block].memory;
+        allocation.offset = kv.first;
+        allocation.size = kv.second.first;
+        allocation.block = block;
+        result.emplace_back(allocation, kv.second.second);
+    }
+    return result;
+}
+
+MemoryAllocator::Metrics MemoryAllocator::getMetrics() const
+{
+    Metrics metrics{};
+    for (const auto &block : blocks_)
+    {
+        if (block.memory == VK_NULL_HANDLE)
+        {
+            continue;
+        }
+
+        metrics.blockCount++;
+        metrics.allocationCount += static_cast<uint32_t>(block.allocations.size());
+        metrics.freeRangeCount += static_cast<uint32_t>(block.freeRanges.size());
+        metrics.totalBytes += block.size;
+        metrics.usedBytes += block.usedBytes;
+        for (const auto &range : block.freeRanges)
+        {
+            metrics.largestFreeRange = std::max(metrics.largestFreeRange, range.second);
+        }
+    }
+    return metrics;
+}
+
+bool MemoryAllocator::tryAllocateFromBlock(uint32_t index,
+                                           const VkMemoryRequirements &requirements,
+                                           Allocation &allocation)
+{
+    auto &block = blocks_[index];
+    for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); ++it)
+    {
+        const VkDeviceSize rangeOffset = it->first;
+        const VkDeviceSize rangeEnd = it->first + it->second;
+        const VkDeviceSize offset = alignUp(rangeOffset, requirements.alignment);
+        if (offset + requirements.size > rangeEnd)
+        {
+            continue;
+        }
+
+        block.freeRanges.erase(it);
+        if (offset > rangeOffset)
+        {
+            block.freeRanges[rangeOffset] = offset - rangeOffset;
+        }
+        if (offset + requirements.size < rangeEnd)
+        {
+            block.freeRanges[offset + requirements.size] = rangeEnd - (offset + requirements.size);
+        }
+
+        block.usedBytes += requirements.size;
+
+        allocation.memory = block.memory;
+        allocation.offset = offset;
+        allocation.size = requirements.size;
+        allocation.block = index;
+        return true;
+    }
+    return false;
+}
+
+uint32_t MemoryAllocator::createBlock(VkDeviceSize size, uint32_t memoryTypeIndex)
+{
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+    // Blocks are shared, so any of their buffers may want a device address.
+    VkMemoryAllocateFlagsInfo allocFlagsInfo{};
+    allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+    allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+    if (device_.bufferDeviceAddressEnabled())
+    {
+        allocInfo.pNext = &allocFlagsInfo;
+    }
+
+    Block block{};
+    if (vkAllocateMemory(device_.device(), &allocInfo, nullptr, &block.memory) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate device memory block!");
+    }
+    block.size = size;
+    block.memoryTypeIndex = memoryTypeIndex;
+    block.freeRanges[0] = size;
+
+    for (uint32_t i = 0; i < blocks_.size(); i++)
+    {
+        if (blocks_[i].memory == VK_NULL_HANDLE)
+        {
+            blocks_[i] = std::move(block);
+            return i;
+        }
+    }
+
+    blocks_.push_back(std::move(block));
+    return static_cast<uint32_t>(blocks_.size() - 1);
+}
+
+void MemoryAllocator::destroyBlock(uint32_t index)
+{
+    auto &block = blocks_[index];
+    if (block.memory != VK_NULL_HANDLE)
+    {
+        vkFreeMemory(device_.device(), block.memory, nullptr);
+    }
+    block = Block{};
+}
@@ -1,4 +1,5 @@
 #include "model.hpp"
+#include "staging_pool.hpp"
 #include "utils.hpp"
 
 #define TINYOBJLOADER_IMPLEMENTATION
@@ -6,7 +7,9 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/hash.hpp>
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstring>
 #include <iostream>
 #include <unordered_map>
@@ -29,6 +32,7 @@ Model::Model(Device &device, const Model::Builder &builder) : device_{device}
 {
     createVertexBuffers(builder.vertices);
     createIndexBuffers(builder.indices);
+    computeBoundingSphere(builder.vertices);
 }
 
 std::unique_ptr<Model> Model::createModelFromFile(Device &device, const std::string &filepath)
@@ -51,18 +55,45 @@ void Model::bind(VkCommandBuffer commandBuffer)
     }
 }
 
-void Model::draw(VkCommandBuffer commandBuffer)
+void Model::draw(VkCommandBuffer commandBuffer, uint32_t instanceCount, uint32_t firstInstance)
 {
     if (hasIndexBuffer_)
     {
-        vkCmdDrawIndexed(commandBuffer, indexCount_, 1, 0, 0, 0);
+        vkCmdDrawIndexed(commandBuffer, indexCount_, instanceCount, 0, 0, firstInstance);
     }
     else
     {
-        vkCmdDraw(commandBuffer, vertexCount_, 1, 0, 0);
+        vkCmdDraw(commandBuffer, vertexCount_, instanceCount, 0, firstInstance);
     }
 }
 
+// Centered on the bounding box, which is close enough to the smallest sphere for culling
+void Model::computeBoundingSphere(const std::vector<Vertex> &vertices)
+{
+    if (vertices.empty())
+    {
+        boundingSphere_ = glm::vec4{0.0f};
+        return;
+    }
+
+    glm::vec3 min{vertices[0].position};
+    glm::vec3 max{vertices[0].position};
+    for (const auto &vertex : vertices)
+    {
+        min = glm::min(min, vertex.position);
+        max = glm::max(max, vertex.position);
+    }
+
+    const glm::vec3 center = (min + max) * 0.5f;
+    float radiusSquared = 0.0f;
+    for (const auto &vertex : vertices)
+    {
+        const glm::vec3 offset = vertex.position - center;
+        radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+    }
+    boundingSphere_ = glm::vec4{center, std::sqrt(radiusSquared)};
+}
+
 void Model::createVertexBuffers(const std::vector<Vertex> &vertices)
 {
     vertexCount_ = static_cast<uint32_t>(vertices.size());
@@ -71,24 +102,13 @@ void Model::createVertexBuffers(const std::vector<Vertex> &vertices)
     VkDeviceSize bufferSize = sizeof(vertices[0]) * vertexCount_;
     uint32_t vertexSize = sizeof(vertices[0]);
 
-    Buffer stagingBuffer{
-      device_,
-      vertexSize,
-      vertexCount_,
-      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-    };
-
-    stagingBuffer.map();
-    stagingBuffer.writeToBuffer((void *)vertices.data());
-
     vertexBuffer_ = std::make_unique<Buffer>(device_,
                                              vertexSize,
                                              vertexCount_,
                                              VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
                                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-    device_.copyBuffer(stagingBuffer.getBuffer(), vertexBuffer_->getBuffer(), bufferSize);
+    device_.stagingPool().upload(vertices.data(), bufferSize, vertexBuffer_->getBuffer());
 }
 
 void Model::createIndexBuffers(const std::vector<uint32_t> &indices)
@@ -104,23 +124,13 @@ void Model::createIndexBuffers(const std::vector<uint32_t> &indices)
     VkDeviceSize bufferSize = sizeof(indices[0]) * indexCount_;
     uint32_t indexSize = sizeof(indices[0]);
 
-    Buffer stagingBuffer{
-      device_,
-      indexSize,
-      indexCount_,
-      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-    };
-
-    stagingBuffer.map();
-    stagingBuffer.writeToBuffer((void *)indices.data());
     indexBuffer_ = std::make_unique<Buffer>(device_,
                                             indexSize,
                                             indexCount_,
                                             VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
                                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-    device_.copyBuffer(stagingBuffer.getBuffer(), indexBuffer_->getBuffer(), bufferSize);
+    device_.stagingPool().upload(indices.data(), bufferSize, indexBuffer_->getBuffer());
 }
 
 std::vector<VkVertexInputBindingDescription> Model::Vertex::getBindingDescriptions()
@@ -0,0 +1,281 @@
+#include "offscreen_target.hpp"
+#include "frame_timeline.hpp"
+
+// std
+#include <array>
+#include <stdexcept>
+
+OffscreenTarget::OffscreenTarget(Device &device,
+                                 VkExtent2D extent,
+                                 uint32_t framesInFlight,
+                                 uint32_t imageCount,
+                                 VkFormat colorFormat,
+                                 bool readableDepth)
+  : RenderTarget{framesInFlight}, device_{device}, extent_{extent}, colorFormat_{colorFormat},
+    readableDepth_{readableDepth}
+{
+    if (colorFormat_ == VK_FORMAT_UNDEFINED)
+    {
+        colorFormat_ = device_.findSupportedFormat({VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_R8G8B8A8_SRGB},
+                                                   VK_IMAGE_TILING_OPTIMAL,
+                                                   VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT);
+    }
+    depthFormat_ =
+      device_.findSupportedFormat({VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
+                                  VK_IMAGE_TILING_OPTIMAL,
+                                  VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                                    (readableDepth_ ? VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT : 0));
+
+    createAttachments(imageCount == 0 ? framesInFlight + 1 : imageCount);
+    if (!device_.dynamicRenderingEnabled())
+    {
+        createRenderPass();
+        createFramebuffers();
+    }
+    frameValues_.resize(framesInFlight_, 0);
+    imageValues_.resize(this->imageCount(), 0);
+}
+
+OffscreenTarget::~OffscreenTarget()
+{
+    auto &timeline = device_.frameTimeline();
+    for (auto value : frameValues_)
+    {
+        timeline.wait(value);
+    }
+
+    for (auto framebuffer : framebuffers_)
+    {
+        vkDestroyFramebuffer(device_.device(), framebuffer, nullptr);
+    }
+
+    for (auto &attachment : colorAttachments_)
+    {
+        destroyAttachment(attachment);
+    }
+    for (auto &attachment : depthAttachments_)
+    {
+        destroyAttachment(attachment);
+    }
+
+    if (renderPass_ != VK_NULL_HANDLE)
+    {
+        vkDestroyRenderPass(device_.device(), renderPass_, nullptr);
+    }
+}
+
+/**
+ * Waits for the current frame slot and picks the next image of the ring
+ *
+ * @param imageIndex Set to the image the frame renders into
+ *
+ * @return Always VK_SUCCESS, there is nothing that can go out of date
+ */
+VkResult OffscreenTarget::acquireNextImage(uint32_t *imageIndex)
+{
+    device_.frameTimeline().wait(frameValues_[currentFrame_]);
+
+    *imageIndex = nextImage_;
+    nextImage_ = (nextImage_ + 1) % static_cast<uint32_t>(imageCount());
+    return VK_SUCCESS;
+}
+
+VkResult OffscreenTarget::submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex)
+{
+    // With more images than frames in flight this only waits when a frame slot wraps onto an image
+    // that is still being rendered to.
+    auto &timeline = device_.frameTimeline();
+    timeline.wait(imageValues_[*imageIndex]);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = buffers;
+
+    frameValues_[currentFrame_] = timeline.submit(device_.graphicsQueue(), submitInfo);
+    imageValues_[*imageIndex] = frameValues_[currentFrame_];
+
+    currentFrame_ = (currentFrame_ + 1) % framesInFlight_;
+    return VK_SUCCESS;
+}
+
+void OffscreenTarget::createRenderPass()
+{
+    VkAttachmentDescription colorAttachment{};
+    colorAttachment.format = colorFormat_;
+    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+    VkAttachmentDescription depthAttachment{};
+    depthAttachment.format = depthFormat_;
+    depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    // Only kept if passes after the scene read it
+    depthAttachment.storeOp = readableDepth_ ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference colorAttachmentRef{};
+    colorAttachmentRef.attachment = 0;
+    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference depthAttachmentRef{};
+    depthAttachmentRef.attachment = 1;
+    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorAttachmentRef;
+    subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+    std::array<VkSubpassDependency, 2> dependencies{};
+
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask =
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].srcAccessMask = 0;
+    dependencies[0].dstStageMask =
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].dstAccessMask =
+      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    // Make the rendered image visible to copies recorded after the render pass.
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    std::array<VkAttachmentDescription, 2> attachments = {colorAttachment, depthAttachment};
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    renderPassInfo.pAttachments = attachments.data();
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
+
+    if (vkCreateRenderPass(device_.device(), &renderPassInfo, nullptr, &renderPass_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create offscreen render pass!");
+    }
+}
+
+void OffscreenTarget::createAttachments(uint32_t imageCount)
+{
+    colorAttachments_.resize(imageCount);
+    depthAttachments_.resize(imageCount);
+
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        colorAttachments_[i] = createAttachment(colorFormat_,
+                                                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                                                  VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                                                VK_IMAGE_ASPECT_COLOR_BIT,
+                                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                                0);
+        if (readableDepth_)
+        {
+            depthAttachments_[i] = createAttachment(depthFormat_,
+                                                    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                                                      VK_IMAGE_USAGE_SAMPLED_BIT,
+                                                    VK_IMAGE_ASPECT_DEPTH_BIT,
+                                                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                                    0);
+        }
+        else
+        {
+            depthAttachments_[i] = createAttachment(
+              depthFormat_,
+              VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+              VK_IMAGE_ASPECT_DEPTH_BIT,
+              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT,
+              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        }
+    }
+}
+
+void OffscreenTarget::createFramebuffers()
+{
+    framebuffers_.resize(imageCount());
+    for (size_t i = 0; i < framebuffers_.size(); i++)
+    {
+        std::array<VkImageView, 2> attachments = {colorAttachments_[i].view, depthAttachments_[i].view};
+
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = renderPass_;
+        framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        framebufferInfo.pAttachments = attachments.data();
+        framebufferInfo.width = extent_.width;
+        framebufferInfo.height = extent_.height;
+        framebufferInfo.layers = 1;
+
+        if (vkCreateFramebuffer(device_.device(), &framebufferInfo, nullptr, &framebuffers_[i]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create offscreen framebuffer!");
+        }
+    }
+}
+
+OffscreenTarget::Attachment OffscreenTarget::createAttachment(VkFormat format,
+                                                              VkImageUsageFlags usage,
+                                                              VkImageAspectFlags aspect,
+                                                              VkMemoryPropertyFlags properties,
+                                                              VkMemoryPropertyFlags fallbackProperties)
+{
+    Attachment attachment{};
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = extent_.width;
+    imageInfo.extent.height = extent_.height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = format;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = usage;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    device_.createImageWithInfo(imageInfo, properties, attachment.image, attachment.memory, fallbackProperties);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = attachment.image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = format;
+    viewInfo.subresourceRange.aspectMask = aspect;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    if (vkCreateImageView(device_.device(), &viewInfo, nullptr, &attachment.view) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create offscreen image view!");
+    }
+    return attachment;
+}
+
+void OffscreenTarget::destroyAttachment(Attachment &attachment)
+{
+    vkDestroyImageView(device_.device(), attachment.view, nullptr);
+    vkDestroyImage(device_.device(), attachment.image, nullptr);
+    vkFreeMemory(device_.device(), attachment.memory, nullptr);
+    attachment = Attachment{};
+}
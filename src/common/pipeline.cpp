@@ -132,14 +132,20 @@ void Pipeline::createGraphicsPipeline(const std::string &vertFilepath,
 {
     assert(configInfo.pipelineLayout != VK_NULL_HANDLE &&
            "Cannot create graphics pipeline: no pipelineLayout provided in configInfo");
-    assert(configInfo.renderPass != VK_NULL_HANDLE &&
-           "Cannot create graphics pipeline: no renderPass provided in configInfo");
+    assert((configInfo.renderTarget.renderPass != VK_NULL_HANDLE ||
+            configInfo.renderTarget.colorFormat != VK_FORMAT_UNDEFINED) &&
+           "Cannot create graphics pipeline: no render target provided in configInfo");
 
     const auto vertCode = readFile(vertFilepath);
-    const auto fragCode = readFile(fragFilepath);
-
     createShaderModule(vertCode, &vertexShaderModule_);
-    createShaderModule(fragCode, &fragmentShaderModule_);
+
+    // Pipelines without a fragment shader, such as depth-only ones, leave fragmentShaderModule_ null
+    const bool hasFragmentShader = !fragFilepath.empty();
+    if (hasFragmentShader)
+    {
+        const auto fragCode = readFile(fragFilepath);
+        createShaderModule(fragCode, &fragmentShaderModule_);
+    }
 
     VkPipelineShaderStageCreateInfo shaderStages[2];
     shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -170,7 +176,7 @@ void Pipeline::createGraphicsPipeline(const std::string &vertFilepath,
 
     VkGraphicsPipelineCreateInfo pipelineInfo{};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;
+    pipelineInfo.stageCount = hasFragmentShader ? 2 : 1;
     pipelineInfo.pStages = shaderStages;
     pipelineInfo.pVertexInputState = &vertexInputInfo;
     pipelineInfo.pInputAssemblyState = &configInfo.inputAssemblyInfo;
@@ -182,9 +188,21 @@ void Pipeline::createGraphicsPipeline(const std::string &vertFilepath,
     pipelineInfo.pDynamicState = &configInfo.dynamicStateInfo;
 
     pipelineInfo.layout = configInfo.pipelineLayout;
-    pipelineInfo.renderPass = configInfo.renderPass;
+    pipelineInfo.renderPass = configInfo.renderTarget.renderPass;
     pipelineInfo.subpass = configInfo.subpass;
 
+    // Without a render pass the attachment formats are taken from the chained rendering info
+    VkPipelineRenderingCreateInfo renderingInfo{};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachmentFormats = &configInfo.renderTarget.colorFormat;
+    renderingInfo.depthAttachmentFormat = configInfo.renderTarget.depthFormat;
+    renderingInfo.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+    if (configInfo.renderTarget.renderPass == VK_NULL_HANDLE)
+    {
+        pipelineInfo.pNext = &renderingInfo;
+    }
+
     pipelineInfo.basePipelineIndex = -1;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
@@ -230,3 +248,46 @@ Pipeline::~Pipeline()
     vkDestroyShaderModule(device_.device(), fragmentShaderModule_, nullptr);
     vkDestroyPipeline(device_.device(), graphicsPipeline_, nullptr);
 }
+
+ComputePipeline::ComputePipeline(Device &device, const std::string &compFilepath, VkPipelineLayout pipelineLayout)
+  : device_{device}
+{
+    assert(pipelineLayout != VK_NULL_HANDLE && "Cannot create compute pipeline: no pipelineLayout provided");
+
+    const auto code = readFile(compFilepath);
+
+    VkShaderModuleCreateInfo moduleInfo{};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = code.size();
+    moduleInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+    if (vkCreateShaderModule(device_.device(), &moduleInfo, nullptr, &computeShaderModule_) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create shader module");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = computeShaderModule_;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipelineLayout;
+    pipelineInfo.basePipelineIndex = -1;
+
+    if (vkCreateComputePipelines(device_.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &computePipeline_) !=
+        VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create compute pipeline");
+    }
+}
+
+ComputePipeline::~ComputePipeline()
+{
+    vkDestroyShaderModule(device_.device(), computeShaderModule_, nullptr);
+    vkDestroyPipeline(device_.device(), computePipeline_, nullptr);
+}
+
+void ComputePipeline::bind(VkCommandBuffer commandBuffer)
+{
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline_);
+}
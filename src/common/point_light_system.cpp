@@ -9,21 +9,22 @@
 // std
 #include <array>
 #include <cassert>
-#include <map>
 #include <stdexcept>
 
+// The position and color change every frame, the shaders read them from the ubo's pointLights[lightIndex]
 struct PointLightPushConstants
 {
-    glm::vec4 position{};
-    glm::vec4 color{};
+    int lightIndex;
     float radius;
 };
 
-PointLightSystem::PointLightSystem(Device &device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout)
+PointLightSystem::PointLightSystem(Device &device,
+                                   const RenderTargetInfo &renderTarget,
+                                   VkDescriptorSetLayout globalSetLayout)
   : device_{device}
 {
     createPipelineLayout(globalSetLayout);
-    createPipeline(renderPass);
+    createPipeline(renderTarget);
 }
 
 PointLightSystem::~PointLightSystem()
@@ -65,10 +66,11 @@ void PointLightSystem::update(FrameInfo &frameInfo, GlobalUbo &ubo)
         assert(lightIndex < MAX_LIGHTS && "Point lights exceed maximum specified");
 
         // update light position
-        obj.transform.translation = glm::vec3(rotateLight * glm::vec4(obj.transform.translation, 1.f));
+        const glm::vec3 translation{rotateLight * glm::vec4(obj.transform.getTranslation(), 1.f)};
+        obj.transform.setTranslation(translation);
 
         // copy light to ubo
-        ubo.pointLights[lightIndex].position = glm::vec4(obj.transform.translation, 1.f);
+        ubo.pointLights[lightIndex].position = glm::vec4(translation, 1.f);
         ubo.pointLights[lightIndex].color = glm::vec4(obj.color, obj.pointLight->lightIntensity);
 
         lightIndex += 1;
@@ -76,7 +78,7 @@ void PointLightSystem::update(FrameInfo &frameInfo, GlobalUbo &ubo)
     ubo.numLights = lightIndex;
 }
 
-void PointLightSystem::createPipeline(VkRenderPass renderPass)
+void PointLightSystem::createPipeline(const RenderTargetInfo &renderTarget)
 {
     assert(pipelineLayout_ != nullptr && "Cannot create pipeline before pipeline layout");
 
@@ -85,55 +87,36 @@ void PointLightSystem::createPipeline(VkRenderPass renderPass)
     Pipeline::enableAlphaBlending(pipelineConfig);
     pipelineConfig.attributeDescriptions.clear();
     pipelineConfig.bindingDescriptions.clear();
-    pipelineConfig.renderPass = renderPass;
+    pipelineConfig.renderTarget = renderTarget;
     pipelineConfig.pipelineLayout = pipelineLayout_;
     pipeline_ = std::make_unique<Pipeline>(device_, "point_light.vert.spv", "point_light.frag.spv", pipelineConfig);
 }
 
-void PointLightSystem::render(FrameInfo &frameInfo)
+// Lights are blended, the render queue draws them back to front after the opaque objects. Each light is drawn
+// with the index update() gave it, both visit the lights in the same order.
+void PointLightSystem::submit(FrameInfo &frameInfo, RenderQueue &renderQueue)
 {
-    // sort lights
-    std::map<float, GameObject::id_t> sorted;
+    int lightIndex = 0;
     for (auto &kv : frameInfo.gameObjects)
     {
         auto &obj = kv.second;
         if (obj.pointLight == nullptr)
             continue;
 
-        // calculate distance
-        auto offset = frameInfo.camera.getPosition() - obj.transform.translation;
-        float disSquared = glm::dot(offset, offset);
-        sorted[disSquared] = obj.getId();
-    }
-
-    pipeline_->bind(frameInfo.commandBuffer);
-
-    vkCmdBindDescriptorSets(frameInfo.commandBuffer,
-                            VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            pipelineLayout_,
-                            0,
-                            1,
-                            &frameInfo.globalDescriptorSet,
-                            0,
-                            nullptr);
-
-    // iterate through sorted lights in reverse order
-    for (auto it = sorted.rbegin(); it != sorted.rend(); ++it)
-    {
-        // use game obj id to find light object
-        auto &obj = frameInfo.gameObjects.at(it->second);
-
         PointLightPushConstants push{};
-        push.position = glm::vec4(obj.transform.translation, 1.f);
-        push.color = glm::vec4(obj.color, obj.pointLight->lightIntensity);
-        push.radius = obj.transform.scale.x;
-
-        vkCmdPushConstants(frameInfo.commandBuffer,
-                           pipelineLayout_,
-                           VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-                           0,
-                           sizeof(PointLightPushConstants),
-                           &push);
-        vkCmdDraw(frameInfo.commandBuffer, 6, 1, 0, 0);
+        push.lightIndex = lightIndex++;
+        push.radius = obj.transform.getScale().x;
+
+        auto offset = frameInfo.camera.getPosition() - obj.transform.getTranslation();
+
+        DrawPacket packet{};
+        packet.phase = RenderPhase::Transparent;
+        packet.depth = glm::dot(offset, offset);
+        packet.pipeline = pipeline_.get();
+        packet.pipelineLayout = pipelineLayout_;
+        packet.descriptorSet = frameInfo.globalDescriptorSet;
+        packet.vertexCount = 6;
+        packet.setPushConstants(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, push);
+        renderQueue.submit(packet);
     }
 }
@@ -0,0 +1,1044 @@
+#include "render_graph.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+constexpr VkAccessFlags WRITE_ACCESS = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                       VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT |
+                                       VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT |
+                                       VK_ACCESS_MEMORY_WRITE_BIT;
+
+// What the graph knows about an image while walking the passes in order
+struct TrackedState
+{
+    VkImageLayout layout;
+    // Last write, or layout transition, and the accesses it has to make available
+    VkPipelineStageFlags writeStages;
+    VkAccessFlags writeAccess;
+    // Stages that already waited for the last write
+    VkPipelineStageFlags syncedStages;
+    // Stages that read the image since the last write, later writes have to wait for them
+    VkPipelineStageFlags readStages;
+};
+
+bool isAttachment(ImageUsage usage)
+{
+    return usage == ImageUsage::ColorAttachment || usage == ImageUsage::DepthAttachment ||
+           usage == ImageUsage::DepthReadOnly;
+}
+
+bool writesImage(ImageUsage usage)
+{
+    return usage == ImageUsage::ColorAttachment || usage == ImageUsage::DepthAttachment ||
+           usage == ImageUsage::StorageWrite || usage == ImageUsage::TransferDst;
+}
+
+// Storage writes may leave parts of the image as they were, so they depend on the previous contents too,
+// unless the pass declared it overwrites all of them
+bool readsImage(ImageUsage usage, VkAttachmentLoadOp loadOp)
+{
+    if (usage == ImageUsage::ColorAttachment || usage == ImageUsage::DepthAttachment ||
+        usage == ImageUsage::StorageWrite)
+    {
+        return loadOp == VK_ATTACHMENT_LOAD_OP_LOAD;
+    }
+    return usage != ImageUsage::TransferDst;
+}
+
+ImageState usageState(ImageUsage usage, RenderGraph::PassType type)
+{
+    const VkPipelineStageFlags shaderStages = type == RenderGraph::PassType::Compute
+                                                ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+                                                : VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                                                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    const VkPipelineStageFlags depthStages =
+      VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+
+    switch (usage)
+    {
+    case ImageUsage::ColorAttachment:
+        return {VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT};
+    case ImageUsage::DepthAttachment:
+        return {VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                depthStages,
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT};
+    case ImageUsage::DepthReadOnly:
+        return {VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+                depthStages,
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT};
+    case ImageUsage::Sampled:
+        return {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, shaderStages, VK_ACCESS_SHADER_READ_BIT};
+    case ImageUsage::StorageRead:
+        return {VK_IMAGE_LAYOUT_GENERAL, shaderStages, VK_ACCESS_SHADER_READ_BIT};
+    case ImageUsage::StorageWrite:
+        return {VK_IMAGE_LAYOUT_GENERAL, shaderStages, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT};
+    case ImageUsage::TransferSrc:
+        return {VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT};
+    case ImageUsage::TransferDst:
+        return {VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT};
+    }
+    return {};
+}
+
+VkImageUsageFlags imageUsageFlags(ImageUsage usage)
+{
+    switch (usage)
+    {
+    case ImageUsage::ColorAttachment:
+        return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    case ImageUsage::DepthAttachment:
+    case ImageUsage::DepthReadOnly:
+        return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    case ImageUsage::Sampled:
+        return VK_IMAGE_USAGE_SAMPLED_BIT;
+    case ImageUsage::StorageRead:
+    case ImageUsage::StorageWrite:
+        return VK_IMAGE_USAGE_STORAGE_BIT;
+    case ImageUsage::TransferSrc:
+        return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    case ImageUsage::TransferDst:
+        return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+    return 0;
+}
+
+VkImageAspectFlags aspectMask(VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_X8_D24_UNORM_PACK32:
+    case VK_FORMAT_D32_SFLOAT:
+        return VK_IMAGE_ASPECT_DEPTH_BIT;
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+        return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    case VK_FORMAT_S8_UINT:
+        return VK_IMAGE_ASPECT_STENCIL_BIT;
+    default:
+        return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
+
+/**
+ * Moves an image into the state a use wants, adding the barrier that takes if any. Reads in the layout the
+ * image is already in only wait for the last write, and only once per stage. Writes and layout transitions
+ * wait for the last write and all reads since.
+ */
+void trackUse(TrackedState &state, const ImageState &wanted, bool write, std::vector<ImageState> &barrierBefore)
+{
+    const bool transition = state.layout != wanted.layout;
+    if (!transition && !write)
+    {
+        if (state.writeStages != 0 && (wanted.stages & ~state.syncedStages) != 0)
+        {
+            barrierBefore.push_back({state.layout, state.writeStages, state.writeAccess});
+            state.syncedStages |= wanted.stages;
+        }
+        state.readStages |= wanted.stages;
+        return;
+    }
+
+    const VkPipelineStageFlags waitStages = state.writeStages | state.readStages;
+    if (transition || waitStages != 0)
+    {
+        barrierBefore.push_back({state.layout, waitStages, state.writeAccess});
+    }
+    state.layout = wanted.layout;
+    state.writeStages = wanted.stages;
+    state.writeAccess = write ? wanted.access & WRITE_ACCESS : 0;
+    state.syncedStages = wanted.stages;
+    state.readStages = write ? 0 : wanted.stages;
+}
+
+// Imported images last used by reads can be read on without a barrier
+TrackedState importedState(const ImageState &initialState)
+{
+    if ((initialState.access & WRITE_ACCESS) != 0)
+    {
+        return {initialState.layout, initialState.stages, initialState.access & WRITE_ACCESS, 0, 0};
+    }
+    return {initialState.layout, 0, 0, 0, initialState.stages};
+}
+
+const char *layoutName(VkImageLayout layout)
+{
+    switch (layout)
+    {
+    case VK_IMAGE_LAYOUT_UNDEFINED:
+        return "UNDEFINED";
+    case VK_IMAGE_LAYOUT_GENERAL:
+        return "GENERAL";
+    case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+        return "COLOR_ATTACHMENT_OPTIMAL";
+    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+        return "DEPTH_STENCIL_ATTACHMENT_OPTIMAL";
+    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+        return "DEPTH_STENCIL_READ_ONLY_OPTIMAL";
+    case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+        return "SHADER_READ_ONLY_OPTIMAL";
+    case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+        return "TRANSFER_SRC_OPTIMAL";
+    case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+        return "TRANSFER_DST_OPTIMAL";
+    case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+        return "PRESENT_SRC_KHR";
+    default:
+        return "OTHER";
+    }
+}
+
+const char *usageName(ImageUsage usage)
+{
+    switch (usage)
+    {
+    case ImageUsage::ColorAttachment:
+        return "color attachment";
+    case ImageUsage::DepthAttachment:
+        return "depth attachment";
+    case ImageUsage::DepthReadOnly:
+        return "read-only depth attachment";
+    case ImageUsage::Sampled:
+        return "sampled";
+    case ImageUsage::StorageRead:
+        return "storage read";
+    case ImageUsage::StorageWrite:
+        return "storage write";
+    case ImageUsage::TransferSrc:
+        return "copy source";
+    case ImageUsage::TransferDst:
+        return "copy destination";
+    }
+    return "unknown";
+}
+
+const char *passTypeName(RenderGraph::PassType type)
+{
+    switch (type)
+    {
+    case RenderGraph::PassType::Graphics:
+        return "graphics";
+    case RenderGraph::PassType::Compute:
+        return "compute";
+    case RenderGraph::PassType::Transfer:
+        return "transfer";
+    }
+    return "unknown";
+}
+
+std::string formatBytes(VkDeviceSize bytes)
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << static_cast<double>(bytes) / (1024.0 * 1024.0) << " MiB";
+    return out.str();
+}
+} // namespace
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::writeColor(ResourceId image,
+                                                                VkAttachmentLoadOp loadOp,
+                                                                VkClearColorValue clear)
+{
+    VkClearValue clearValue{};
+    clearValue.color = clear;
+    return use(image, ImageUsage::ColorAttachment, loadOp, clearValue);
+}
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::writeDepth(ResourceId image,
+                                                                VkAttachmentLoadOp loadOp,
+                                                                VkClearDepthStencilValue clear)
+{
+    VkClearValue clearValue{};
+    clearValue.depthStencil = clear;
+    return use(image, ImageUsage::DepthAttachment, loadOp, clearValue);
+}
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::readDepth(ResourceId image)
+{
+    return use(image, ImageUsage::DepthReadOnly, VK_ATTACHMENT_LOAD_OP_LOAD, {});
+}
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::sample(ResourceId image)
+{
+    return use(image, ImageUsage::Sampled, VK_ATTACHMENT_LOAD_OP_LOAD, {});
+}
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::readStorage(ResourceId image)
+{
+    return use(image, ImageUsage::StorageRead, VK_ATTACHMENT_LOAD_OP_LOAD, {});
+}
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::writeStorage(ResourceId image, VkAttachmentLoadOp loadOp)
+{
+    return use(image, ImageUsage::StorageWrite, loadOp, {});
+}
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::copyFrom(ResourceId image)
+{
+    return use(image, ImageUsage::TransferSrc, VK_ATTACHMENT_LOAD_OP_LOAD, {});
+}
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::copyTo(ResourceId image)
+{
+    return use(image, ImageUsage::TransferDst, VK_ATTACHMENT_LOAD_OP_DONT_CARE, {});
+}
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::sideEffect()
+{
+    graph_.passes_[pass_].sideEffect = true;
+    return *this;
+}
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::use(ResourceId image,
+                                                         ImageUsage usage,
+                                                         VkAttachmentLoadOp loadOp,
+                                                         VkClearValue clear)
+{
+    assert(image < graph_.resources_.size() && "Unknown render graph resource");
+    auto &pass = graph_.passes_[pass_];
+    assert((!isAttachment(usage) || pass.type == PassType::Graphics) && "Only graphics passes have attachments");
+    assert(std::none_of(pass.uses.begin(), pass.uses.end(), [&](const Use &u) { return u.image == image; }) &&
+           "Pass uses an image twice");
+    pass.uses.push_back({image, usage, loadOp, clear});
+    return *this;
+}
+
+RenderGraph::RenderGraph(Device &device) : device_{device}
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+    for (auto &pass : passes_)
+    {
+        for (auto &[views, framebuffer] : pass.framebuffers)
+        {
+            vkDestroyFramebuffer(device_.device(), framebuffer, nullptr);
+        }
+        if (pass.renderPass != VK_NULL_HANDLE)
+        {
+            vkDestroyRenderPass(device_.device(), pass.renderPass, nullptr);
+        }
+    }
+    for (auto &resource : resources_)
+    {
+        if (!resource.imported && resource.image != VK_NULL_HANDLE)
+        {
+            vkDestroyImageView(device_.device(), resource.view, nullptr);
+            vkDestroyImage(device_.device(), resource.image, nullptr);
+        }
+    }
+    for (auto &slot : slots_)
+    {
+        vkFreeMemory(device_.device(), slot.memory, nullptr);
+    }
+}
+
+/**
+ * Declares an image the graph creates and owns. Its usage flags follow from the passes that use it, and it
+ * only exists if a pass that was not culled uses it.
+ */
+RenderGraph::ResourceId RenderGraph::createImage(const std::string &name, const ImageInfo &info)
+{
+    assert(!compiled_ && "Can't add to a compiled render graph");
+    Resource resource{};
+    resource.name = name;
+    resource.info = info;
+    resource.aspect = aspectMask(info.format);
+    resources_.push_back(resource);
+    return static_cast<ResourceId>(resources_.size() - 1);
+}
+
+/**
+ * Declares an image owned by someone else, see setImportedImage()
+ *
+ * @param initialState Layout the image is in when the graph is executed, and the stages and accesses that
+ * last used it
+ * @param finalState Layout the image is left in and the stages and accesses that use it next, or
+ * VK_IMAGE_LAYOUT_UNDEFINED if its contents are not needed after the graph
+ */
+RenderGraph::ResourceId RenderGraph::importImage(const std::string &name,
+                                                 const ImageInfo &info,
+                                                 const ImageState &initialState,
+                                                 const ImageState &finalState)
+{
+    const ResourceId id = createImage(name, info);
+    auto &resource = resources_[id];
+    resource.imported = true;
+    resource.initialState = initialState;
+    resource.finalState = finalState;
+    resource.output = finalState.layout != VK_IMAGE_LAYOUT_UNDEFINED;
+    return id;
+}
+
+// Sets the image an imported resource refers to in the next execute()
+void RenderGraph::setImportedImage(ResourceId image, VkImage handle, VkImageView view)
+{
+    assert(resources_[image].imported && "Only imported images can be set");
+    resources_[image].image = handle;
+    resources_[image].view = view;
+}
+
+/**
+ * Adds a pass, which runs in the order passes were added in
+ *
+ * @param setup Declares the images the pass uses, called right away
+ * @param execute Records the pass' commands. Graphics passes are recorded inside of rendering that covers
+ * their attachments, with viewport and scissor set to it.
+ */
+void RenderGraph::addPass(const std::string &name,
+                          PassType type,
+                          const std::function<void(PassBuilder &)> &setup,
+                          Execute execute)
+{
+    assert(!compiled_ && "Can't add to a compiled render graph");
+    Pass pass{};
+    pass.name = name;
+    pass.type = type;
+    pass.execute = std::move(execute);
+    passes_.push_back(std::move(pass));
+
+    PassBuilder builder{*this, static_cast<uint32_t>(passes_.size() - 1)};
+    setup(builder);
+}
+
+// The final contents of an output are needed after the graph, which keeps the passes writing them
+void RenderGraph::markOutput(ResourceId image)
+{
+    resources_[image].output = true;
+}
+
+void RenderGraph::compile()
+{
+    assert(!compiled_ && "Render graph is already compiled");
+    stats_ = {};
+    stats_.passes = static_cast<uint32_t>(passes_.size());
+
+    cullPasses();
+    computeLifetimes();
+    createTransientImages();
+    computeBarriers();
+    if (!device_.dynamicRenderingEnabled())
+    {
+        createRenderPasses();
+    }
+    compiled_ = true;
+}
+
+// Keeps the passes that write an output's final contents or have side effects, and the passes those read from
+void RenderGraph::cullPasses()
+{
+    std::vector<int> writer(resources_.size(), -1);
+    std::vector<std::vector<uint32_t>> dependencies(passes_.size());
+    for (uint32_t p = 0; p < passes_.size(); p++)
+    {
+        for (const auto &use : passes_[p].uses)
+        {
+            if (readsImage(use.usage, use.loadOp) && writer[use.image] >= 0)
+            {
+                dependencies[p].push_back(static_cast<uint32_t>(writer[use.image]));
+            }
+        }
+        for (const auto &use : passes_[p].uses)
+        {
+            if (writesImage(use.usage))
+            {
+                writer[use.image] = static_cast<int>(p);
+            }
+        }
+    }
+
+    std::vector<uint32_t> pending;
+    for (uint32_t r = 0; r < resources_.size(); r++)
+    {
+        if (resources_[r].output && writer[r] >= 0)
+        {
+            pending.push_back(static_cast<uint32_t>(writer[r]));
+        }
+    }
+    for (uint32_t p = 0; p < passes_.size(); p++)
+    {
+        if (passes_[p].sideEffect)
+        {
+            pending.push_back(p);
+        }
+    }
+
+    std::vector<bool> live(passes_.size(), false);
+    while (!pending.empty())
+    {
+        const uint32_t p = pending.back();
+        pending.pop_back();
+        if (live[p])
+        {
+            continue;
+        }
+        live[p] = true;
+        pending.insert(pending.end(), dependencies[p].begin(), dependencies[p].end());
+    }
+
+    for (uint32_t p = 0; p < passes_.size(); p++)
+    {
+        passes_[p].culled = !live[p];
+        stats_.culledPasses += passes_[p].culled ? 1 : 0;
+    }
+}
+
+void RenderGraph::computeLifetimes()
+{
+    for (uint32_t p = 0; p < passes_.size(); p++)
+    {
+        auto &pass = passes_[p];
+        if (pass.culled)
+        {
+            continue;
+        }
+        for (const auto &use : pass.uses)
+        {
+            auto &resource = resources_[use.image];
+            if (!resource.used)
+            {
+                resource.used = true;
+                resource.firstPass = p;
+            }
+            resource.lastPass = p;
+            resource.usage |= imageUsageFlags(use.usage);
+
+            if (isAttachment(use.usage))
+            {
+                if (pass.extent.width == 0)
+                {
+                    pass.extent = resource.info.extent;
+                }
+                else if (pass.extent.width != resource.info.extent.width ||
+                         pass.extent.height != resource.info.extent.height)
+                {
+                    throw std::runtime_error("attachments of render graph pass " + pass.name + " differ in size!");
+                }
+            }
+        }
+    }
+
+    // Attachment contents nobody uses anymore don't have to be written back to memory
+    for (uint32_t p = 0; p < passes_.size(); p++)
+    {
+        for (auto &use : passes_[p].uses)
+        {
+            const auto &resource = resources_[use.image];
+            const bool needed = resource.imported || resource.output || p < resource.lastPass;
+            use.storeOp = needed ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        }
+    }
+}
+
+/**
+ * Creates the transient images and places them in memory slots, largest first. An image joins the first
+ * slot whose images are all used strictly before or after it, so images with disjoint lifetimes share memory.
+ */
+void RenderGraph::createTransientImages()
+{
+    std::vector<ResourceId> transients;
+    for (ResourceId r = 0; r < resources_.size(); r++)
+    {
+        if (!resources_[r].imported && resources_[r].used)
+        {
+            createTransientImage(resources_[r]);
+            stats_.transientBytes += resources_[r].memoryRequirements.size;
+            transients.push_back(r);
+        }
+    }
+    std::stable_sort(transients.begin(), transients.end(), [&](ResourceId a, ResourceId b) {
+        return resources_[a].memoryRequirements.size > resources_[b].memoryRequirements.size;
+    });
+
+    for (ResourceId r : transients)
+    {
+        auto &resource = resources_[r];
+        auto fits = [&](const MemorySlot &slot) {
+            if ((slot.memoryTypeBits & resource.memoryRequirements.memoryTypeBits) == 0)
+            {
+                return false;
+            }
+            return std::all_of(slot.images.begin(), slot.images.end(), [&](ResourceId other) {
+                return resources_[other].lastPass < resource.firstPass ||
+                       resource.lastPass < resources_[other].firstPass;
+            });
+        };
+        auto slot = std::find_if(slots_.begin(), slots_.end(), fits);
+        if (slot == slots_.end())
+        {
+            slot = slots_.insert(slots_.end(), MemorySlot{});
+        }
+        slot->images.push_back(r);
+        slot->size = std::max(slot->size, resource.memoryRequirements.size);
+        slot->memoryTypeBits &= resource.memoryRequirements.memoryTypeBits;
+        resource.slot = static_cast<int>(slot - slots_.begin());
+    }
+
+    for (auto &slot : slots_)
+    {
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = slot.size;
+        allocInfo.memoryTypeIndex = device_.findMemoryType(slot.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        if (vkAllocateMemory(device_.device(), &allocInfo, nullptr, &slot.memory) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate render graph memory!");
+        }
+        stats_.allocatedBytes += slot.size;
+
+        // Later images in a slot are used later in the frame
+        std::sort(slot.images.begin(), slot.images.end(), [&](ResourceId a, ResourceId b) {
+            return resources_[a].firstPass < resources_[b].firstPass;
+        });
+        for (ResourceId r : slot.images)
+        {
+            auto &resource = resources_[r];
+            if (vkBindImageMemory(device_.device(), resource.image, slot.memory, 0) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to bind render graph image memory!");
+            }
+
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = resource.image;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = resource.info.format;
+            viewInfo.subresourceRange.aspectMask = resource.aspect;
+            viewInfo.subresourceRange.levelCount = resource.info.mipLevels;
+            viewInfo.subresourceRange.layerCount = 1;
+            if (vkCreateImageView(device_.device(), &viewInfo, nullptr, &resource.view) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create render graph image view!");
+            }
+        }
+    }
+    stats_.transientImages = static_cast<uint32_t>(transients.size());
+    stats_.memorySlots = static_cast<uint32_t>(slots_.size());
+}
+
+void RenderGraph::createTransientImage(Resource &resource)
+{
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = resource.info.format;
+    imageInfo.extent = {resource.info.extent.width, resource.info.extent.height, 1};
+    imageInfo.mipLevels = resource.info.mipLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = resource.usage;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if (vkCreateImage(device_.device(), &imageInfo, nullptr, &resource.image) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create render graph image!");
+    }
+    vkGetImageMemoryRequirements(device_.device(), resource.image, &resource.memoryRequirements);
+}
+
+/**
+ * Walks the passes that were not culled in order and records the barrier each use of an image needs.
+ * Transient images start out UNDEFINED, but their memory was last used by the image before them in their
+ * slot, or by the slot's last image in the previous frame, which their first barrier has to wait for.
+ */
+void RenderGraph::computeBarriers()
+{
+    std::vector<TrackedState> states(resources_.size());
+    for (ResourceId r = 0; r < resources_.size(); r++)
+    {
+        states[r] = resources_[r].imported ? importedState(resources_[r].initialState)
+                                           : TrackedState{VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, 0, 0};
+    }
+
+    // Pass and barrier index of each transient's first barrier, its wait is filled in once all are known
+    std::vector<std::pair<uint32_t, size_t>> firstBarriers(resources_.size(), {~0u, 0});
+    for (uint32_t p = 0; p < passes_.size(); p++)
+    {
+        auto &pass = passes_[p];
+        if (pass.culled)
+        {
+            continue;
+        }
+        for (const auto &use : pass.uses)
+        {
+            const auto &resource = resources_[use.image];
+            if (!resource.imported && p == resource.firstPass && readsImage(use.usage, use.loadOp))
+            {
+                throw std::runtime_error("render graph pass " + pass.name + " reads " + resource.name +
+                                         " before anything writes it!");
+            }
+
+            std::vector<ImageState> before;
+            const ImageState wanted = usageState(use.usage, pass.type);
+            trackUse(states[use.image], wanted, writesImage(use.usage), before);
+            if (!before.empty())
+            {
+                if (!resource.imported && p == resource.firstPass)
+                {
+                    firstBarriers[use.image] = {p, pass.barriers.size()};
+                }
+                pass.barriers.push_back({use.image, before[0], wanted});
+                stats_.imageBarriers++;
+            }
+        }
+    }
+
+    for (const auto &slot : slots_)
+    {
+        for (size_t i = 0; i < slot.images.size(); i++)
+        {
+            const ResourceId image = slot.images[i];
+            const ResourceId previous = slot.images[(i + slot.images.size() - 1) % slot.images.size()];
+            const auto [pass, barrier] = firstBarriers[image];
+            if (pass == ~0u)
+            {
+                continue;
+            }
+            auto &before = passes_[pass].barriers[barrier].before;
+            before.stages = states[previous].writeStages | states[previous].readStages;
+            before.access = states[previous].writeAccess;
+        }
+    }
+
+    for (ResourceId r = 0; r < resources_.size(); r++)
+    {
+        const auto &resource = resources_[r];
+        if (!resource.imported || resource.finalState.layout == VK_IMAGE_LAYOUT_UNDEFINED)
+        {
+            continue;
+        }
+        std::vector<ImageState> before;
+        trackUse(states[r], resource.finalState, false, before);
+        if (!before.empty())
+        {
+            finalBarriers_.push_back({r, before[0], resource.finalState});
+            stats_.imageBarriers++;
+        }
+    }
+}
+
+// Without dynamic rendering each graphics pass gets a render pass. The graph's barriers already move the
+// attachments into their layouts, so the render passes don't transition them.
+void RenderGraph::createRenderPasses()
+{
+    for (auto &pass : passes_)
+    {
+        if (pass.culled || pass.type != PassType::Graphics)
+        {
+            continue;
+        }
+
+        std::vector<VkAttachmentDescription> attachments;
+        std::vector<VkAttachmentReference> colorReferences;
+        VkAttachmentReference depthReference{};
+        bool hasDepth = false;
+        for (const auto &use : pass.uses)
+        {
+            if (!isAttachment(use.usage))
+            {
+                continue;
+            }
+            const VkImageLayout layout = usageState(use.usage, pass.type).layout;
+            VkAttachmentDescription attachment{};
+            attachment.format = resources_[use.image].info.format;
+            attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+            attachment.loadOp = use.loadOp;
+            attachment.storeOp = use.storeOp;
+            attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            attachment.initialLayout = layout;
+            attachment.finalLayout = layout;
+
+            const VkAttachmentReference reference{static_cast<uint32_t>(attachments.size()), layout};
+            if (use.usage == ImageUsage::ColorAttachment)
+            {
+                colorReferences.push_back(reference);
+            }
+            else
+            {
+                depthReference = reference;
+                hasDepth = true;
+            }
+            attachments.push_back(attachment);
+        }
+
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = static_cast<uint32_t>(colorReferences.size());
+        subpass.pColorAttachments = colorReferences.data();
+        subpass.pDepthStencilAttachment = hasDepth ? &depthReference : nullptr;
+
+        VkRenderPassCreateInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        renderPassInfo.pAttachments = attachments.data();
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        if (vkCreateRenderPass(device_.device(), &renderPassInfo, nullptr, &pass.renderPass) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create render graph render pass!");
+        }
+    }
+}
+
+/**
+ * Records the passes that were not culled, each with its barriers in one pipeline barrier and in a
+ * profiler scope of its name, and moves the imported images into their final states
+ *
+ * @param commandBuffer Command buffer of the current frame, outside of a render pass
+ * @param profiler Optional, measures each pass
+ */
+void RenderGraph::execute(VkCommandBuffer commandBuffer, GpuProfiler *profiler)
+{
+    assert(compiled_ && "Render graph must be compiled before it is executed");
+
+    for (auto &pass : passes_)
+    {
+        if (pass.culled)
+        {
+            continue;
+        }
+        assert(std::all_of(pass.uses.begin(),
+                           pass.uses.end(),
+                           [&](const Use &use) { return resources_[use.image].image != VK_NULL_HANDLE; }) &&
+               "Imported image was not set");
+
+        GpuProfiler::Scope profilerScope{profiler, commandBuffer, pass.name.c_str()};
+        recordBarriers(commandBuffer, pass.barriers);
+        if (pass.type == PassType::Graphics)
+        {
+            beginRendering(commandBuffer, pass);
+        }
+        pass.execute(commandBuffer);
+        if (pass.type == PassType::Graphics)
+        {
+            endRendering(commandBuffer, pass);
+        }
+    }
+    recordBarriers(commandBuffer, finalBarriers_);
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier> &barriers) const
+{
+    if (barriers.empty())
+    {
+        return;
+    }
+
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+    for (const auto &barrier : barriers)
+    {
+        const auto &resource = resources_[barrier.image];
+        VkImageMemoryBarrier imageBarrier{};
+        imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageBarrier.srcAccessMask = barrier.before.access;
+        imageBarrier.dstAccessMask = barrier.after.access;
+        imageBarrier.oldLayout = barrier.before.layout;
+        imageBarrier.newLayout = barrier.after.layout;
+        imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.image = resource.image;
+        imageBarrier.subresourceRange.aspectMask = resource.aspect;
+        imageBarrier.subresourceRange.levelCount = resource.info.mipLevels;
+        imageBarrier.subresourceRange.layerCount = 1;
+        imageBarriers.push_back(imageBarrier);
+
+        srcStages |= barrier.before.stages;
+        dstStages |= barrier.after.stages;
+    }
+
+    vkCmdPipelineBarrier(commandBuffer,
+                         srcStages != 0 ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         dstStages != 0 ? dstStages : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0,
+                         0,
+                         nullptr,
+                         0,
+                         nullptr,
+                         static_cast<uint32_t>(imageBarriers.size()),
+                         imageBarriers.data());
+}
+
+void RenderGraph::beginRendering(VkCommandBuffer commandBuffer, Pass &pass)
+{
+    const VkRect2D renderArea{{0, 0}, pass.extent};
+
+    if (device_.dynamicRenderingEnabled())
+    {
+        std::vector<VkRenderingAttachmentInfo> colorAttachments;
+        VkRenderingAttachmentInfo depthAttachment{};
+        bool hasDepth = false;
+        for (const auto &use : pass.uses)
+        {
+            if (!isAttachment(use.usage))
+            {
+                continue;
+            }
+            VkRenderingAttachmentInfo attachment{};
+            attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+            attachment.imageView = resources_[use.image].view;
+            attachment.imageLayout = usageState(use.usage, pass.type).layout;
+            attachment.loadOp = use.loadOp;
+            attachment.storeOp = use.storeOp;
+            attachment.clearValue = use.clear;
+            if (use.usage == ImageUsage::ColorAttachment)
+            {
+                colorAttachments.push_back(attachment);
+            }
+            else
+            {
+                depthAttachment = attachment;
+                hasDepth = true;
+            }
+        }
+
+        VkRenderingInfo renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+        renderingInfo.renderArea = renderArea;
+        renderingInfo.layerCount = 1;
+        renderingInfo.colorAttachmentCount = static_cast<uint32_t>(colorAttachments.size());
+        renderingInfo.pColorAttachments = colorAttachments.data();
+        renderingInfo.pDepthAttachment = hasDepth ? &depthAttachment : nullptr;
+        device_.cmdBeginRendering(commandBuffer, renderingInfo);
+    }
+    else
+    {
+        // Same order as the render pass' attachments
+        std::vector<VkImageView> views;
+        std::vector<VkClearValue> clearValues;
+        for (const auto &use : pass.uses)
+        {
+            if (isAttachment(use.usage))
+            {
+                views.push_back(resources_[use.image].view);
+                clearValues.push_back(use.clear);
+            }
+        }
+
+        // Imported images may be different ones every frame, such as the swap chain's
+        auto framebuffer = pass.framebuffers.find(views);
+        if (framebuffer == pass.framebuffers.end())
+        {
+            VkFramebufferCreateInfo framebufferInfo{};
+            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebufferInfo.renderPass = pass.renderPass;
+            framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+            framebufferInfo.pAttachments = views.data();
+            framebufferInfo.width = pass.extent.width;
+            framebufferInfo.height = pass.extent.height;
+            framebufferInfo.layers = 1;
+
+            VkFramebuffer handle = VK_NULL_HANDLE;
+            if (vkCreateFramebuffer(device_.device(), &framebufferInfo, nullptr, &handle) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create render graph framebuffer!");
+            }
+            framebuffer = pass.framebuffers.emplace(views, handle).first;
+        }
+
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = pass.renderPass;
+        renderPassInfo.framebuffer = framebuffer->second;
+        renderPassInfo.renderArea = renderArea;
+        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+        renderPassInfo.pClearValues = clearValues.data();
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    }
+
+    VkViewport viewport{};
+    viewport.width = static_cast<float>(pass.extent.width);
+    viewport.height = static_cast<float>(pass.extent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &renderArea);
+}
+
+void RenderGraph::endRendering(VkCommandBuffer commandBuffer, const Pass &pass)
+{
+    if (pass.renderPass != VK_NULL_HANDLE)
+    {
+        vkCmdEndRenderPass(commandBuffer);
+    }
+    else
+    {
+        device_.cmdEndRendering(commandBuffer);
+    }
+}
+
+// Lists the passes in execution order with their barriers and uses, then the memory the transients share
+std::string RenderGraph::dump() const
+{
+    std::ostringstream out;
+    out << "render graph: " << stats_.passes << " passes, " << stats_.culledPasses << " culled, "
+        << stats_.imageBarriers << " image barriers\n";
+
+    auto printBarrier = [&](const Barrier &barrier) {
+        out << "    barrier " << resources_[barrier.image].name << ": " << layoutName(barrier.before.layout)
+            << " -> " << layoutName(barrier.after.layout) << "\n";
+    };
+
+    for (uint32_t p = 0; p < passes_.size(); p++)
+    {
+        const auto &pass = passes_[p];
+        out << "  pass " << p << " " << pass.name << " (" << passTypeName(pass.type) << ")";
+        if (pass.culled)
+        {
+            out << " culled\n";
+            continue;
+        }
+        out << "\n";
+        for (const auto &barrier : pass.barriers)
+        {
+            printBarrier(barrier);
+        }
+        for (const auto &use : pass.uses)
+        {
+            out << "    " << usageName(use.usage) << " " << resources_[use.image].name;
+            if (isAttachment(use.usage))
+            {
+                out << (use.loadOp == VK_ATTACHMENT_LOAD_OP_CLEAR  ? " clear"
+                        : use.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD ? " load"
+                                                                   : " discard")
+                    << (use.storeOp == VK_ATTACHMENT_STORE_OP_STORE ? "/store" : "/discard");
+            }
+            out << "\n";
+        }
+    }
+
+    if (!finalBarriers_.empty())
+    {
+        out << "  final\n";
+        for (const auto &barrier : finalBarriers_)
+        {
+            printBarrier(barrier);
+        }
+    }
+
+    out << "transient images: " << stats_.transientImages << " in " << stats_.memorySlots << " memory slots, "
+        << formatBytes(stats_.allocatedBytes) << " instead of " << formatBytes(stats_.transientBytes) << "\n";
+    for (size_t s = 0; s < slots_.size(); s++)
+    {
+        out << "  slot " << s << " (" << formatBytes(slots_[s].size) << "):";
+        for (ResourceId r : slots_[s].images)
+        {
+            out << " " << resources_[r].name << " [" << resources_[r].firstPass << "-" << resources_[r].lastPass
+                << "]";
+        }
+        out << "\n";
+    }
+    return out.str();
+}
@@ -0,0 +1,269 @@
+#include "render_queue.hpp"
+
+// std
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+namespace
+{
+// Widths of the sort key fields, ids beyond a field's range wrap around, which only costs sorting quality
+constexpr uint32_t PHASE_BITS = 2;
+constexpr uint32_t PIPELINE_BITS = 10;
+constexpr uint32_t MATERIAL_BITS = 12;
+constexpr uint32_t MODEL_BITS = 16;
+constexpr uint32_t DEPTH_BITS = 24;
+static_assert(PHASE_BITS + PIPELINE_BITS + MATERIAL_BITS + MODEL_BITS + DEPTH_BITS == 64,
+              "Sort key fields must fill 64 bits");
+
+constexpr uint32_t RADIX_BITS = 8;
+constexpr size_t RADIX_BUCKETS = size_t{1} << RADIX_BITS;
+
+uint64_t field(uint64_t value, uint32_t bits)
+{
+    return value & ((uint64_t{1} << bits) - 1);
+}
+
+// The bit patterns of non-negative floats sort like their values, the top bits keep the order
+uint64_t quantizeDepth(float depth)
+{
+    return std::bit_cast<uint32_t>(std::max(depth, 0.f)) >> (32 - DEPTH_BITS);
+}
+
+uint32_t smallId(std::unordered_map<uint64_t, uint32_t> &ids, uint64_t handle)
+{
+    return ids.try_emplace(handle, static_cast<uint32_t>(ids.size())).first->second;
+}
+} // namespace
+
+/**
+ * Drops the packets of the previous frame. Called once per frame before the systems submit.
+ */
+void RenderQueue::clear()
+{
+    packets_.clear();
+}
+
+void RenderQueue::submit(const DrawPacket &packet)
+{
+    assert(packet.pipeline != nullptr && "Draw packet without a pipeline");
+    assert((packet.model != nullptr || packet.vertexCount > 0) && "Draw packet draws nothing");
+    packets_.push_back(packet);
+}
+
+/**
+ * Sorts and records the submitted packets. Through the frame's CommandRecorder if the pass is recorded in
+ * secondary command buffers, into its cache for a cached pass. See getStats() for how many binds the sorting
+ * saved.
+ *
+ * @param frameInfo Frame being recorded, inside of the render pass
+ */
+void RenderQueue::execute(FrameInfo &frameInfo)
+{
+    sort();
+    stats_ = {};
+    stats_.packets = packets_.size();
+
+    auto recordEntries = [this](VkCommandBuffer commandBuffer, size_t begin, size_t end) {
+        recordRange(commandBuffer, begin, end);
+    };
+    if (frameInfo.cachedPass)
+    {
+        assert(frameInfo.recorder != nullptr && "Cached passes are recorded through the command recorder");
+        frameInfo.recorder->recordCached(
+          frameInfo.commandBuffer, frameInfo.sceneVersion, entries_.size(), recordEntries);
+        return;
+    }
+    if (frameInfo.recorder != nullptr && frameInfo.recorder->isInPass())
+    {
+        // Timestamps can't be written into a pass made of secondary command buffers, so there is no scope
+        frameInfo.recorder->record(frameInfo.commandBuffer, entries_.size(), recordEntries);
+        return;
+    }
+
+    GpuProfiler::Scope profilerScope{frameInfo.profiler, frameInfo.commandBuffer, "render queue"};
+    recordRange(frameInfo.commandBuffer, 0, entries_.size());
+}
+
+/**
+ * Builds the key packets are drawn in ascending order of. Depth prepass and opaque packets are grouped by
+ * state and drawn front to back within a group, transparent ones are drawn strictly back to front, then
+ * grouped by state.
+ */
+uint64_t RenderQueue::sortKey(const DrawPacket &packet)
+{
+    const uint64_t pipelineId = smallId(pipelineIds_, reinterpret_cast<uintptr_t>(packet.pipeline));
+    const uint64_t materialId = smallId(materialIds_, reinterpret_cast<uint64_t>(packet.descriptorSet));
+    const uint64_t modelId = smallId(modelIds_, reinterpret_cast<uintptr_t>(packet.model));
+    const uint64_t pipeline = field(pipelineId, PIPELINE_BITS);
+    const uint64_t material = field(materialId, MATERIAL_BITS);
+    const uint64_t model = field(modelId, MODEL_BITS);
+    const uint64_t depth = quantizeDepth(packet.depth);
+
+    const uint64_t phase = field(static_cast<uint64_t>(packet.phase), PHASE_BITS) << (64 - PHASE_BITS);
+    const uint64_t state = (pipeline << (MATERIAL_BITS + MODEL_BITS)) | (material << MODEL_BITS) | model;
+    if (packet.phase == RenderPhase::Transparent)
+    {
+        const uint64_t backToFront = field(~depth, DEPTH_BITS);
+        return phase | (backToFront << (PIPELINE_BITS + MATERIAL_BITS + MODEL_BITS)) | state;
+    }
+    return phase | (state << DEPTH_BITS) | depth;
+}
+
+// LSD radix sort of the keys, 8 bits per pass. It is stable, so packets with equal keys keep the order
+// they were submitted in.
+void RenderQueue::sort()
+{
+    entries_.clear();
+    for (uint32_t i = 0; i < packets_.size(); i++)
+    {
+        entries_.push_back({sortKey(packets_[i]), i});
+    }
+    if (entries_.size() < 2)
+    {
+        return;
+    }
+
+    scratch_.resize(entries_.size());
+    for (uint32_t shift = 0; shift < 64; shift += RADIX_BITS)
+    {
+        std::array<size_t, RADIX_BUCKETS> offsets{};
+        for (const auto &entry : entries_)
+        {
+            offsets[(entry.key >> shift) & (RADIX_BUCKETS - 1)]++;
+        }
+        // All keys share this digit, the pass would not move anything
+        if (offsets[(entries_[0].key >> shift) & (RADIX_BUCKETS - 1)] == entries_.size())
+        {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (auto &bucket : offsets)
+        {
+            const size_t count = bucket;
+            bucket = offset;
+            offset += count;
+        }
+        for (const auto &entry : entries_)
+        {
+            scratch_[offsets[(entry.key >> shift) & (RADIX_BUCKETS - 1)]++] = entry;
+        }
+        entries_.swap(scratch_);
+    }
+}
+
+void RenderQueue::recordRange(VkCommandBuffer commandBuffer, size_t begin, size_t end)
+{
+    // Nothing is bound at the start of a command buffer
+    Pipeline *boundPipeline = nullptr;
+    VkPipelineLayout boundLayout = VK_NULL_HANDLE;
+    VkDescriptorSet boundDescriptorSet = VK_NULL_HANDLE;
+    VkDescriptorSet boundObjectSet = VK_NULL_HANDLE;
+    Model *boundModel = nullptr;
+    VkBuffer boundInstanceBuffer = VK_NULL_HANDLE;
+
+    BindCounts requested{};
+    BindCounts issued{};
+    for (size_t i = begin; i < end; i++)
+    {
+        auto &packet = packets_[entries_[i].packet];
+
+        requested.pipelines++;
+        if (packet.pipeline != boundPipeline)
+        {
+            packet.pipeline->bind(commandBuffer);
+            boundPipeline = packet.pipeline;
+            issued.pipelines++;
+        }
+
+        // Sets stay bound across pipelines only if their layouts are compatible, which differing push
+        // constant ranges already break
+        if (packet.descriptorSet != VK_NULL_HANDLE)
+        {
+            requested.descriptorSets++;
+            if (packet.descriptorSet != boundDescriptorSet || packet.pipelineLayout != boundLayout)
+            {
+                vkCmdBindDescriptorSets(commandBuffer,
+                                        VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                        packet.pipelineLayout,
+                                        0,
+                                        1,
+                                        &packet.descriptorSet,
+                                        0,
+                                        nullptr);
+                boundDescriptorSet = packet.descriptorSet;
+                boundLayout = packet.pipelineLayout;
+                // Rebinding set 0 may disturb set 1
+                boundObjectSet = VK_NULL_HANDLE;
+                issued.descriptorSets++;
+            }
+        }
+        if (packet.objectDescriptorSet != VK_NULL_HANDLE)
+        {
+            requested.descriptorSets++;
+            if (packet.objectDescriptorSet != boundObjectSet || packet.pipelineLayout != boundLayout)
+            {
+                vkCmdBindDescriptorSets(commandBuffer,
+                                        VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                        packet.pipelineLayout,
+                                        1,
+                                        1,
+                                        &packet.objectDescriptorSet,
+                                        0,
+                                        nullptr);
+                boundObjectSet = packet.objectDescriptorSet;
+                issued.descriptorSets++;
+            }
+        }
+
+        if (packet.model != nullptr)
+        {
+            requested.vertexBuffers++;
+            if (packet.model != boundModel)
+            {
+                packet.model->bind(commandBuffer);
+                boundModel = packet.model;
+                issued.vertexBuffers++;
+            }
+        }
+        if (packet.instanceBuffer != VK_NULL_HANDLE)
+        {
+            requested.vertexBuffers++;
+            if (packet.instanceBuffer != boundInstanceBuffer)
+            {
+                VkDeviceSize offset = 0;
+                vkCmdBindVertexBuffers(commandBuffer, packet.instanceBinding, 1, &packet.instanceBuffer, &offset);
+                boundInstanceBuffer = packet.instanceBuffer;
+                issued.vertexBuffers++;
+            }
+        }
+
+        if (packet.pushConstantSize > 0)
+        {
+            vkCmdPushConstants(commandBuffer,
+                               packet.pipelineLayout,
+                               packet.pushConstantStages,
+                               0,
+                               packet.pushConstantSize,
+                               packet.pushConstants.data());
+        }
+
+        if (packet.model != nullptr)
+        {
+            packet.model->draw(commandBuffer, packet.instanceCount, packet.firstInstance);
+        }
+        else
+        {
+            vkCmdDraw(commandBuffer, packet.vertexCount, packet.instanceCount, 0, packet.firstInstance);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock{statsMutex_};
+    stats_.requested.pipelines += requested.pipelines;
+    stats_.requested.descriptorSets += requested.descriptorSets;
+    stats_.requested.vertexBuffers += requested.vertexBuffers;
+    stats_.issued.pipelines += issued.pipelines;
+    stats_.issued.descriptorSets += issued.descriptorSets;
+    stats_.issued.vertexBuffers += issued.vertexBuffers;
+}
@@ -1,31 +1,171 @@
+#include <algorithm>
 #include <array>
+#include <iostream>
 #include <stdexcept>
+#include <string>
 
+#include "frame_timeline.hpp"
 #include "renderer.hpp"
+#include "staging_pool.hpp"
 
 
-Renderer::Renderer(Window &window, Device &device) : window_{window}, device_{device}
+namespace
 {
+uint32_t validateFramesInFlight(uint32_t framesInFlight)
+{
+    if (framesInFlight < 1 || framesInFlight > RenderTarget::MAX_FRAMES_IN_FLIGHT)
+    {
+        throw std::runtime_error("frames in flight must be between 1 and " +
+                                 std::to_string(RenderTarget::MAX_FRAMES_IN_FLIGHT) + "!");
+    }
+    return framesInFlight;
+}
+
+void transitionImageLayout(VkCommandBuffer commandBuffer,
+                           VkImage image,
+                           VkImageAspectFlags aspectMask,
+                           VkImageLayout oldLayout,
+                           VkImageLayout newLayout,
+                           VkPipelineStageFlags srcStage,
+                           VkAccessFlags srcAccess,
+                           VkPipelineStageFlags dstStage,
+                           VkAccessFlags dstAccess)
+{
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = aspectMask;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+VkImageAspectFlags depthAspectMask(VkFormat format)
+{
+    if (format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT)
+    {
+        return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    }
+    return VK_IMAGE_ASPECT_DEPTH_BIT;
+}
+
+// Hands a finished color image on to presentation, or to a copy recorded after the frame
+void transitionToFinalLayout(VkCommandBuffer commandBuffer,
+                             VkImage image,
+                             VkImageLayout oldLayout,
+                             VkImageLayout finalLayout,
+                             VkPipelineStageFlags srcStage,
+                             VkAccessFlags srcAccess)
+{
+    const bool present = finalLayout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    transitionImageLayout(commandBuffer,
+                          image,
+                          VK_IMAGE_ASPECT_COLOR_BIT,
+                          oldLayout,
+                          finalLayout,
+                          srcStage,
+                          srcAccess,
+                          present ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT,
+                          present ? 0 : VK_ACCESS_TRANSFER_READ_BIT);
+}
+} // namespace
+
+Renderer::Renderer(
+  Window &window, Device &device, const PresentPolicy &presentPolicy, uint32_t framesInFlight, bool readableDepth)
+  : window_{&window}, device_{device}, presentPolicy_{presentPolicy},
+    framesInFlight_{validateFramesInFlight(framesInFlight)}, readableDepth_{readableDepth}
+{
+    // There is nothing to render into yet, so wait for a window that has a size.
+    while (isMinimized())
+    {
+        glfwWaitEvents();
+    }
     recreateSwapChain();
     createCommandBuffers();
+    profiler_ = std::make_unique<GpuProfiler>(device_, framesInFlight_);
+}
+
+Renderer::Renderer(Device &device, VkExtent2D extent, uint32_t framesInFlight, bool readableDepth)
+  : window_{nullptr}, device_{device}, framesInFlight_{validateFramesInFlight(framesInFlight)},
+    readableDepth_{readableDepth}
+{
+    offscreenTarget_ = std::make_unique<OffscreenTarget>(
+      device_, extent, framesInFlight_, 0, VK_FORMAT_UNDEFINED, readableDepth_);
+    renderTarget_ = offscreenTarget_.get();
+    createCommandBuffers();
+    profiler_ = std::make_unique<GpuProfiler>(device_, framesInFlight_);
+}
+
+void Renderer::setPresentPolicy(const PresentPolicy &presentPolicy)
+{
+    assert(!isFrameStarted_ && "Can't change the present policy while frame is in progress");
+    presentPolicy_ = presentPolicy;
+    if (!isHeadless())
+    {
+        recreateSwapChain();
+    }
 }
 
 VkCommandBuffer Renderer::beginFrame()
 {
     assert(!isFrameStarted_ && "Can't call beginFrame while already in progress");
 
-    auto result = swapChain_->acquireNextImage(&currentImageIndex_);
+    device_.stagingPool().tick();
+
+    if (!isHeadless())
+    {
+        if (window_->wasWindowResized())
+        {
+            window_->resetWindowResizedFlag();
+            scheduleSwapChainRecreation(true);
+        }
+        if (isMinimized())
+        {
+            return nullptr;
+        }
+        if (isSwapChainRecreationDue() && !recreateSwapChain())
+        {
+            return nullptr;
+        }
+    }
+
+    auto result = renderTarget_->acquireNextImage(&currentImageIndex_);
     if (result == VK_ERROR_OUT_OF_DATE_KHR)
     {
+        // The image cannot be presented anymore, so this one is not debounced.
         recreateSwapChain();
         return nullptr;
     }
 
-    if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+    if (result == VK_SUBOPTIMAL_KHR)
+    {
+        scheduleSwapChainRecreation(false);
+    }
+    else if (result != VK_SUCCESS)
     {
         throw std::runtime_error("failed to acquire swap chain image!");
     }
 
+    // The fence wait in acquireNextImage completed the oldest frame in flight.
+    releaseRetiredTargets(false);
+    if (frameCapture_ != nullptr)
+    {
+        frameCapture_->collect();
+    }
+    if (commandRecorder_ != nullptr)
+    {
+        commandRecorder_->beginFrame(currentFrameIndex_);
+    }
+
     isFrameStarted_ = true;
 
     auto commandBuffer = getCurrentCommandBuffer();
@@ -36,6 +176,16 @@ VkCommandBuffer Renderer::beginFrame()
     {
         throw std::runtime_error("failed to begin recording command buffer!");
     }
+    profiler_->beginFrame(commandBuffer, currentFrameIndex_);
+
+    // Only frames that have been read back since the last update carry new information
+    if (sceneTarget_ != nullptr && profiler_->getCollectedFrames() != resolutionSamples_)
+    {
+        resolutionSamples_ = profiler_->getCollectedFrames();
+        dynamicResolution_.update(profiler_->getLastFrameMs());
+    }
+    renderExtent_ =
+      sceneTarget_ != nullptr ? dynamicResolution_.scaleExtent(sceneTarget_->getExtent()) : renderTarget_->getExtent();
 
     return commandBuffer;
 }
@@ -45,24 +195,41 @@ void Renderer::endFrame()
     assert(isFrameStarted_ && "Can't call endFrame while frame is not in progress");
 
     auto commandBuffer = getCurrentCommandBuffer();
+    if (frameCapture_ != nullptr && frameCapture_->isCaptured(frameNumber_))
+    {
+        GpuProfiler::Scope profilerScope{profiler_.get(), commandBuffer, "capture"};
+        frameCapture_->record(commandBuffer,
+                              renderTarget_->getAttachments(currentImageIndex_).colorImage,
+                              renderTarget_->getFinalColorLayout(),
+                              renderTarget_->getColorFormat(),
+                              renderTarget_->getExtent(),
+                              frameNumber_);
+    }
+    profiler_->endFrame(commandBuffer);
     if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
     {
         throw std::runtime_error("failed to record command buffer!");
     }
 
-    auto result = swapChain_->submitCommandBuffers(&commandBuffer, &currentImageIndex_);
-    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || window_.wasWindowResized())
+    // Uploads recorded during the frame have to reach the queue before the frame reading them
+    device_.stagingPool().flush();
+    auto result = renderTarget_->submitCommandBuffers(&commandBuffer, &currentImageIndex_);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR)
     {
-        window_.resetWindowResizedFlag();
         recreateSwapChain();
     }
+    else if (result == VK_SUBOPTIMAL_KHR)
+    {
+        scheduleSwapChainRecreation(false);
+    }
     else if (result != VK_SUCCESS)
     {
         throw std::runtime_error("failed to present swap chain image!");
     }
 
     isFrameStarted_ = false;
-    currentFrameIndex_ = (currentFrameIndex_ + 1) % SwapChain::MAX_FRAMES_IN_FLIGHT;
+    currentFrameIndex_ = (currentFrameIndex_ + 1) % framesInFlight_;
+    frameNumber_++;
 }
 
 void Renderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer)
@@ -71,30 +238,57 @@ void Renderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer)
     assert(commandBuffer == getCurrentCommandBuffer() &&
            "Can't begin render pass on command buffer from a different frame");
 
-    VkRenderPassBeginInfo renderPassInfo{};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = swapChain_->getRenderPass();
-    renderPassInfo.framebuffer = swapChain_->getFrameBuffer(currentImageIndex_);
-
-    renderPassInfo.renderArea.offset = {0, 0};
-    renderPassInfo.renderArea.extent = swapChain_->getSwapChainExtent();
-
     std::array<VkClearValue, 2> clearValues{};
     clearValues[0].color = {0.01f, 0.01f, 0.01f, 1.0f};
     clearValues[1].depthStencil = {1.0f, 0};
-    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-    renderPassInfo.pClearValues = clearValues.data();
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    const bool secondaries = commandRecorder_ != nullptr;
+    if (device_.dynamicRenderingEnabled())
+    {
+        beginRendering(commandBuffer,
+                       clearValues[0],
+                       clearValues[1],
+                       secondaries ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0);
+    }
+    else
+    {
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = drawTarget().getRenderPass();
+        renderPassInfo.framebuffer = drawTarget().getFrameBuffer(drawImageIndex());
+
+        // A scaled scene only covers the top left part of its framebuffer
+        renderPassInfo.renderArea.offset = {0, 0};
+        renderPassInfo.renderArea.extent = renderExtent_;
+
+        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+        renderPassInfo.pClearValues = clearValues.data();
+
+        vkCmdBeginRenderPass(commandBuffer,
+                             &renderPassInfo,
+                             secondaries ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+    }
+
+    // Nothing but secondary command buffers may be recorded into the pass, they set their own viewport
+    if (secondaries)
+    {
+        const bool renderPass = !device_.dynamicRenderingEnabled();
+        commandRecorder_->beginPass({drawTarget().getRenderPass(),
+                                     renderPass ? drawTarget().getFrameBuffer(drawImageIndex()) : VK_NULL_HANDLE,
+                                     drawTarget().getColorFormat(),
+                                     drawTarget().getDepthFormat(),
+                                     renderExtent_});
+        return;
+    }
 
     VkViewport viewport{};
     viewport.x = 0.0f;
     viewport.y = 0.0f;
-    viewport.width = static_cast<float>(swapChain_->getSwapChainExtent().width);
-    viewport.height = static_cast<float>(swapChain_->getSwapChainExtent().height);
+    viewport.width = static_cast<float>(renderExtent_.width);
+    viewport.height = static_cast<float>(renderExtent_.height);
     viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
-    VkRect2D scissor{{0, 0}, swapChain_->getSwapChainExtent()};
+    VkRect2D scissor{{0, 0}, renderExtent_};
     vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 }
@@ -104,46 +298,453 @@ void Renderer::endSwapChainRenderPass(VkCommandBuffer commandBuffer)
     assert(isFrameStarted_ && "Can't call endSwapChainRenderPass if frame is not in progress");
     assert(commandBuffer == getCurrentCommandBuffer() &&
            "Can't end render pass on command buffer from a different frame");
-    vkCmdEndRenderPass(commandBuffer);
+    if (commandRecorder_ != nullptr)
+    {
+        commandRecorder_->endPass();
+    }
+    if (device_.dynamicRenderingEnabled())
+    {
+        endRendering(commandBuffer);
+    }
+    else
+    {
+        vkCmdEndRenderPass(commandBuffer);
+    }
+
+    if (sceneTarget_ != nullptr || postScenePasses_)
+    {
+        executePostSceneGraph(commandBuffer);
+    }
 }
 
-Renderer::~Renderer()
+/**
+ * Begins dynamic rendering on the acquired image. The layout transitions and dependencies a render pass
+ * would declare are recorded as barriers instead.
+ *
+ * @param commandBuffer Command buffer of the current frame
+ * @param colorClear Clear value of the color attachment
+ * @param depthClear Clear value of the depth attachment
+ * @param flags VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT if the pass is recorded in secondaries
+ */
+void Renderer::beginRendering(VkCommandBuffer commandBuffer,
+                              VkClearValue colorClear,
+                              VkClearValue depthClear,
+                              VkRenderingFlags flags)
 {
-    freeCommandBuffers();
+    const auto attachments = drawTarget().getAttachments(drawImageIndex());
+    const auto depthAspect = depthAspectMask(drawTarget().getDepthFormat());
+
+    // The acquire semaphore is waited on at the color attachment output stage, so the transition has to
+    // happen after it. Depth is cleared, only the previous frame's writes to it have to be ordered.
+    transitionImageLayout(commandBuffer,
+                          attachments.colorImage,
+                          VK_IMAGE_ASPECT_COLOR_BIT,
+                          VK_IMAGE_LAYOUT_UNDEFINED,
+                          VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                          VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                          0,
+                          VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                          VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+    transitionImageLayout(commandBuffer,
+                          attachments.depthImage,
+                          depthAspect,
+                          VK_IMAGE_LAYOUT_UNDEFINED,
+                          VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                          VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                          VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+
+    VkRenderingAttachmentInfo colorAttachment{};
+    colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    colorAttachment.imageView = attachments.colorView;
+    colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.clearValue = colorClear;
+
+    VkRenderingAttachmentInfo depthAttachment{};
+    depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    depthAttachment.imageView = attachments.depthView;
+    depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = readableDepth_ ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.clearValue = depthClear;
+
+    VkRenderingInfo renderingInfo{};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    renderingInfo.flags = flags;
+    renderingInfo.renderArea.offset = {0, 0};
+    renderingInfo.renderArea.extent = renderExtent_;
+    renderingInfo.layerCount = 1;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachments = &colorAttachment;
+    renderingInfo.pDepthAttachment = &depthAttachment;
+
+    device_.cmdBeginRendering(commandBuffer, renderingInfo);
+}
+
+void Renderer::endRendering(VkCommandBuffer commandBuffer)
+{
+    device_.cmdEndRendering(commandBuffer);
+
+    transitionToFinalLayout(commandBuffer,
+                            drawTarget().getAttachments(drawImageIndex()).colorImage,
+                            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                            drawTarget().getFinalColorLayout(),
+                            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
 }
 
-void Renderer::recreateSwapChain()
+/**
+ * Builds the graph of the passes recorded after the scene for the current targets. The scene's color image
+ * was left in its final layout and its depth as an attachment. Without dynamic resolution the scene is drawn
+ * into the target's image directly, which then also has to end up in the target's final layout.
+ */
+void Renderer::buildPostSceneGraph()
 {
-    auto extent = window_.getExtent();
-    while (extent.width == 0 || extent.height == 0)
+    postSceneGraph_ = std::make_unique<RenderGraph>(device_);
+    auto &graph = *postSceneGraph_;
+
+    auto finalState = [](VkImageLayout layout) -> ImageState {
+        const bool present = layout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        return {layout,
+                present ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT,
+                present ? VkAccessFlags{0} : VK_ACCESS_TRANSFER_READ_BIT};
+    };
+    const bool scaled = sceneTarget_ != nullptr;
+    const auto &scene = drawTarget();
+    sceneColor_ = graph.importImage("scene color",
+                                    {scene.getColorFormat(), scene.getExtent()},
+                                    finalState(scene.getFinalColorLayout()),
+                                    scaled ? ImageState{} : finalState(renderTarget_->getFinalColorLayout()));
+    sceneDepth_ = graph.importImage("scene depth",
+                                    {scene.getDepthFormat(), scene.getExtent()},
+                                    {VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                                     VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                       VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                                     VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT},
+                                    {});
+
+    if (postScenePasses_)
     {
-        extent = window_.getExtent();
-        glfwWaitEvents();
+        postScenePasses_(graph, {sceneColor_, sceneDepth_, scene.getExtent()});
     }
 
-    // Wait till the current swap chain is unused before creating a new one.
+    if (scaled)
+    {
+        targetColor_ =
+          graph.importImage("target color",
+                            {renderTarget_->getColorFormat(), renderTarget_->getExtent()},
+                            {VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0},
+                            finalState(renderTarget_->getFinalColorLayout()));
+        graph.addPass(
+          "upscale",
+          RenderGraph::PassType::Transfer,
+          [&](RenderGraph::PassBuilder &pass) { pass.copyFrom(sceneColor_).copyTo(targetColor_); },
+          [this](VkCommandBuffer commandBuffer) { blitSceneTarget(commandBuffer); });
+    }
+
+    graph.compile();
+    if (dumpRenderGraph_)
+    {
+        std::cout << graph.dump();
+    }
+}
+
+void Renderer::retirePostSceneGraph()
+{
+    if (postSceneGraph_ != nullptr)
+    {
+        const uint64_t releaseValue = device_.frameTimeline().submittedValue();
+        retiredGraphs_.push_back({std::move(postSceneGraph_), releaseValue});
+    }
+}
+
+void Renderer::executePostSceneGraph(VkCommandBuffer commandBuffer)
+{
+    if (postSceneGraph_ == nullptr)
+    {
+        buildPostSceneGraph();
+    }
+    const auto scene = drawTarget().getAttachments(drawImageIndex());
+    postSceneGraph_->setImportedImage(sceneColor_, scene.colorImage, scene.colorView);
+    postSceneGraph_->setImportedImage(sceneDepth_, scene.depthImage, scene.depthView);
+    if (sceneTarget_ != nullptr)
+    {
+        const auto target = renderTarget_->getAttachments(currentImageIndex_);
+        postSceneGraph_->setImportedImage(targetColor_, target.colorImage, target.colorView);
+    }
+    postSceneGraph_->execute(commandBuffer, profiler_.get());
+}
+
+void Renderer::setPostScenePasses(PostScenePasses passes)
+{
+    assert(!isFrameStarted_ && "Can't change the post-scene passes while frame is in progress");
+    postScenePasses_ = std::move(passes);
+    retirePostSceneGraph();
+}
+
+/**
+ * Upscales the part of the scene target rendered this frame into the whole acquired image
+ *
+ * @param commandBuffer Command buffer of the current frame, in the transfer layouts the post-scene graph
+ * moved the images into
+ */
+void Renderer::blitSceneTarget(VkCommandBuffer commandBuffer)
+{
+    const auto source = sceneTarget_->getColorImage(currentFrameIndex_);
+    const auto destination = renderTarget_->getAttachments(currentImageIndex_).colorImage;
+    const auto extent = renderTarget_->getExtent();
+
+    VkImageBlit region{};
+    region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.srcSubresource.layerCount = 1;
+    region.srcOffsets[1] = {static_cast<int32_t>(renderExtent_.width), static_cast<int32_t>(renderExtent_.height), 1};
+    region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.dstSubresource.layerCount = 1;
+    region.dstOffsets[1] = {static_cast<int32_t>(extent.width), static_cast<int32_t>(extent.height), 1};
+
+    vkCmdBlitImage(commandBuffer,
+                   source,
+                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   destination,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   1,
+                   &region,
+                   VK_FILTER_LINEAR);
+}
+
+void Renderer::setDynamicResolution(const DynamicResolution::Settings &settings)
+{
+    assert(!isFrameStarted_ && "Can't change dynamic resolution while frame is in progress");
+
+    dynamicResolution_ = DynamicResolution{settings};
+    retirePostSceneGraph();
+    if (commandRecorder_ != nullptr)
+    {
+        commandRecorder_->invalidateCache();
+    }
+    if (sceneTarget_ != nullptr)
+    {
+        retireTarget(std::move(sceneTarget_));
+    }
+
+    if (!dynamicResolution_.isEnabled())
+    {
+        return;
+    }
+    if (!canScaleResolution())
+    {
+        dynamicResolution_ = DynamicResolution{};
+        return;
+    }
+    createSceneTarget();
+}
+
+bool Renderer::canScaleResolution() const
+{
+    if (!profiler_->isSupported())
+    {
+        std::cout << "dynamic resolution: unsupported, GPU frame time cannot be measured" << std::endl;
+        return false;
+    }
+    if (swapChain_ != nullptr && (swapChain_->getImageUsage() & VK_IMAGE_USAGE_TRANSFER_DST_BIT) == 0)
+    {
+        std::cout << "dynamic resolution: unsupported, swap chain images cannot be blitted to" << std::endl;
+        return false;
+    }
+
+    const VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                              VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    if (!device_.isFormatSupported(renderTarget_->getColorFormat(), VK_IMAGE_TILING_OPTIMAL, blitFeatures))
+    {
+        std::cout << "dynamic resolution: unsupported, color format cannot be blitted with linear filtering"
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void Renderer::setRecordingThreads(WorkerPool &workers, uint32_t threadCount)
+{
+    assert(!isFrameStarted_ && "Can't change recording threads while frame is in progress");
+    workers_ = &workers;
+    recordingThreads_ = threadCount;
+    createCommandRecorder();
+}
+
+void Renderer::setCommandCaching(bool enabled)
+{
+    assert(!isFrameStarted_ && "Can't change command caching while frame is in progress");
+    commandCaching_ = enabled;
+    createCommandRecorder();
+}
+
+void Renderer::createCommandRecorder()
+{
+    // Frames in flight may still execute command buffers of the old recorder's pools
+    if (commandRecorder_ != nullptr)
+    {
+        auto &timeline = device_.frameTimeline();
+        timeline.wait(timeline.submittedValue());
+        commandRecorder_.reset();
+    }
+    if (recordingThreads_ > 1 || commandCaching_)
+    {
+        commandRecorder_ = std::make_unique<CommandRecorder>(device_, framesInFlight_, workers_, recordingThreads_);
+    }
+}
+
+void Renderer::setFrameCapture(const FrameCapture::Settings &settings)
+{
+    assert(!isFrameStarted_ && "Can't change frame capture while frame is in progress");
+
+    frameCapture_.reset();
+    if (settings.interval == 0 || !canCapture())
+    {
+        return;
+    }
+    frameCapture_ = std::make_unique<FrameCapture>(device_, settings);
+}
+
+bool Renderer::canCapture() const
+{
+    if (swapChain_ != nullptr && (swapChain_->getImageUsage() & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) == 0)
+    {
+        std::cout << "frame capture: unsupported, swap chain images cannot be copied from" << std::endl;
+        return false;
+    }
+    if (!FrameCapture::isFormatSupported(renderTarget_->getColorFormat()))
+    {
+        std::cout << "frame capture: unsupported, color format is not 8-bit RGBA or BGRA" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void Renderer::createSceneTarget()
+{
+    // Same formats as the presented images, so pipelines work with either target
+    sceneTarget_ = std::make_shared<OffscreenTarget>(device_,
+                                                     renderTarget_->getExtent(),
+                                                     framesInFlight_,
+                                                     framesInFlight_,
+                                                     renderTarget_->getColorFormat(),
+                                                     readableDepth_);
+}
+
+Renderer::~Renderer()
+{
     vkDeviceWaitIdle(device_.device());
-    // swapChain_ = nullptr;
+    frameCapture_.reset();
+    commandRecorder_.reset();
+    postSceneGraph_.reset();
+    releaseRetiredTargets(true);
+    freeCommandBuffers();
+}
+
+/**
+ * Replaces the swap chain without waiting for the device. The old one is passed as oldSwapchain and
+ * destroyed once the frames that were submitted to it have completed.
+ *
+ * @return False if the window is minimized and no swap chain could be created
+ */
+bool Renderer::recreateSwapChain()
+{
+    if (isMinimized())
+    {
+        recreationPending_ = true;
+        return false;
+    }
+    recreationPending_ = false;
 
+    const auto extent = window_->getExtent();
     if (swapChain_ == nullptr)
     {
-        swapChain_ = std::make_unique<SwapChain>(device_, extent);
+        swapChain_ = std::make_unique<SwapChain>(device_, extent, presentPolicy_, framesInFlight_, readableDepth_);
     }
     else
     {
         std::shared_ptr<SwapChain> oldSwapChain = std::move(swapChain_);
-        swapChain_ = std::make_unique<SwapChain>(device_, extent, oldSwapChain);
+        swapChain_ = std::make_unique<SwapChain>(device_, extent, presentPolicy_, framesInFlight_, oldSwapChain);
 
         if (!oldSwapChain->compareSwapFormats(*swapChain_.get()))
         {
             throw std::runtime_error("Swap chain image(or depth) format has changed!");
         }
+
+        retireTarget(std::move(oldSwapChain));
     }
+    renderTarget_ = swapChain_.get();
+    retirePostSceneGraph();
+    if (commandRecorder_ != nullptr)
+    {
+        commandRecorder_->invalidateCache();
+    }
+
+    // The scene target is as large as the swap chain, the scale is applied inside of it
+    if (sceneTarget_ != nullptr && (sceneTarget_->getExtent().width != swapChain_->width() ||
+                                    sceneTarget_->getExtent().height != swapChain_->height()))
+    {
+        retireTarget(std::move(sceneTarget_));
+        createSceneTarget();
+    }
+    return true;
+}
+
+void Renderer::scheduleSwapChainRecreation(bool resized)
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (!recreationPending_)
+    {
+        recreationPending_ = true;
+        firstResizeTime_ = now;
+        lastResizeTime_ = now;
+    }
+    else if (resized)
+    {
+        lastResizeTime_ = now;
+    }
+}
+
+bool Renderer::isSwapChainRecreationDue() const
+{
+    if (!recreationPending_)
+    {
+        return false;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    return now - lastResizeTime_ >= RESIZE_DEBOUNCE || now - firstResizeTime_ >= RESIZE_MAX_DELAY;
+}
+
+void Renderer::retireTarget(std::shared_ptr<RenderTarget> target)
+{
+    // Frames submitted so far may still be using it. Presentation of its images is not tracked by the
+    // timeline, so frames in flight worth of margin are added on top.
+    const uint64_t releaseValue = device_.frameTimeline().submittedValue() + framesInFlight_;
+    retiredTargets_.push_back({std::move(target), releaseValue});
+}
+
+void Renderer::releaseRetiredTargets(bool force)
+{
+    auto &timeline = device_.frameTimeline();
+    auto isComplete = [&](const RetiredTarget &retired) { return force || timeline.isComplete(retired.releaseValue); };
+    auto it = std::remove_if(retiredTargets_.begin(), retiredTargets_.end(), isComplete);
+    retiredTargets_.erase(it, retiredTargets_.end());
+
+    auto isGraphComplete = [&](const RetiredGraph &retired) {
+        return force || timeline.isComplete(retired.releaseValue);
+    };
+    auto graph = std::remove_if(retiredGraphs_.begin(), retiredGraphs_.end(), isGraphComplete);
+    retiredGraphs_.erase(graph, retiredGraphs_.end());
 }
 
 void Renderer::createCommandBuffers()
 {
-    commandBuffers_.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+    commandBuffers_.resize(framesInFlight_);
 
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
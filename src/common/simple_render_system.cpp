@@ -1,5 +1,8 @@
-#include <array>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <stdexcept>
+#include <vector>
 
 // libs
 #define GLM_FORCE_RADIANS
@@ -11,78 +14,236 @@
 
 namespace
 {
-struct SimplePushConstantData
+// std430 layout of ObjectData in simple_shader.vert, the normal matrix is a mat3 of three vec4 columns
+struct ObjectData
 {
-    glm::mat4 modelMatrix{1.f};
-    glm::mat4 normalMatrix{1.f};
+    glm::mat4 modelMatrix;
+    glm::vec4 normalMatrix[3];
 };
+
+static_assert(sizeof(ObjectData) == 112, "ObjectData must match simple_shader.vert");
+
+constexpr uint32_t MIN_OBJECT_CAPACITY = 64;
+
+void configurePipeline(PipelineConfigInfo &config,
+                       const RenderTargetInfo &renderTarget,
+                       VkPipelineLayout pipelineLayout)
+{
+    Pipeline::defaultPipelineConfigInfo(config);
+    config.renderTarget = renderTarget;
+    config.pipelineLayout = pipelineLayout;
+}
+
+// Reads only the position, writes no color
+void configureDepthOnly(PipelineConfigInfo &config)
+{
+    auto &attributes = config.attributeDescriptions;
+    attributes.erase(std::remove_if(attributes.begin(),
+                                    attributes.end(),
+                                    [](const VkVertexInputAttributeDescription &a) { return a.location != 0; }),
+                     attributes.end());
+    config.colorBlendAttachment.colorWriteMask = 0;
+}
+
+// The prepass already wrote the nearest depth, only fragments at exactly that depth are shaded
+void configureDepthEqual(PipelineConfigInfo &config)
+{
+    config.depthStencilInfo.depthCompareOp = VK_COMPARE_OP_EQUAL;
+    config.depthStencilInfo.depthWriteEnable = VK_FALSE;
+}
 } // namespace
 
-SimpleRenderSystem::SimpleRenderSystem(Device &device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout)
-  : device_{device}
+SimpleRenderSystem::SimpleRenderSystem(Device &device,
+                                       const RenderTargetInfo &renderTarget,
+                                       VkDescriptorSetLayout globalSetLayout,
+                                       uint32_t framesInFlight,
+                                       WorkerPool &workers,
+                                       uint32_t cullingThreads)
+  : device_{device}, culler_{workers, cullingThreads}, transforms_{workers, cullingThreads}
 {
+    createObjectSets(framesInFlight);
     createPipelineLayout(globalSetLayout);
-    createPipeline(renderPass);
+    createPipeline(renderTarget);
 }
 
-void SimpleRenderSystem::renderGameObjects(FrameInfo &frameInfo)
+void SimpleRenderSystem::submitGameObjects(FrameInfo &frameInfo, RenderQueue &renderQueue)
 {
-    pipeline_->bind(frameInfo.commandBuffer);
-
-    vkCmdBindDescriptorSets(frameInfo.commandBuffer,
-                            VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            pipelineLayout_,
-                            0,
-                            1,
-                            &frameInfo.globalDescriptorSet,
-                            0,
-                            nullptr);
+    // Objects that moved since the last frame get their matrices built in one batch, the rest are cached
+    transforms_.clear();
+    for (auto &kv : frameInfo.gameObjects)
+    {
+        auto &obj = kv.second;
+        if (obj.model != nullptr && obj.transform.isDirty())
+        {
+            transforms_.add(obj.transform);
+        }
+    }
+    transforms_.update();
 
+    std::vector<GameObject *> candidates;
+    candidates.reserve(frameInfo.gameObjects.size());
+    culler_.clear();
     for (auto &kv : frameInfo.gameObjects)
     {
         auto &obj = kv.second;
         if (obj.model == nullptr)
+        {
             continue;
+        }
+        // Rotation keeps lengths, so the largest scale bounds how far the sphere grows
+        const glm::vec4 &sphere = obj.model->getBoundingSphere();
+        const glm::vec3 &scale = obj.transform.getScale();
+        const float maxScale = std::max({std::abs(scale.x), std::abs(scale.y), std::abs(scale.z)});
+        culler_.addSphere(glm::vec3{obj.transform.mat4() * glm::vec4{glm::vec3{sphere}, 1.f}}, sphere.w * maxScale);
+        candidates.push_back(&obj);
+    }
 
-        SimplePushConstantData push{};
-        push.modelMatrix = obj.transform.mat4();
-        push.normalMatrix = obj.transform.normalMatrix();
+    // A cached pass is replayed from other viewpoints, what is out of view is left to the rasterizer
+    std::vector<GameObject *> objects;
+    if (frameInfo.cachedPass)
+    {
+        objects = candidates;
+    }
+    else
+    {
+        culler_.cull(Frustum::fromMatrix(frameInfo.camera.getProjection() * frameInfo.camera.getView()));
+        objects.reserve(culler_.getStats().visible);
+        for (size_t i = 0; i < candidates.size(); i++)
+        {
+            if (culler_.isVisible(i))
+            {
+                objects.push_back(candidates[i]);
+            }
+        }
+    }
+    std::sort(objects.begin(), objects.end(), [](const GameObject *a, const GameObject *b) {
+        return a->model.get() < b->model.get();
+    });
 
-        vkCmdPushConstants(frameInfo.commandBuffer,
-                           pipelineLayout_,
-                           VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-                           0,
-                           sizeof(SimplePushConstantData),
-                           &push);
+    std::vector<ModelGroup> groups;
+    for (uint32_t i = 0; i < objects.size(); i++)
+    {
+        if (groups.empty() || groups.back().model != objects[i]->model.get())
+        {
+            groups.push_back({objects[i]->model.get(), i, 0});
+        }
+        groups.back().count++;
+    }
 
-        obj.model->bind(frameInfo.commandBuffer);
-        obj.model->draw(frameInfo.commandBuffer);
+    // The draws find their objects through firstInstance
+    auto *objectData = static_cast<ObjectData *>(objectBuffer(frameInfo.frameIndex, objects.size()).getMappedMemory());
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        const glm::mat3 &normalMatrix = objects[i]->transform.normalMatrix();
+        objectData[i].modelMatrix = objects[i]->transform.mat4();
+        for (int column = 0; column < 3; column++)
+        {
+            objectData[i].normalMatrix[column] = glm::vec4{normalMatrix[column], 0.f};
+        }
+    }
+
+    const VkDescriptorSet objectSet = frames_[frameInfo.frameIndex].objectSet;
+    const glm::vec3 cameraPosition = frameInfo.camera.getPosition();
+    for (const auto &group : groups)
+    {
+        DrawPacket packet{};
+        packet.pipeline = depthPrepass_ ? equalPipeline_.get() : pipeline_.get();
+        packet.pipelineLayout = pipelineLayout_;
+        packet.descriptorSet = frameInfo.globalDescriptorSet;
+        packet.objectDescriptorSet = objectSet;
+        packet.model = group.model;
+        packet.instanceCount = group.count;
+        packet.firstInstance = group.first;
+
+        // Groups are drawn from their nearest object
+        float depth = std::numeric_limits<float>::max();
+        for (uint32_t i = group.first; i < group.first + group.count; i++)
+        {
+            const glm::vec3 offset = cameraPosition - objects[i]->transform.getTranslation();
+            depth = std::min(depth, glm::dot(offset, offset));
+        }
+        packet.depth = depth;
+
+        if (depthPrepass_)
+        {
+            DrawPacket depthPacket = packet;
+            depthPacket.phase = RenderPhase::DepthPrepass;
+            depthPacket.pipeline = depthPipeline_.get();
+            renderQueue.submit(depthPacket);
+        }
+        renderQueue.submit(packet);
     }
 }
 
+/**
+ * Returns the object buffer of a frame slot, which the frame that used it last has finished with
+ *
+ * @param frameIndex Frame slot
+ * @param objectCount Number of objects the buffer has to hold at least
+ */
+Buffer &SimpleRenderSystem::objectBuffer(int frameIndex, size_t objectCount)
+{
+    auto &frame = frames_[frameIndex];
+    if (frame.objects == nullptr || frame.objects->getInstanceCount() < objectCount)
+    {
+        // Grows in powers of two so a growing scene doesn't reallocate every frame
+        uint32_t capacity = MIN_OBJECT_CAPACITY;
+        while (capacity < objectCount)
+        {
+            capacity *= 2;
+        }
+        frame.objects = std::make_unique<Buffer>(device_,
+                                                 sizeof(ObjectData),
+                                                 capacity,
+                                                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        frame.objects->map();
+
+        auto objectsInfo = frame.objects->descriptorInfo();
+        DescriptorWriter(*objectSetLayout_, *descriptorPool_).writeBuffer(0, &objectsInfo).overwrite(frame.objectSet);
+    }
+    return *frame.objects;
+}
+
 SimpleRenderSystem::~SimpleRenderSystem()
 {
     vkDestroyPipelineLayout(device_.device(), pipelineLayout_, nullptr);
 }
 
-void SimpleRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout)
+void SimpleRenderSystem::createObjectSets(uint32_t framesInFlight)
 {
-    VkPushConstantRange pushConstantRange{};
+    objectSetLayout_ = DescriptorSetLayout::Builder(device_)
+                         .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+                         .build();
+    descriptorPool_ = DescriptorPool::Builder(device_)
+                        .setMaxSets(framesInFlight)
+                        .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, framesInFlight)
+                        .build();
 
-    // We want to have access to push constant data both in vertex and fragment shaders.
-    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-    pushConstantRange.offset = 0;
-    pushConstantRange.size = sizeof(SimplePushConstantData);
+    // Written when the frame's object buffer is created
+    frames_.resize(framesInFlight);
+    for (auto &frame : frames_)
+    {
+        if (!descriptorPool_->allocateDescriptor(objectSetLayout_->getDescriptorSetLayout(), frame.objectSet))
+        {
+            throw std::runtime_error("failed to allocate object descriptor set!");
+        }
+    }
+}
 
-    std::vector<VkDescriptorSetLayout> descriptorSetLayouts{globalSetLayout};
+void SimpleRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout)
+{
+    std::vector<VkDescriptorSetLayout> descriptorSetLayouts{globalSetLayout,
+                                                            objectSetLayout_->getDescriptorSetLayout()};
 
     VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
     pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-    pipelineLayoutInfo.pushConstantRangeCount = 1;
-    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    pipelineLayoutInfo.pPushConstantRanges = nullptr;
 
     if (vkCreatePipelineLayout(device_.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout_) != VK_SUCCESS)
     {
@@ -90,13 +251,22 @@ void SimpleRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLay
     }
 }
 
-void SimpleRenderSystem::createPipeline(VkRenderPass renderPass)
+void SimpleRenderSystem::createPipeline(const RenderTargetInfo &renderTarget)
 {
     assert(pipelineLayout_ != nullptr && "Cannot create pipeline before pipeline layout");
 
     PipelineConfigInfo pipelineConfig{};
-    Pipeline::defaultPipelineConfigInfo(pipelineConfig);
-    pipelineConfig.renderPass = renderPass;
-    pipelineConfig.pipelineLayout = pipelineLayout_;
+    configurePipeline(pipelineConfig, renderTarget, pipelineLayout_);
     pipeline_ = std::make_unique<Pipeline>(device_, "simple_shader.vert.spv", "simple_shader.frag.spv", pipelineConfig);
+
+    PipelineConfigInfo equalConfig{};
+    configurePipeline(equalConfig, renderTarget, pipelineLayout_);
+    configureDepthEqual(equalConfig);
+    equalPipeline_ =
+      std::make_unique<Pipeline>(device_, "simple_shader.vert.spv", "simple_shader.frag.spv", equalConfig);
+
+    PipelineConfigInfo depthConfig{};
+    configurePipeline(depthConfig, renderTarget, pipelineLayout_);
+    configureDepthOnly(depthConfig);
+    depthPipeline_ = std::make_unique<Pipeline>(device_, "depth_only.vert.spv", "", depthConfig);
 }
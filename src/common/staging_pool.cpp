@@ -0,0 +1,411 @@
+#include "staging_pool.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+StagingPool::StagingPool(Device &device, uint32_t idleTicksBeforeShrink)
+  : device_{device}, idleTicksBeforeShrink_{idleTicksBeforeShrink}
+{
+}
+
+StagingPool::~StagingPool()
+{
+    waitIdle();
+
+    for (auto &block : blocks_)
+    {
+        destroyBlock(block);
+    }
+
+    for (auto &transfer : transfers_)
+    {
+        vkFreeCommandBuffers(device_.device(), device_.getCommandPool(), 1, &transfer.commandBuffer);
+        vkDestroyFence(device_.device(), transfer.fence, nullptr);
+    }
+}
+
+/**
+ * Rounds a requested size up to the size class serving it
+ *
+ * @param size Number of bytes requested
+ *
+ * @return Smallest power of two that is at least MIN_BLOCK_SIZE and can hold size bytes
+ */
+VkDeviceSize StagingPool::blockSizeFor(VkDeviceSize size)
+{
+    VkDeviceSize blockSize = MIN_BLOCK_SIZE;
+    while (blockSize < size)
+    {
+        blockSize <<= 1;
+    }
+    return blockSize;
+}
+
+/**
+ * Hands out a mapped span of at least size bytes. The span has to be given back with release().
+ *
+ * @param size Number of bytes needed
+ *
+ * @return Span describing the buffer and mapped host pointer to write to
+ */
+StagingPool::Span StagingPool::acquire(VkDeviceSize size)
+{
+    assert(size > 0 && "Cannot acquire an empty staging span");
+    recycleCompleted();
+
+    const VkDeviceSize alignedSize = (size + SPAN_ALIGNMENT - 1) / SPAN_ALIGNMENT * SPAN_ALIGNMENT;
+    stats_.acquireCount++;
+
+    uint32_t index = findBlock(alignedSize);
+    if (index == std::numeric_limits<uint32_t>::max())
+    {
+        index = createBlock(blockSizeFor(alignedSize));
+    }
+    else
+    {
+        stats_.reuseCount++;
+    }
+
+    auto &block = blocks_[index];
+    Span span{};
+    span.buffer = block.buffer->getBuffer();
+    span.offset = block.used;
+    span.size = size;
+    span.mapped = static_cast<char *>(block.buffer->getMappedMemory()) + block.used;
+    span.block = index;
+
+    block.state = BlockState::InUse;
+    block.used += alignedSize;
+    block.liveSpans++;
+    block.lastUsedTick = tick_;
+
+    stats_.bytesInUse += alignedSize;
+    stats_.highWaterBytesInUse = std::max(stats_.highWaterBytesInUse, stats_.bytesInUse);
+    return span;
+}
+
+/**
+ * Gives a span back to the pool
+ *
+ * @param span Span previously returned by acquire()
+ * @param fence (Optional) Fence signaled by the submission reading from the span. The span's block is only
+ * reused after it has signaled, so the caller must keep the fence alive until then.
+ */
+void StagingPool::release(const Span &span, VkFence fence)
+{
+    assert(span.block < blocks_.size() && blocks_[span.block].liveSpans > 0 && "Releasing a span that is not in use");
+
+    auto &block = blocks_[span.block];
+    block.liveSpans--;
+    block.lastUsedTick = tick_;
+    if (fence != VK_NULL_HANDLE && std::find(block.fences.begin(), block.fences.end(), fence) == block.fences.end())
+    {
+        block.fences.push_back(fence);
+    }
+    freeIfUnused(block);
+}
+
+/**
+ * Copies data into a staging span and records a transfer into dstBuffer. The transfer is submitted
+ * together with the other uploads since the last flush by the next flush(), tick() or waitIdle(), which is
+ * followed by a barrier so later submissions on the graphics queue see the data.
+ *
+ * @param data Pointer to the data to upload
+ * @param size Number of bytes to upload
+ * @param dstBuffer Destination buffer, created with VK_BUFFER_USAGE_TRANSFER_DST_BIT
+ * @param dstOffset (Optional) Byte offset into the destination buffer
+ */
+void StagingPool::upload(const void *data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset)
+{
+    auto span = acquire(size);
+    memcpy(span.mapped, data, static_cast<size_t>(size));
+
+    auto &transfer = recordingTransfer();
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = span.offset;
+    copyRegion.dstOffset = dstOffset;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(transfer.commandBuffer, span.buffer, dstBuffer, 1, &copyRegion);
+
+    release(span, transfer.fence);
+}
+
+/**
+ * Submits the uploads recorded since the last flush in one batch. Has to be called before submitting
+ * work that reads the uploaded data.
+ */
+void StagingPool::flush()
+{
+    if (recording_ == NO_TRANSFER)
+    {
+        return;
+    }
+    auto &transfer = transfers_[recording_];
+    recording_ = NO_TRANSFER;
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(transfer.commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         0,
+                         1,
+                         &barrier,
+                         0,
+                         nullptr,
+                         0,
+                         nullptr);
+
+    if (vkEndCommandBuffer(transfer.commandBuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to record staging uploads!");
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &transfer.commandBuffer;
+
+    if (vkQueueSubmit(device_.graphicsQueue(), 1, &submitInfo, transfer.fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to submit staging upload!");
+    }
+    transfer.pending = true;
+    stats_.submitCount++;
+}
+
+/**
+ * Advances the pool clock. Submits the recorded uploads, recycles blocks whose transfers completed and
+ * frees blocks that have not been used for idleTicksBeforeShrink ticks. Meant to be called once per frame.
+ */
+void StagingPool::tick()
+{
+    flush();
+    tick_++;
+    recycleCompleted();
+    shrinkIdle();
+}
+
+/**
+ * Submits the recorded uploads and blocks until every transfer has completed and all blocks are recycled
+ */
+void StagingPool::waitIdle()
+{
+    flush();
+    for (auto &transfer : transfers_)
+    {
+        if (transfer.pending)
+        {
+            vkWaitForFences(device_.device(), 1, &transfer.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+        }
+    }
+    recycleCompleted();
+}
+
+// Prefers the tail of a block that is already in use, so small spans share blocks
+uint32_t StagingPool::findBlock(VkDeviceSize size)
+{
+    uint32_t freeIndex = std::numeric_limits<uint32_t>::max();
+    for (uint32_t i = 0; i < blocks_.size(); i++)
+    {
+        const auto &block = blocks_[i];
+        if (block.state == BlockState::InUse && block.used + size <= block.size)
+        {
+            return i;
+        }
+        if (block.state == BlockState::Free && block.size >= size && freeIndex == std::numeric_limits<uint32_t>::max())
+        {
+            freeIndex = i;
+        }
+    }
+    return freeIndex;
+}
+
+uint32_t StagingPool::createBlock(VkDeviceSize size)
+{
+    uint32_t index = static_cast<uint32_t>(blocks_.size());
+    for (uint32_t i = 0; i < blocks_.size(); i++)
+    {
+        if (blocks_[i].state == BlockState::Released)
+        {
+            index = i;
+            break;
+        }
+    }
+    if (index == blocks_.size())
+    {
+        blocks_.emplace_back();
+    }
+
+    auto &block = blocks_[index];
+    block.buffer = std::make_unique<Buffer>(device_,
+                                            size,
+                                            1,
+                                            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    block.buffer->map();
+    block.size = size;
+    block.used = 0;
+    block.liveSpans = 0;
+    block.fences.clear();
+    block.state = BlockState::Free;
+
+    stats_.bytesAllocated += size;
+    stats_.blockCount++;
+    stats_.highWaterBytesAllocated = std::max(stats_.highWaterBytesAllocated, stats_.bytesAllocated);
+    stats_.highWaterBlockCount = std::max(stats_.highWaterBlockCount, stats_.blockCount);
+    return index;
+}
+
+void StagingPool::destroyBlock(Block &block)
+{
+    if (block.state == BlockState::Released)
+    {
+        return;
+    }
+
+    stats_.bytesAllocated -= block.size;
+    stats_.blockCount--;
+
+    block.buffer = nullptr;
+    block.size = 0;
+    block.fences.clear();
+    block.state = BlockState::Released;
+}
+
+// Once no span of the block is live or read by the GPU anymore, spans start at its beginning again
+void StagingPool::freeIfUnused(Block &block)
+{
+    if (block.state != BlockState::InUse || block.liveSpans > 0 || !block.fences.empty())
+    {
+        return;
+    }
+    stats_.bytesInUse -= block.used;
+    block.used = 0;
+    block.state = BlockState::Free;
+}
+
+void StagingPool::recycleCompleted()
+{
+    for (auto &block : blocks_)
+    {
+        if (block.state != BlockState::InUse)
+        {
+            continue;
+        }
+        block.fences.erase(std::remove_if(block.fences.begin(),
+                                          block.fences.end(),
+                                          [&](VkFence fence) {
+                                              return vkGetFenceStatus(device_.device(), fence) == VK_SUCCESS;
+                                          }),
+                           block.fences.end());
+        freeIfUnused(block);
+    }
+
+    for (auto &transfer : transfers_)
+    {
+        if (transfer.pending && vkGetFenceStatus(device_.device(), transfer.fence) == VK_SUCCESS)
+        {
+            transfer.pending = false;
+        }
+    }
+}
+
+void StagingPool::shrinkIdle()
+{
+    for (auto &block : blocks_)
+    {
+        if (block.state == BlockState::Free && tick_ - block.lastUsedTick > idleTicksBeforeShrink_)
+        {
+            destroyBlock(block);
+            stats_.shrinkCount++;
+        }
+    }
+}
+
+StagingPool::Transfer &StagingPool::recordingTransfer()
+{
+    if (recording_ == NO_TRANSFER)
+    {
+        recording_ = acquireTransfer();
+        auto &transfer = transfers_[recording_];
+
+        // Unsignaled until the batch completes, which keeps the blocks of its spans from being reused
+        vkResetFences(device_.device(), 1, &transfer.fence);
+        vkResetCommandBuffer(transfer.commandBuffer, 0);
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(transfer.commandBuffer, &beginInfo) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to begin staging command buffer!");
+        }
+    }
+    return transfers_[recording_];
+}
+
+// Waits for a submitted batch to complete if all MAX_TRANSFERS of them are still in flight
+size_t StagingPool::acquireTransfer()
+{
+    if (transfers_.size() == MAX_TRANSFERS)
+    {
+        std::vector<VkFence> fences;
+        for (const auto &transfer : transfers_)
+        {
+            if (!transfer.pending)
+            {
+                fences.clear();
+                break;
+            }
+            fences.push_back(transfer.fence);
+        }
+        if (!fences.empty())
+        {
+            vkWaitForFences(device_.device(),
+                            static_cast<uint32_t>(fences.size()),
+                            fences.data(),
+                            VK_FALSE,
+                            std::numeric_limits<uint64_t>::max());
+            recycleCompleted();
+        }
+    }
+
+    for (size_t i = 0; i < transfers_.size(); i++)
+    {
+        if (!transfers_[i].pending)
+        {
+            return i;
+        }
+    }
+
+    Transfer transfer{};
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = device_.getCommandPool();
+    allocInfo.commandBufferCount = 1;
+
+    if (vkAllocateCommandBuffers(device_.device(), &allocInfo, &transfer.commandBuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate staging command buffer!");
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    if (vkCreateFence(device_.device(), &fenceInfo, nullptr, &transfer.fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create staging fence!");
+    }
+
+    transfers_.push_back(transfer);
+    return transfers_.size() - 1;
+}
@@ -1,5 +1,7 @@
 #include "swap_chain.hpp"
+#include "frame_timeline.hpp"
 
+#include <algorithm>
 #include <array>
 #include <cstdlib>
 #include <cstring>
@@ -8,14 +10,64 @@
 #include <set>
 #include <stdexcept>
 
-SwapChain::SwapChain(Device &deviceRef, VkExtent2D extent) : device{deviceRef}, windowExtent{extent}
+namespace
+{
+// Upper bound for blocking on a present, so an occluded window cannot stall the frame loop
+constexpr uint64_t PRESENT_WAIT_TIMEOUT = 1000ull * 1000ull * 1000ull;
+
+const char *presentModeName(VkPresentModeKHR presentMode)
+{
+    switch (presentMode)
+    {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+        return "Immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+        return "Mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR:
+        return "V-Sync";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+        return "V-Sync (relaxed)";
+    default:
+        return "Unknown";
+    }
+}
+} // namespace
+
+PresentPolicy PresentPolicy::throughput()
+{
+    PresentPolicy policy{};
+    policy.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+    policy.imageCount = 3;
+    policy.maxQueuedFrames = 0;
+    return policy;
+}
+
+PresentPolicy PresentPolicy::lowLatency()
+{
+    PresentPolicy policy{};
+    policy.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+    policy.imageCount = 0;
+    policy.maxQueuedFrames = 1;
+    return policy;
+}
+
+SwapChain::SwapChain(
+  Device &deviceRef, VkExtent2D extent, const PresentPolicy &policy, uint32_t framesInFlight, bool readableDepth)
+  : RenderTarget{framesInFlight}, device{deviceRef}, windowExtent{extent}, policy_{policy},
+    readableDepth_{readableDepth}
 {
     init();
 }
 
-SwapChain::SwapChain(Device &deviceRef, VkExtent2D extent, std::shared_ptr<SwapChain> previous)
-  : device{deviceRef}, windowExtent{extent}, oldSwapChain{previous}
+SwapChain::SwapChain(Device &deviceRef,
+                     VkExtent2D extent,
+                     const PresentPolicy &policy,
+                     uint32_t framesInFlight,
+                     std::shared_ptr<SwapChain> previous)
+  : RenderTarget{framesInFlight}, device{deviceRef}, windowExtent{extent}, oldSwapChain{previous}, policy_{policy},
+    readableDepth_{previous->readableDepth_}
 {
+    presentStats_ = previous->presentStats_;
     init();
     oldSwapChain = nullptr;
 }
@@ -24,9 +76,14 @@ void SwapChain::init()
 {
     createSwapChain();
     createImageViews();
-    createRenderPass();
     createDepthResources();
-    createFramebuffers();
+    // With dynamic rendering the Renderer begins rendering on the image views directly, so recreating
+    // only has to replace the views
+    if (!device.dynamicRenderingEnabled())
+    {
+        createRenderPass();
+        createFramebuffers();
+    }
     createSyncObjects();
 }
 
@@ -44,7 +101,7 @@ SwapChain::~SwapChain()
         swapChain = nullptr;
     }
 
-    for (int i = 0; i < depthImages.size(); i++)
+    for (size_t i = 0; i < depthImages.size(); i++)
     {
         vkDestroyImageView(device.device(), depthImageViews[i], nullptr);
         vkDestroyImage(device.device(), depthImages[i], nullptr);
@@ -56,20 +113,24 @@ SwapChain::~SwapChain()
         vkDestroyFramebuffer(device.device(), framebuffer, nullptr);
     }
 
-    vkDestroyRenderPass(device.device(), renderPass, nullptr);
+    if (renderPass != VK_NULL_HANDLE)
+    {
+        vkDestroyRenderPass(device.device(), renderPass, nullptr);
+    }
 
     // cleanup synchronization objects
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    for (size_t i = 0; i < framesInFlight_; i++)
     {
         vkDestroySemaphore(device.device(), renderFinishedSemaphores[i], nullptr);
         vkDestroySemaphore(device.device(), imageAvailableSemaphores[i], nullptr);
-        vkDestroyFence(device.device(), inFlightFences[i], nullptr);
     }
 }
 
 VkResult SwapChain::acquireNextImage(uint32_t *imageIndex)
 {
-    vkWaitForFences(device.device(), 1, &inFlightFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+    limitQueuedFrames();
+
+    device.frameTimeline().wait(frameValues_[currentFrame]);
 
     VkResult result = vkAcquireNextImageKHR(device.device(),
                                             swapChain,
@@ -83,11 +144,8 @@ VkResult SwapChain::acquireNextImage(uint32_t *imageIndex)
 
 VkResult SwapChain::submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex)
 {
-    if (imagesInFlight[*imageIndex] != VK_NULL_HANDLE)
-    {
-        vkWaitForFences(device.device(), 1, &imagesInFlight[*imageIndex], VK_TRUE, UINT64_MAX);
-    }
-    imagesInFlight[*imageIndex] = inFlightFences[currentFrame];
+    auto &timeline = device.frameTimeline();
+    timeline.wait(imageValues_[*imageIndex]);
 
     VkSubmitInfo submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -105,11 +163,8 @@ VkResult SwapChain::submitCommandBuffers(const VkCommandBuffer *buffers, uint32_
     submitInfo.signalSemaphoreCount = 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
-    vkResetFences(device.device(), 1, &inFlightFences[currentFrame]);
-    if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to submit draw command buffer!");
-    }
+    frameValues_[currentFrame] = timeline.submit(device.graphicsQueue(), submitInfo);
+    imageValues_[*imageIndex] = frameValues_[currentFrame];
 
     VkPresentInfoKHR presentInfo = {};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -123,9 +178,28 @@ VkResult SwapChain::submitCommandBuffers(const VkCommandBuffer *buffers, uint32_
 
     presentInfo.pImageIndices = imageIndex;
 
+    // Ids have to increase with every present to the swap chain, they are what vkWaitForPresentKHR waits on.
+    const uint64_t presentId = presentId_ + 1;
+    VkPresentIdKHR presentIdInfo{};
+    presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+    presentIdInfo.swapchainCount = 1;
+    presentIdInfo.pPresentIds = &presentId;
+    if (device.presentWaitEnabled())
+    {
+        presentInfo.pNext = &presentIdInfo;
+    }
+
+    const auto presentTime = std::chrono::steady_clock::now();
     auto result = vkQueuePresentKHR(device.presentQueue(), &presentInfo);
 
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    presentId_ = presentId;
+    presentStats_.presentedFrames++;
+    if (device.presentWaitEnabled() && (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR))
+    {
+        pendingPresents_.push_back({presentId, presentTime});
+    }
+
+    currentFrame = (currentFrame + 1) % framesInFlight_;
 
     return result;
 }
@@ -138,11 +212,7 @@ void SwapChain::createSwapChain()
     VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
     VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
-    uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
-    if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount)
-    {
-        imageCount = swapChainSupport.capabilities.maxImageCount;
-    }
+    uint32_t imageCount = chooseImageCount(swapChainSupport.capabilities);
 
     VkSwapchainCreateInfoKHR createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -153,7 +223,12 @@ void SwapChain::createSwapChain()
     createInfo.imageColorSpace = surfaceFormat.colorSpace;
     createInfo.imageExtent = extent;
     createInfo.imageArrayLayers = 1;
-    createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    // Transfer destination allows the Renderer to blit a scene rendered at a lower resolution into the image,
+    // transfer source to read it back for captures
+    imageUsage_ =
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (swapChainSupport.capabilities.supportedUsageFlags &
+                                             (VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT));
+    createInfo.imageUsage = imageUsage_;
 
     QueueFamilyIndices indices = device.findPhysicalQueueFamilies();
     uint32_t queueFamilyIndices[] = {indices.graphicsFamily, indices.presentFamily};
@@ -194,6 +269,7 @@ void SwapChain::createSwapChain()
 
     swapChainImageFormat = surfaceFormat.format;
     swapChainExtent = extent;
+    presentMode_ = presentMode;
 }
 
 void SwapChain::createImageViews()
@@ -225,7 +301,8 @@ void SwapChain::createRenderPass()
     depthAttachment.format = findDepthFormat();
     depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
     depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    // Only kept if passes after the scene read it, e.g. the occlusion culling's depth pyramid
+    depthAttachment.storeOp = readableDepth_ ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
     depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -284,10 +361,12 @@ void SwapChain::createRenderPass()
 
 void SwapChain::createFramebuffers()
 {
-    swapChainFramebuffers.resize(imageCount());
-    for (size_t i = 0; i < imageCount(); i++)
+    // One framebuffer per (frame slot, swapchain image) combination, see createDepthResources.
+    swapChainFramebuffers.resize(depthImages.size() * imageCount());
+    for (size_t i = 0; i < swapChainFramebuffers.size(); i++)
     {
-        std::array<VkImageView, 2> attachments = {swapChainImageViews[i], depthImageViews[i]};
+        std::array<VkImageView, 2> attachments = {swapChainImageViews[i % imageCount()],
+                                                  depthImageViews[i / imageCount()]};
 
         VkExtent2D swapChainExtent = getSwapChainExtent();
         VkFramebufferCreateInfo framebufferInfo = {};
@@ -312,11 +391,33 @@ void SwapChain::createDepthResources()
     swapChainDepthFormat = depthFormat;
     VkExtent2D swapChainExtent = getSwapChainExtent();
 
-    depthImages.resize(imageCount());
-    depthImageMemorys.resize(imageCount());
-    depthImageViews.resize(imageCount());
+    // Depth is cleared at the start of the render pass and discarded at its end, or at most read by the
+    // passes recorded after the scene in the same frame, so it only has to exist once per frame that can be
+    // in flight, not once per swapchain image. Unless it is read, it is also transient, which lets tiled GPUs
+    // back it with lazily allocated memory that is never actually committed. For the same reason the previous
+    // swap chain's depth images can be taken over when they are large enough; the frame values taken over in
+    // createSyncObjects keep each slot's image exclusive.
+    if (oldSwapChain != nullptr && oldSwapChain->swapChainDepthFormat == depthFormat &&
+        oldSwapChain->depthImages.size() == framesInFlight_ &&
+        oldSwapChain->depthExtent_.width >= swapChainExtent.width &&
+        oldSwapChain->depthExtent_.height >= swapChainExtent.height)
+    {
+        depthImages = std::move(oldSwapChain->depthImages);
+        depthImageMemorys = std::move(oldSwapChain->depthImageMemorys);
+        depthImageViews = std::move(oldSwapChain->depthImageViews);
+        depthExtent_ = oldSwapChain->depthExtent_;
+        oldSwapChain->depthImages.clear();
+        oldSwapChain->depthImageMemorys.clear();
+        oldSwapChain->depthImageViews.clear();
+        return;
+    }
 
-    for (int i = 0; i < depthImages.size(); i++)
+    depthExtent_ = swapChainExtent;
+    depthImages.resize(framesInFlight_);
+    depthImageMemorys.resize(framesInFlight_);
+    depthImageViews.resize(framesInFlight_);
+
+    for (size_t i = 0; i < depthImages.size(); i++)
     {
         VkImageCreateInfo imageInfo{};
         imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -329,13 +430,18 @@ void SwapChain::createDepthResources()
         imageInfo.format = depthFormat;
         imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
         imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                          (readableDepth_ ? VK_IMAGE_USAGE_SAMPLED_BIT : VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT);
         imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
         imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
         imageInfo.flags = 0;
 
-        device.createImageWithInfo(
-          imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImages[i], depthImageMemorys[i]);
+        const VkMemoryPropertyFlags lazy = readableDepth_ ? 0 : VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+        device.createImageWithInfo(imageInfo,
+                                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | lazy,
+                                   depthImages[i],
+                                   depthImageMemorys[i],
+                                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
         VkImageViewCreateInfo viewInfo{};
         viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -357,23 +463,30 @@ void SwapChain::createDepthResources()
 
 void SwapChain::createSyncObjects()
 {
-    imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-    imagesInFlight.resize(imageCount(), VK_NULL_HANDLE);
+    imageAvailableSemaphores.resize(framesInFlight_);
+    renderFinishedSemaphores.resize(framesInFlight_);
+    imageValues_.resize(imageCount(), 0);
+
+    // Taking over the previous swap chain's frame values keeps the frame slots continuous: waiting on a
+    // slot also covers the frame submitted to the previous swap chain, which is what allows recreating
+    // without idling the device.
+    if (oldSwapChain != nullptr && oldSwapChain->frameValues_.size() == framesInFlight_)
+    {
+        frameValues_ = oldSwapChain->frameValues_;
+        currentFrame = oldSwapChain->currentFrame;
+    }
+    else
+    {
+        frameValues_.resize(framesInFlight_, 0);
+    }
 
     VkSemaphoreCreateInfo semaphoreInfo = {};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    VkFenceCreateInfo fenceInfo = {};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    for (size_t i = 0; i < framesInFlight_; i++)
     {
         if (vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-            vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-            vkCreateFence(device.device(), &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS)
+            vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS)
         {
             throw std::runtime_error("failed to create synchronization objects for a frame!");
         }
@@ -396,24 +509,29 @@ VkSurfaceFormatKHR SwapChain::chooseSwapSurfaceFormat(const std::vector<VkSurfac
 
 VkPresentModeKHR SwapChain::chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes)
 {
-    for (const auto &availablePresentMode : availablePresentModes)
+    auto isAvailable = [&](VkPresentModeKHR presentMode) {
+        return std::find(availablePresentModes.begin(), availablePresentModes.end(), presentMode) !=
+               availablePresentModes.end();
+    };
+
+    // FIFO is the only mode every surface has to support. Mailbox is the closer substitute for immediate.
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    if (isAvailable(policy_.presentMode))
     {
-        if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR)
-        {
-            std::cout << "Present mode: Mailbox" << std::endl;
-            return availablePresentMode;
-        }
+        presentMode = policy_.presentMode;
+    }
+    else if (policy_.presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR && isAvailable(VK_PRESENT_MODE_MAILBOX_KHR))
+    {
+        presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
     }
 
-    // for (const auto &availablePresentMode : availablePresentModes) {
-    //   if (availablePresentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-    //     std::cout << "Present mode: Immediate" << std::endl;
-    //     return availablePresentMode;
-    //   }
-    // }
-
-    std::cout << "Present mode: V-Sync" << std::endl;
-    return VK_PRESENT_MODE_FIFO_KHR;
+    std::cout << "Present mode: " << presentModeName(presentMode);
+    if (presentMode != policy_.presentMode)
+    {
+        std::cout << " (" << presentModeName(policy_.presentMode) << " unsupported)";
+    }
+    std::cout << std::endl;
+    return presentMode;
 }
 
 VkExtent2D SwapChain::chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities)
@@ -434,9 +552,83 @@ VkExtent2D SwapChain::chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilit
     }
 }
 
+uint32_t SwapChain::chooseImageCount(const VkSurfaceCapabilitiesKHR &capabilities)
+{
+    uint32_t imageCount = policy_.imageCount == 0 ? capabilities.minImageCount + 1
+                                                  : std::max(policy_.imageCount, capabilities.minImageCount);
+    if (capabilities.maxImageCount > 0 && imageCount > capabilities.maxImageCount)
+    {
+        imageCount = capabilities.maxImageCount;
+    }
+    return imageCount;
+}
+
+// Blocks until no more than policy_.maxQueuedFrames presented images are waiting to be displayed, so
+// the input sampled for the next frame is at most that many frames old when it reaches the screen.
+void SwapChain::limitQueuedFrames()
+{
+    const uint64_t maxQueuedFrames = policy_.maxQueuedFrames;
+
+    if (!device.presentWaitEnabled())
+    {
+        // Only GPU completion is observable without present wait, so wait for the frame submitted
+        // maxQueuedFrames ago to finish rendering instead. Waiting for the current slot covers the rest.
+        if (maxQueuedFrames > 0 && maxQueuedFrames < framesInFlight_)
+        {
+            const size_t frame = (currentFrame + framesInFlight_ - maxQueuedFrames) % framesInFlight_;
+            device.frameTimeline().wait(frameValues_[frame]);
+        }
+        return;
+    }
+
+    uint64_t blockUntilId = 0;
+    if (maxQueuedFrames > 0 && presentId_ > maxQueuedFrames)
+    {
+        blockUntilId = presentId_ - maxQueuedFrames;
+    }
+    collectPresentLatencies(blockUntilId);
+}
+
+/**
+ * Records the latency of every pending present that has been displayed
+ *
+ * @param blockUntilId Presents up to this id are waited for, later ones are only polled. Polled
+ * presents are noticed once per frame, so their latency is overestimated by up to a frame.
+ */
+void SwapChain::collectPresentLatencies(uint64_t blockUntilId)
+{
+    while (!pendingPresents_.empty())
+    {
+        const auto pending = pendingPresents_.front();
+        const uint64_t timeout = pending.presentId <= blockUntilId ? PRESENT_WAIT_TIMEOUT : 0;
+
+        const VkResult result = device.waitForPresent(swapChain, pending.presentId, timeout);
+        if (result == VK_TIMEOUT)
+        {
+            break;
+        }
+        if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+        {
+            // The swap chain is out of date or lost, nothing pending will be displayed anymore.
+            pendingPresents_.clear();
+            break;
+        }
+        pendingPresents_.pop_front();
+
+        const double latencyMs =
+          std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pending.presentTime).count();
+        presentStats_.measuredFrames++;
+        presentStats_.lastLatencyMs = latencyMs;
+        presentStats_.maxLatencyMs = std::max(presentStats_.maxLatencyMs, latencyMs);
+        presentStats_.averageLatencyMs +=
+          (latencyMs - presentStats_.averageLatencyMs) / static_cast<double>(presentStats_.measuredFrames);
+    }
+}
+
 VkFormat SwapChain::findDepthFormat()
 {
     return device.findSupportedFormat({VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
                                       VK_IMAGE_TILING_OPTIMAL,
-                                      VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+                                      VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                                        (readableDepth_ ? VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT : 0));
 }
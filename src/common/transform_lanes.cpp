@@ -0,0 +1,316 @@
+#include "transform_lanes.hpp"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_LANES_SSE
+#include <emmintrin.h>
+#endif
+
+// Compiled once per instruction set (see transform_lanes_avx.cpp), so nothing in here may use inline
+// functions of other headers: the linker keeps only one of their copies, whichever instruction set it uses.
+namespace
+{
+// The kernel below is written once against these, for whichever instruction set the compiler targets
+#if defined(__AVX__)
+using Lanes = __m256;
+constexpr size_t LANE_COUNT = 8;
+
+Lanes load(const float *p)
+{
+    return _mm256_loadu_ps(p);
+}
+
+void store(float *p, Lanes a)
+{
+    _mm256_storeu_ps(p, a);
+}
+
+Lanes set1(float a)
+{
+    return _mm256_set1_ps(a);
+}
+
+Lanes add(Lanes a, Lanes b)
+{
+    return _mm256_add_ps(a, b);
+}
+
+Lanes sub(Lanes a, Lanes b)
+{
+    return _mm256_sub_ps(a, b);
+}
+
+Lanes mul(Lanes a, Lanes b)
+{
+    return _mm256_mul_ps(a, b);
+}
+
+Lanes div(Lanes a, Lanes b)
+{
+    return _mm256_div_ps(a, b);
+}
+
+Lanes bitAnd(Lanes a, Lanes b)
+{
+    return _mm256_and_ps(a, b);
+}
+
+Lanes bitAndNot(Lanes a, Lanes b)
+{
+    return _mm256_andnot_ps(a, b);
+}
+
+Lanes bitOr(Lanes a, Lanes b)
+{
+    return _mm256_or_ps(a, b);
+}
+
+Lanes bitXor(Lanes a, Lanes b)
+{
+    return _mm256_xor_ps(a, b);
+}
+
+Lanes equal(Lanes a, Lanes b)
+{
+    return _mm256_cmp_ps(a, b, _CMP_EQ_OQ);
+}
+
+Lanes greaterEqual(Lanes a, Lanes b)
+{
+    return _mm256_cmp_ps(a, b, _CMP_GE_OQ);
+}
+
+// Also set where either is NaN
+Lanes notLess(Lanes a, Lanes b)
+{
+    return _mm256_cmp_ps(a, b, _CMP_NLT_UQ);
+}
+
+bool anyLane(Lanes mask)
+{
+    return _mm256_movemask_ps(mask) != 0;
+}
+
+// Exact for non-negative values below 2^31
+Lanes truncate(Lanes a)
+{
+    return _mm256_cvtepi32_ps(_mm256_cvttps_epi32(a));
+}
+#elif defined(TRANSFORM_LANES_SSE)
+using Lanes = __m128;
+constexpr size_t LANE_COUNT = 4;
+
+Lanes load(const float *p)
+{
+    return _mm_loadu_ps(p);
+}
+
+void store(float *p, Lanes a)
+{
+    _mm_storeu_ps(p, a);
+}
+
+Lanes set1(float a)
+{
+    return _mm_set1_ps(a);
+}
+
+Lanes add(Lanes a, Lanes b)
+{
+    return _mm_add_ps(a, b);
+}
+
+Lanes sub(Lanes a, Lanes b)
+{
+    return _mm_sub_ps(a, b);
+}
+
+Lanes mul(Lanes a, Lanes b)
+{
+    return _mm_mul_ps(a, b);
+}
+
+Lanes div(Lanes a, Lanes b)
+{
+    return _mm_div_ps(a, b);
+}
+
+Lanes bitAnd(Lanes a, Lanes b)
+{
+    return _mm_and_ps(a, b);
+}
+
+Lanes bitAndNot(Lanes a, Lanes b)
+{
+    return _mm_andnot_ps(a, b);
+}
+
+Lanes bitOr(Lanes a, Lanes b)
+{
+    return _mm_or_ps(a, b);
+}
+
+Lanes bitXor(Lanes a, Lanes b)
+{
+    return _mm_xor_ps(a, b);
+}
+
+Lanes equal(Lanes a, Lanes b)
+{
+    return _mm_cmpeq_ps(a, b);
+}
+
+Lanes greaterEqual(Lanes a, Lanes b)
+{
+    return _mm_cmpge_ps(a, b);
+}
+
+// Also set where either is NaN
+Lanes notLess(Lanes a, Lanes b)
+{
+    return _mm_cmpnlt_ps(a, b);
+}
+
+bool anyLane(Lanes mask)
+{
+    return _mm_movemask_ps(mask) != 0;
+}
+
+// Exact for non-negative values below 2^31
+Lanes truncate(Lanes a)
+{
+    return _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+}
+#endif
+
+#if defined(__AVX__) || defined(TRANSFORM_LANES_SSE)
+// Largest angle sinCos() reduces correctly
+constexpr float MAX_LANE_ANGLE = 8192.0f;
+
+// Lanes of a where mask is set, of b elsewhere
+Lanes select(Lanes mask, Lanes a, Lanes b)
+{
+    return bitOr(bitAnd(mask, a), bitAndNot(mask, b));
+}
+
+/**
+ * Cephes' sinf and cosf for all lanes at once. The angle is reduced by the nearest multiple of pi/2 with the
+ * octant logic kept in floats, as AVX has no 256-bit integer operations. Accurate for |x| < MAX_LANE_ANGLE,
+ * larger angles overflow the truncation or lose the reduction's precision.
+ */
+void sinCos(Lanes x, Lanes &sin, Lanes &cos)
+{
+    const Lanes signMask = set1(-0.0f);
+    const Lanes sinSign = bitAnd(x, signMask);
+    x = bitAndNot(signMask, x);
+
+    // Octant rounded up to an even one, and which quarter turn that is
+    const Lanes octant = truncate(mul(x, set1(1.27323954473516f)));
+    const Lanes halfOctant = truncate(mul(add(octant, set1(1.0f)), set1(0.5f)));
+    const Lanes evenOctant = add(halfOctant, halfOctant);
+    const Lanes quadrant = sub(halfOctant, mul(set1(4.0f), truncate(mul(halfOctant, set1(0.25f)))));
+
+    // x - evenOctant * pi / 4 in three steps, so the reduction loses no precision
+    x = sub(x, mul(evenOctant, set1(0.78515625f)));
+    x = sub(x, mul(evenOctant, set1(2.4187564849853515625e-4f)));
+    x = sub(x, mul(evenOctant, set1(3.77489497744594108e-8f)));
+    const Lanes z = mul(x, x);
+
+    Lanes cosPolynomial = add(mul(set1(2.443315711809948e-5f), z), set1(-1.388731625493765e-3f));
+    cosPolynomial = add(mul(cosPolynomial, z), set1(4.166664568298827e-2f));
+    cosPolynomial = mul(mul(cosPolynomial, z), z);
+    cosPolynomial = add(sub(cosPolynomial, mul(z, set1(0.5f))), set1(1.0f));
+
+    Lanes sinPolynomial = add(mul(set1(-1.9515295891e-4f), z), set1(8.3321608736e-3f));
+    sinPolynomial = add(mul(sinPolynomial, z), set1(-1.6666654611e-1f));
+    sinPolynomial = add(mul(mul(sinPolynomial, z), x), x);
+
+    // Odd quadrants swap the polynomials, the sine is negative in quadrants 2 and 3, the cosine in 1 and 2
+    const Lanes evenQuadrant = equal(sub(quadrant, mul(set1(2.0f), truncate(mul(quadrant, set1(0.5f))))),
+                                     set1(0.0f));
+    const Lanes sinNegative = greaterEqual(quadrant, set1(2.0f));
+    const Lanes cosNegative = bitAnd(greaterEqual(quadrant, set1(1.0f)), greaterEqual(set1(2.0f), quadrant));
+    sin = bitXor(select(evenQuadrant, sinPolynomial, cosPolynomial),
+                 bitXor(sinSign, bitAnd(sinNegative, signMask)));
+    cos = bitXor(select(evenQuadrant, cosPolynomial, sinPolynomial), bitAnd(cosNegative, signMask));
+}
+
+// Multiplies in the same order as TransformComponent::updateMatrices(), so only the sines and cosines differ
+size_t buildLanes(const TransformLanes &transforms, size_t index, size_t end)
+{
+    const Lanes signMask = set1(-0.0f);
+    const Lanes maxAngle = set1(MAX_LANE_ANGLE);
+    // model matrix columns 0 to 2, then normal matrix columns 0 to 2, three rows each
+    float columns[18][LANE_COUNT];
+    for (; index + LANE_COUNT <= end; index += LANE_COUNT)
+    {
+        const Lanes angles[3] = {load(transforms.rotationY + index),
+                                 load(transforms.rotationX + index),
+                                 load(transforms.rotationZ + index)};
+        if (anyLane(bitOr(notLess(bitAndNot(signMask, angles[0]), maxAngle),
+                          bitOr(notLess(bitAndNot(signMask, angles[1]), maxAngle),
+                                notLess(bitAndNot(signMask, angles[2]), maxAngle)))))
+        {
+            return index;
+        }
+
+        Lanes s1, c1, s2, c2, s3, c3;
+        sinCos(angles[0], s1, c1);
+        sinCos(angles[1], s2, c2);
+        sinCos(angles[2], s3, c3);
+
+        const Lanes rotation[3][3] = {
+          {add(mul(c1, c3), mul(mul(s1, s2), s3)), mul(c2, s3), sub(mul(mul(c1, s2), s3), mul(c3, s1))},
+          {sub(mul(mul(c3, s1), s2), mul(c1, s3)), mul(c2, c3), add(mul(mul(c1, c3), s2), mul(s1, s3))},
+          {mul(c2, s1), bitXor(s2, set1(-0.0f)), mul(c1, c2)},
+        };
+        const Lanes scale[3] = {
+          load(transforms.scaleX + index), load(transforms.scaleY + index), load(transforms.scaleZ + index)};
+
+        for (int column = 0; column < 3; column++)
+        {
+            const Lanes invScale = div(set1(1.0f), scale[column]);
+            for (int row = 0; row < 3; row++)
+            {
+                store(columns[column * 3 + row], mul(scale[column], rotation[column][row]));
+                store(columns[9 + column * 3 + row], mul(invScale, rotation[column][row]));
+            }
+        }
+
+        for (size_t lane = 0; lane < LANE_COUNT; lane++)
+        {
+            const size_t i = index + lane;
+            float *matrix = transforms.matrices + i * 16;
+            float *normalMatrix = transforms.normalMatrices + i * 9;
+            for (int column = 0; column < 3; column++)
+            {
+                for (int row = 0; row < 3; row++)
+                {
+                    matrix[column * 4 + row] = columns[column * 3 + row][lane];
+                    normalMatrix[column * 3 + row] = columns[9 + column * 3 + row][lane];
+                }
+                matrix[column * 4 + 3] = 0.0f;
+            }
+            matrix[12] = transforms.translationX[i];
+            matrix[13] = transforms.translationY[i];
+            matrix[14] = transforms.translationZ[i];
+            matrix[15] = 1.0f;
+        }
+    }
+    return index;
+}
+#endif
+} // namespace
+
+#if defined(__AVX__)
+size_t buildTransformLanesAvx(const TransformLanes &lanes, size_t begin, size_t end)
+{
+    return buildLanes(lanes, begin, end);
+}
+#elif defined(TRANSFORM_LANES_SSE)
+size_t buildTransformLanesSse(const TransformLanes &lanes, size_t begin, size_t end)
+{
+    return buildLanes(lanes, begin, end);
+}
+#endif
@@ -0,0 +1,3 @@
+// The AVX kernel next to the SSE one, for libraries built without USE_AVX. Only this file is compiled with
+// AVX enabled (see CMakeLists.txt), and TransformStore only calls it on CPUs that support AVX.
+#include "transform_lanes.cpp"
@@ -0,0 +1,199 @@
+#include "transform_store.hpp"
+
+// libs
+#include <glm/gtc/type_ptr.hpp>
+
+// std
+#include <algorithm>
+#include <cassert>
+
+// The SSE kernel exists unless the whole library targets AVX. Without USE_AVX, an AVX kernel is built next to
+// it if the compiler can, see src/common/CMakeLists.txt.
+#if defined(__AVX__) || defined(TRANSFORM_STORE_AVX_KERNEL)
+#define TRANSFORM_STORE_AVX
+#endif
+#if !defined(__AVX__) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define TRANSFORM_STORE_SSE
+#endif
+
+TransformStore::TransformStore(WorkerPool &workers, uint32_t threadCount)
+  : workers_{workers}, threadCount_{std::max(1u, std::min(threadCount, workers.getThreadCount()))}
+{
+    ranges_.reserve(getThreadCount());
+    setSimd(getSupportedSimd());
+}
+
+/**
+ * Whether the library has a kernel for the instruction set and the CPU can run it
+ */
+bool TransformStore::isSimdAvailable(Simd simd)
+{
+    switch (simd)
+    {
+    case Simd::Scalar:
+        return true;
+    case Simd::Sse:
+#if defined(TRANSFORM_STORE_SSE)
+        return true;
+#else
+        return false;
+#endif
+    case Simd::Avx:
+#if defined(__AVX__)
+        return true;
+#elif defined(TRANSFORM_STORE_AVX) && (defined(__GNUC__) || defined(__clang__))
+        return __builtin_cpu_supports("avx");
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+TransformStore::Simd TransformStore::getSupportedSimd()
+{
+    if (isSimdAvailable(Simd::Avx))
+    {
+        return Simd::Avx;
+    }
+    return isSimdAvailable(Simd::Sse) ? Simd::Sse : Simd::Scalar;
+}
+
+const char *TransformStore::getSimdName(Simd simd)
+{
+    switch (simd)
+    {
+    case Simd::Sse:
+        return "SSE";
+    case Simd::Avx:
+        return "AVX";
+    default:
+        return "scalar";
+    }
+}
+
+/**
+ * Selects the kernel the matrices are built with, the widest available one by default. Narrower ones are
+ * only useful to compare the kernels.
+ *
+ * @param simd Instruction set, isSimdAvailable() has to be true for it
+ */
+void TransformStore::setSimd(Simd simd)
+{
+    assert(isSimdAvailable(simd) && "Instruction set not available");
+    simd_ = simd;
+    switch (simd)
+    {
+    case Simd::Scalar:
+        kernel_ = nullptr;
+        laneCount_ = 1;
+        break;
+    case Simd::Sse:
+#if defined(TRANSFORM_STORE_SSE)
+        kernel_ = buildTransformLanesSse;
+#endif
+        laneCount_ = 4;
+        break;
+    case Simd::Avx:
+#if defined(TRANSFORM_STORE_AVX)
+        kernel_ = buildTransformLanesAvx;
+#endif
+        laneCount_ = 8;
+        break;
+    }
+}
+
+void TransformStore::clear()
+{
+    transforms_.clear();
+    translationX_.clear();
+    translationY_.clear();
+    translationZ_.clear();
+    rotationX_.clear();
+    rotationY_.clear();
+    rotationZ_.clear();
+    scaleX_.clear();
+    scaleY_.clear();
+    scaleZ_.clear();
+}
+
+/**
+ * Adds a transform whose matrices the next update() builds. It must stay alive and unchanged until then.
+ */
+void TransformStore::add(TransformComponent &transform)
+{
+    transforms_.push_back(&transform);
+    const glm::vec3 &translation = transform.getTranslation();
+    const glm::vec3 &rotation = transform.getRotation();
+    const glm::vec3 &scale = transform.getScale();
+    translationX_.push_back(translation.x);
+    translationY_.push_back(translation.y);
+    translationZ_.push_back(translation.z);
+    rotationX_.push_back(rotation.x);
+    rotationY_.push_back(rotation.y);
+    rotationZ_.push_back(rotation.z);
+    scaleX_.push_back(scale.x);
+    scaleY_.push_back(scale.y);
+    scaleZ_.push_back(scale.z);
+}
+
+/**
+ * Builds the matrices of all transforms added since the last clear() and writes them into the transforms,
+ * which are no longer dirty afterwards. Returns once all ranges are built.
+ */
+void TransformStore::update()
+{
+    const size_t count = size();
+    matrices_.resize(count * 16);
+    normalMatrices_.resize(count * 9);
+
+    const size_t maxRanges = (count + MIN_TRANSFORMS_PER_RANGE - 1) / MIN_TRANSFORMS_PER_RANGE;
+    const size_t rangeCount = std::min<size_t>(getThreadCount(), maxRanges);
+    if (rangeCount <= 1)
+    {
+        buildRange({0, count});
+        return;
+    }
+
+    ranges_.clear();
+    for (size_t i = 0; i < rangeCount; i++)
+    {
+        ranges_.push_back({count * i / rangeCount, count * (i + 1) / rangeCount});
+    }
+    workers_.run(static_cast<uint32_t>(rangeCount), [this](uint32_t thread) { buildRange(ranges_[thread]); });
+}
+
+void TransformStore::buildRange(const Range &range)
+{
+    const TransformLanes lanes{translationX_.data(),
+                               translationY_.data(),
+                               translationZ_.data(),
+                               rotationX_.data(),
+                               rotationY_.data(),
+                               rotationZ_.data(),
+                               scaleX_.data(),
+                               scaleY_.data(),
+                               scaleZ_.data(),
+                               matrices_.data(),
+                               normalMatrices_.data()};
+    size_t index = range.begin;
+    while (index < range.end)
+    {
+        const size_t begin = index;
+        if (kernel_ != nullptr)
+        {
+            index = kernel_(lanes, index, range.end);
+        }
+        for (size_t i = begin; i < index; i++)
+        {
+            transforms_[i]->matrix_ = glm::make_mat4(&matrices_[i * 16]);
+            transforms_[i]->normalMatrix_ = glm::make_mat3(&normalMatrices_[i * 9]);
+            transforms_[i]->dirty_ = false;
+        }
+        // The group the kernel stopped at, or the last transforms that don't fill a group
+        for (const size_t scalarEnd = std::min(range.end, index + laneCount_); index < scalarEnd; index++)
+        {
+            transforms_[index]->updateMatrices();
+        }
+    }
+}
@@ -0,0 +1,125 @@
+#include "worker_pool.hpp"
+
+// std
+#include <cassert>
+#include <stdexcept>
+
+WorkerPool::WorkerPool(uint32_t threadCount)
+{
+    if (threadCount < 1)
+    {
+        throw std::runtime_error("worker pool needs at least one thread!");
+    }
+    for (uint32_t thread = 1; thread < threadCount; thread++)
+    {
+        workers_.emplace_back(&WorkerPool::workLoop, this, thread);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stopping_ = true;
+    }
+    jobStarted_.notify_all();
+    for (auto &worker : workers_)
+    {
+        worker.join();
+    }
+}
+
+/**
+ * Runs task 0 on the calling thread and the others on the workers, and returns once all of them have. If tasks
+ * throw, the exception of task 0 or else of the first task that threw is rethrown then.
+ *
+ * @param taskCount Number of tasks, at most getThreadCount()
+ * @param task Called once per task, concurrently from different threads
+ */
+void WorkerPool::run(uint32_t taskCount, const Task &task)
+{
+    assert(taskCount <= getThreadCount() && "More tasks than threads");
+    if (taskCount == 0)
+    {
+        return;
+    }
+    if (taskCount == 1)
+    {
+        task(0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        task_ = &task;
+        taskCount_ = taskCount;
+        error_ = nullptr;
+        pendingWorkers_ = taskCount - 1;
+        job_++;
+    }
+    jobStarted_.notify_all();
+
+    std::exception_ptr error;
+    try
+    {
+        task(0);
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+
+    std::unique_lock<std::mutex> lock{mutex_};
+    jobFinished_.wait(lock, [this] { return pendingWorkers_ == 0; });
+    task_ = nullptr;
+    if (error == nullptr)
+    {
+        error = error_;
+    }
+    if (error != nullptr)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+void WorkerPool::workLoop(uint32_t thread)
+{
+    uint64_t lastJob = 0;
+    std::unique_lock<std::mutex> lock{mutex_};
+    while (true)
+    {
+        jobStarted_.wait(lock, [&] { return stopping_ || job_ != lastJob; });
+        if (stopping_)
+        {
+            return;
+        }
+        lastJob = job_;
+        // Jobs with fewer tasks than threads leave the last threads idle
+        if (thread >= taskCount_)
+        {
+            continue;
+        }
+
+        const Task &task = *task_;
+        lock.unlock();
+        std::exception_ptr error;
+        try
+        {
+            task(thread);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        lock.lock();
+
+        if (error != nullptr && error_ == nullptr)
+        {
+            error_ = error;
+        }
+        if (--pendingWorkers_ == 0)
+        {
+            jobFinished_.notify_one();
+        }
+    }
+}
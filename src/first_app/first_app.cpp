@@ -1,6 +1,10 @@
+#include <algorithm>
 #include <array>
+#include <cassert>
 #include <chrono>
+#include <iostream>
 #include <stdexcept>
+#include <string>
 
 // libs
 #define GLM_FORCE_RADIANS
@@ -10,24 +14,135 @@
 
 #include "buffer.hpp"
 #include "camera.hpp"
+#include "defragmenter.hpp"
 #include "first_app.hpp"
+#include "gpu_driven_render_system.hpp"
 #include "keyboard_movement_controller.hpp"
 #include "point_light_system.hpp"
+#include "render_queue.hpp"
 #include "simple_render_system.hpp"
 
+namespace
+{
+void printDefragmentationStats(const Defragmenter::Stats &stats)
+{
+    std::cout << "Defragmentation finished after " << stats.endFrame - stats.startFrame << " frames: moved "
+              << stats.movedAllocations << " allocations (" << stats.movedBytes / 1024 << " KiB) out of "
+              << stats.evacuatedBlocks << " blocks" << std::endl;
+    std::cout << "\tbefore: " << stats.before.blockCount << " blocks, " << stats.before.totalBytes / 1024
+              << " KiB reserved, fragmentation " << stats.before.fragmentation() << std::endl;
+    std::cout << "\tafter:  " << stats.after.blockCount << " blocks, " << stats.after.totalBytes / 1024
+              << " KiB reserved, fragmentation " << stats.after.fragmentation() << std::endl;
+}
+
+void printFrameRate(uint64_t frames, float seconds)
+{
+    std::cout << "Rendered " << frames << " frames in " << seconds << " s (" << static_cast<float>(frames) / seconds
+              << " fps)" << std::endl;
+}
+
+void printPresentStats(const PresentStats &stats)
+{
+    std::cout << "Presented " << stats.presentedFrames << " frames";
+    if (stats.measuredFrames > 0)
+    {
+        std::cout << ", present latency avg " << stats.averageLatencyMs << " ms, max " << stats.maxLatencyMs
+                  << " ms over " << stats.measuredFrames << " frames";
+    }
+    std::cout << std::endl;
+}
+
+void printDynamicResolution(const DynamicResolution &dynamicResolution, VkExtent2D renderExtent)
+{
+    std::cout << "Resolution scale " << dynamicResolution.getScale() << " (" << renderExtent.width << "x"
+              << renderExtent.height << ") after " << dynamicResolution.getChangeCount()
+              << " changes, smoothed GPU frame time " << dynamicResolution.getSmoothedFrameMs() << " ms, budget "
+              << dynamicResolution.getSettings().frameBudgetMs << " ms" << std::endl;
+}
+
+void printCaptureStats(const FrameCapture::Stats &stats, const std::string &directory)
+{
+    std::cout << "Captured " << stats.written << " frames to " << directory << " (" << stats.dropped << " dropped, "
+              << stats.failed << " failed)" << std::endl;
+}
+
+void printFrustumCulling(const FrustumCuller &culler)
+{
+    const auto &stats = culler.getStats();
+    std::cout << "Frustum culling (" << FrustumCuller::getSimdName() << ", " << culler.getThreadCount()
+              << " threads) kept " << stats.visible << " of " << stats.tested << " objects in the last frame, culled "
+              << stats.tested - stats.visible << std::endl;
+}
+
+void printRenderQueueStats(const RenderQueue::Stats &stats)
+{
+    std::cout << "Render queue drew " << stats.packets << " packets in the last frame, binds issued of requested: "
+              << stats.issued.pipelines << "/" << stats.requested.pipelines << " pipelines, "
+              << stats.issued.descriptorSets << "/" << stats.requested.descriptorSets << " descriptor sets, "
+              << stats.issued.vertexBuffers << "/" << stats.requested.vertexBuffers << " vertex buffers" << std::endl;
+}
+
+void printGpuCulling(const GpuDrivenRenderSystem &system)
+{
+    std::cout << "GPU culling kept " << system.getVisibleCount() << " of " << system.getObjectCount()
+              << " objects in a recent frame" << std::endl;
+}
+
+void printGpuProfile(const GpuProfiler &profiler)
+{
+    if (!profiler.isSupported())
+    {
+        std::cout << "GPU timestamps are not supported on this queue" << std::endl;
+        return;
+    }
 
-FirstApp::FirstApp()
+    std::cout << "GPU time per frame (ms, last " << GpuProfiler::HISTORY_SIZE << " frames):" << std::endl;
+    for (const auto &scope : profiler.getStats())
+    {
+        std::cout << "\t" << scope.name << ": avg " << scope.averageMs << ", p50 " << scope.p50Ms << ", p95 "
+                  << scope.p95Ms << ", p99 " << scope.p99Ms << std::endl;
+    }
+}
+} // namespace
+
+FirstApp::FirstApp(const Settings &settings)
+  : settings_{settings},
+    window_{settings.headless ? nullptr : std::make_unique<Window>(WIDTH, HEIGHT, "Hello Vulkan!")},
+    device_{window_.get()},
+    workers_{std::max(settings.recordingThreads, settings.cullingThreads)}
 {
+    // Only the occlusion culling's depth pyramid reads the scene's depth after it is drawn
+    const bool readableDepth =
+      settings_.gpuCulling && settings_.occlusionCulling && GpuDrivenRenderSystem::isSupported(device_);
+    if (settings_.headless)
+    {
+        renderer_ = std::make_unique<Renderer>(
+          device_, VkExtent2D{WIDTH, HEIGHT}, settings_.framesInFlight, readableDepth);
+    }
+    else
+    {
+        renderer_ = std::make_unique<Renderer>(
+          *window_, device_, settings_.presentPolicy, settings_.framesInFlight, readableDepth);
+    }
+    renderer_->setRenderGraphDump(settings_.dumpRenderGraph);
+    renderer_->setDynamicResolution(settings_.dynamicResolution);
+    renderer_->setFrameCapture(settings_.capture);
+    renderer_->setRecordingThreads(workers_, settings_.recordingThreads);
+    renderer_->setCommandCaching(settings_.staticScene);
+
+    const uint32_t framesInFlight = renderer_->getFramesInFlight();
     globalPool_ = DescriptorPool::Builder(device_)
-                    .setMaxSets(SwapChain::MAX_FRAMES_IN_FLIGHT)
-                    .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, SwapChain::MAX_FRAMES_IN_FLIGHT)
+                    .setMaxSets(framesInFlight)
+                    .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, framesInFlight)
                     .build();
     loadGameObjects();
 }
 
 void FirstApp::run()
 {
-    std::vector<std::unique_ptr<Buffer>> uboBuffers(SwapChain::MAX_FRAMES_IN_FLIGHT);
+    const uint32_t framesInFlight = renderer_->getFramesInFlight();
+
+    std::vector<std::unique_ptr<Buffer>> uboBuffers(framesInFlight);
     for (int i = 0; i < uboBuffers.size(); i++)
     {
         uboBuffers[i] = std::make_unique<Buffer>(
@@ -39,48 +154,136 @@ void FirstApp::run()
                              .addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS)
                              .build();
 
-    std::vector<VkDescriptorSet> globalDescriptorSets(SwapChain::MAX_FRAMES_IN_FLIGHT);
+    std::vector<VkDescriptorSet> globalDescriptorSets(framesInFlight);
     for (int i = 0; i < globalDescriptorSets.size(); i++)
     {
         auto bufferInfo = uboBuffers[i]->descriptorInfo();
         DescriptorWriter(*globalSetLayout, *globalPool_).writeBuffer(0, &bufferInfo).build(globalDescriptorSets[i]);
     }
 
-    SimpleRenderSystem simpleRenderSystem{
-      device_, renderer_.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout()};
+    SimpleRenderSystem simpleRenderSystem{device_,
+                                          renderer_->getRenderTargetInfo(),
+                                          globalSetLayout->getDescriptorSetLayout(),
+                                          framesInFlight,
+                                          workers_,
+                                          settings_.cullingThreads};
+    simpleRenderSystem.setDepthPrepass(settings_.depthPrepass);
+    std::unique_ptr<GpuDrivenRenderSystem> gpuDrivenRenderSystem;
+    if (settings_.gpuCulling)
+    {
+        if (GpuDrivenRenderSystem::isSupported(device_))
+        {
+            gpuDrivenRenderSystem = std::make_unique<GpuDrivenRenderSystem>(device_,
+                                                                            renderer_->getRenderTargetInfo(),
+                                                                            globalSetLayout->getDescriptorSetLayout(),
+                                                                            framesInFlight,
+                                                                            settings_.occlusionCulling);
+            if (gpuDrivenRenderSystem->isOcclusionCullingEnabled())
+            {
+                assert(renderer_->isDepthReadable() && "Occlusion culling reads the scene's depth");
+                renderer_->setPostScenePasses(
+                  [system = gpuDrivenRenderSystem.get()](RenderGraph &graph, const Renderer::SceneResources &scene) {
+                      system->addOcclusionPasses(graph, scene);
+                  });
+            }
+        }
+        else
+        {
+            std::cout << "GPU culling is not supported, culling on the CPU" << std::endl;
+        }
+    }
     PointLightSystem pointLightSystem{
-      device_, renderer_.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout()};
+      device_, renderer_->getRenderTargetInfo(), globalSetLayout->getDescriptorSetLayout()};
+
+    RenderQueue renderQueue;
+    Defragmenter defragmenter{device_};
 
     Camera camera{};
 
     auto viewerObject = GameObject::createGameObject();
-    viewerObject.transform.translation.z = -2.5f;
+    viewerObject.transform.setTranslation({0.f, 0.f, -2.5f});
     KeyboardMovementController cameraController{};
+    bool depthPrepassKeyDown = false;
 
-    auto currentTime = std::chrono::high_resolution_clock::now();
+    const auto startTime = std::chrono::high_resolution_clock::now();
+    auto currentTime = startTime;
 
-    while (!window_.shouldClose())
+    while (isRunning())
     {
-        glfwPollEvents();
-
         const auto newTime = std::chrono::high_resolution_clock::now();
-        const float frameTime =
-          std::chrono::duration<float, std::chrono::seconds::period>(newTime - currentTime).count();
+        float frameTime = std::chrono::duration<float, std::chrono::seconds::period>(newTime - currentTime).count();
 
-        cameraController.moveInPlaneXZ(window_.getGLFWwindow(), frameTime, viewerObject);
-        camera.setViewYXZ(viewerObject.transform.translation, viewerObject.transform.rotation);
+        if (window_ != nullptr)
+        {
+            // no frames are rendered while minimized, so don't spin
+            if (renderer_->isMinimized())
+            {
+                glfwWaitEventsTimeout(MINIMIZED_EVENT_TIMEOUT);
+            }
+            else
+            {
+                glfwPollEvents();
+            }
+            cameraController.moveInPlaneXZ(window_->getGLFWwindow(), frameTime, viewerObject);
+
+            // toggles once per key press
+            const bool keyDown = glfwGetKey(window_->getGLFWwindow(), DEPTH_PREPASS_KEY) == GLFW_PRESS;
+            if (keyDown && !depthPrepassKeyDown)
+            {
+                simpleRenderSystem.setDepthPrepass(!simpleRenderSystem.isDepthPrepassEnabled());
+                sceneVersion_++;
+                std::cout << "Depth prepass " << (simpleRenderSystem.isDepthPrepassEnabled() ? "on" : "off")
+                          << std::endl;
+            }
+            depthPrepassKeyDown = keyDown;
+        }
+        else
+        {
+            // fixed steps keep headless runs reproducible
+            frameTime = HEADLESS_FRAME_TIME;
+        }
+        camera.setViewYXZ(viewerObject.transform.getTranslation(), viewerObject.transform.getRotation());
 
         currentTime = newTime;
 
-        const auto aspect = renderer_.getAspectRatio();
+        const auto aspect = renderer_->getAspectRatio();
         // camera.setOrthographicProjection(-aspect, aspect, -1, 1, -1, 1);
         camera.setPerspectiveProjection(glm::radians(50.f), aspect, 0.1f, 100.f);
 
-        if (auto commandBuffer = renderer_.beginFrame())
+        if (auto commandBuffer = renderer_->beginFrame())
         {
-            int frameIndex = renderer_.getFrameIndex();
-            FrameInfo frameInfo{
-              frameIndex, frameTime, commandBuffer, camera, globalDescriptorSets[frameIndex], gameObjects_};
+            int frameIndex = renderer_->getFrameIndex();
+            FrameInfo frameInfo{frameIndex,
+                                frameTime,
+                                commandBuffer,
+                                camera,
+                                globalDescriptorSets[frameIndex],
+                                gameObjects_,
+                                &renderer_->getProfiler(),
+                                renderer_->getCommandRecorder(),
+                                renderer_->getRenderExtent()};
+            frameInfo.cachedPass = settings_.staticScene;
+
+            // compact device-local memory a little every frame, outside of the render pass
+            const auto frameNumber = renderer_->getFrameNumber();
+            if (frameNumber % DEFRAGMENT_INTERVAL_FRAMES == 0)
+            {
+                defragmenter.begin(frameNumber);
+            }
+            {
+                GpuProfiler::Scope profilerScope{frameInfo.profiler, commandBuffer, "defragmentation"};
+                const auto bindingGeneration = defragmenter.getBindingGeneration();
+                if (defragmenter.update(commandBuffer, frameNumber))
+                {
+                    printDefragmentationStats(defragmenter.getStats());
+                }
+                // cached passes still bind the buffers' old VkBuffers, which are destroyed soon
+                if (defragmenter.getBindingGeneration() != bindingGeneration)
+                {
+                    sceneVersion_++;
+                }
+            }
+            frameInfo.sceneVersion = sceneVersion_;
 
             // update
             GlobalUbo ubo{};
@@ -91,17 +294,74 @@ void FirstApp::run()
             uboBuffers[frameIndex]->writeToBuffer(&ubo);
             uboBuffers[frameIndex]->flush();
 
-            // render
-            renderer_.beginSwapChainRenderPass(commandBuffer);
+            // render, the queue orders the submitted draws
+            if (gpuDrivenRenderSystem != nullptr)
+            {
+                gpuDrivenRenderSystem->cull(frameInfo);
+            }
 
-            // order here matters
-            simpleRenderSystem.renderGameObjects(frameInfo);
-            pointLightSystem.render(frameInfo);
+            renderer_->beginSwapChainRenderPass(commandBuffer);
+            if (gpuDrivenRenderSystem != nullptr)
+            {
+                gpuDrivenRenderSystem->renderGameObjects(frameInfo);
+            }
+            // a static scene is only submitted again when the frame slot's cached pass is out of date
+            if (!frameInfo.cachedPass || !frameInfo.recorder->replayCached(commandBuffer, sceneVersion_))
+            {
+                renderQueue.clear();
+                if (gpuDrivenRenderSystem == nullptr)
+                {
+                    simpleRenderSystem.submitGameObjects(frameInfo, renderQueue);
+                }
+                pointLightSystem.submit(frameInfo, renderQueue);
+                renderQueue.execute(frameInfo);
+            }
 
-            renderer_.endSwapChainRenderPass(commandBuffer);
-            renderer_.endFrame();
+            renderer_->endSwapChainRenderPass(commandBuffer);
+            renderer_->endFrame();
         }
     }
+
+    vkDeviceWaitIdle(device_.device());
+    // The passes refer to the render system, which goes out of scope
+    renderer_->setPostScenePasses({});
+
+    const float elapsed =
+      std::chrono::duration<float, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - startTime)
+        .count();
+    printFrameRate(renderer_->getFrameNumber(), elapsed);
+    if (!renderer_->isHeadless())
+    {
+        printPresentStats(renderer_->getPresentStats());
+    }
+    if (renderer_->getDynamicResolution().isEnabled())
+    {
+        printDynamicResolution(renderer_->getDynamicResolution(), renderer_->getRenderExtent());
+    }
+    if (auto frameCapture = renderer_->getFrameCapture())
+    {
+        frameCapture->finish();
+        printCaptureStats(frameCapture->getStats(), frameCapture->getSettings().directory);
+    }
+    if (gpuDrivenRenderSystem != nullptr)
+    {
+        printGpuCulling(*gpuDrivenRenderSystem);
+    }
+    else
+    {
+        printFrustumCulling(simpleRenderSystem.getCuller());
+    }
+    printRenderQueueStats(renderQueue.getStats());
+    printGpuProfile(renderer_->getProfiler());
+}
+
+bool FirstApp::isRunning() const
+{
+    if (window_ != nullptr && window_->shouldClose())
+    {
+        return false;
+    }
+    return settings_.frameCount == 0 || renderer_->getFrameNumber() < settings_.frameCount;
 }
 
 void FirstApp::loadGameObjects()
@@ -109,22 +369,22 @@ void FirstApp::loadGameObjects()
     std::shared_ptr<Model> model = Model::createModelFromFile(device_, "models/flat_vase.obj");
     auto flatVase = GameObject::createGameObject();
     flatVase.model = model;
-    flatVase.transform.translation = {-.5f, .5f, 0.0f};
-    flatVase.transform.scale = {3.f, 1.5f, 3.f};
+    flatVase.transform.setTranslation({-.5f, .5f, 0.0f});
+    flatVase.transform.setScale({3.f, 1.5f, 3.f});
     gameObjects_.emplace(flatVase.getId(), std::move(flatVase));
 
     model = Model::createModelFromFile(device_, "models/smooth_vase.obj");
     auto smoothVase = GameObject::createGameObject();
     smoothVase.model = model;
-    smoothVase.transform.translation = {.5f, .5f, 0.0f};
-    smoothVase.transform.scale = {3.f, 1.5f, 3.f};
+    smoothVase.transform.setTranslation({.5f, .5f, 0.0f});
+    smoothVase.transform.setScale({3.f, 1.5f, 3.f});
     gameObjects_.emplace(smoothVase.getId(), std::move(smoothVase));
 
     model = Model::createModelFromFile(device_, "models/quad.obj");
     auto floor = GameObject::createGameObject();
     floor.model = model;
-    floor.transform.translation = {0.f, .5f, 0.f};
-    floor.transform.scale = {3.f, 1.f, 3.f};
+    floor.transform.setTranslation({0.f, .5f, 0.f});
+    floor.transform.setScale({3.f, 1.f, 3.f});
     gameObjects_.emplace(floor.getId(), std::move(floor));
 
     std::vector<glm::vec3> lightColors{
@@ -137,7 +397,8 @@ void FirstApp::loadGameObjects()
         pointLight.color = lightColors[i];
         auto rotateLight =
           glm::rotate(glm::mat4(1.f), (i * glm::two_pi<float>()) / lightColors.size(), {0.f, -1.f, 0.f});
-        pointLight.transform.translation = glm::vec3(rotateLight * glm::vec4(-1.f, -1.f, -1.f, 1.f));
+        pointLight.transform.setTranslation(glm::vec3(rotateLight * glm::vec4(-1.f, -1.f, -1.f, 1.f)));
         gameObjects_.emplace(pointLight.getId(), std::move(pointLight));
     }
+    sceneVersion_++;
 }
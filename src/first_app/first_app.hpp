@@ -8,14 +8,50 @@
 #include <game_object.hpp>
 #include <renderer.hpp>
 #include <window.hpp>
+#include <worker_pool.hpp>
 
 class FirstApp
 {
   public:
     static constexpr int WIDTH = 800;
     static constexpr int HEIGHT = 600;
+    static constexpr uint64_t DEFRAGMENT_INTERVAL_FRAMES = 3600;
+    static constexpr float HEADLESS_FRAME_TIME = 1.f / 60.f;
+    static constexpr double MINIMIZED_EVENT_TIMEOUT = 0.1;
+    // Toggles the depth prepass while running, to compare it with the single pass
+    static constexpr int DEPTH_PREPASS_KEY = GLFW_KEY_P;
 
-    FirstApp();
+    struct Settings
+    {
+        PresentPolicy presentPolicy{};
+        // Render into offscreen images without opening a window, e.g. on machines without a display
+        bool headless = false;
+        // 1 to RenderTarget::MAX_FRAMES_IN_FLIGHT, fewer trades throughput for latency
+        uint32_t framesInFlight = RenderTarget::DEFAULT_FRAMES_IN_FLIGHT;
+        // Threads recording the scene into secondary command buffers, 1 records it on the main thread
+        uint32_t recordingThreads = 1;
+        // Threads testing the objects against the view frustum, 1 culls on the recording thread
+        uint32_t cullingThreads = 1;
+        // Cull and generate the draws in a compute pass, falls back to CPU-side draws where unsupported
+        bool gpuCulling = false;
+        // With gpuCulling, also cull objects hidden behind the ones drawn in the previous frame
+        bool occlusionCulling = false;
+        // Lay down depth before shading so hidden fragments aren't shaded, toggled with DEPTH_PREPASS_KEY
+        bool depthPrepass = false;
+        // Record the scene's draws once per frame slot and replay them until the scene changes, for scenes that
+        // rarely do. Nothing is frustum culled then.
+        bool staticScene = false;
+        // Print the compiled render graph of the passes after the scene whenever it is built
+        bool dumpRenderGraph = false;
+        // Number of frames to render before returning, 0 runs until the window is closed
+        uint64_t frameCount = 0;
+        // Scales the render resolution to keep the GPU frame time within a budget, off by default
+        DynamicResolution::Settings dynamicResolution{};
+        // Writes selected frames to disk, off by default
+        FrameCapture::Settings capture{};
+    };
+
+    explicit FirstApp(const Settings &settings);
     FirstApp(const FirstApp &) = delete;
     FirstApp &operator=(const FirstApp &) = delete;
 
@@ -23,13 +59,19 @@ class FirstApp
 
   private:
     void loadGameObjects();
+    bool isRunning() const;
 
-    Window window_{WIDTH, HEIGHT, "Hello Vulkan!"};
-    Device device_{window_};
-    Renderer renderer_{window_, device_};
+    Settings settings_;
+    std::unique_ptr<Window> window_;
+    Device device_;
+    // Shared by the recording and culling threads, outlives everything that runs on it
+    WorkerPool workers_;
+    std::unique_ptr<Renderer> renderer_;
     // note: order of declarations matters
     std::unique_ptr<DescriptorPool> globalPool_{};
     GameObject::Map gameObjects_;
+    // Bumped whenever what the scene draws changes, cached passes are recorded again then
+    uint64_t sceneVersion_{0};
 };
 
 #endif /* SRC_FIRST_APP_FIRST_APP */
@@ -1,12 +1,337 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <exception>
 #include <iostream>
+#include <string>
+#include <thread>
 
 #include "first_app.hpp"
 
-int main()
+namespace
 {
-    FirstApp app;
+constexpr uint64_t DEFAULT_HEADLESS_FRAMES = 1000;
+
+void printUsage(const char *program)
+{
+    std::cout << "usage: " << program << " [options]\n"
+              << "  --benchmark                 uncapped frame rate, may tear\n"
+              << "  --low-latency               tear-free with at most one queued frame\n"
+              << "  --present-mode MODE         fifo, fifo-relaxed, mailbox or immediate\n"
+              << "  --swapchain-images N        requested number of swap chain images\n"
+              << "  --max-queued-frames N       frames allowed to wait for display, 0 for unlimited\n"
+              << "  --frames-in-flight N        frames recorded ahead of the GPU, 1 to "
+              << RenderTarget::MAX_FRAMES_IN_FLIGHT << " (default: " << RenderTarget::DEFAULT_FRAMES_IN_FLIGHT << ")\n"
+              << "  --recording-threads N       threads recording the scene, 0 for one per core (default: 1)\n"
+              << "  --culling-threads N         threads frustum culling the scene, 0 for one per core (default: 1)\n"
+              << "  --gpu-culling               cull and generate draws on the GPU where supported\n"
+              << "  --occlusion-culling         also cull what is hidden behind nearer objects, implies --gpu-culling\n"
+              << "  --depth-prepass             draw depth first and shade only visible fragments, P toggles it\n"
+              << "  --static-scene              record the scene once and replay it until it changes, no culling\n"
+              << "  --dump-render-graph         print the compiled render graph of the passes after the scene\n"
+              << "  --frame-budget MS           scale the render resolution to keep GPU frame time below MS\n"
+              << "  --min-scale S               lowest resolution scale, 0 < S <= 1 (default: "
+              << DynamicResolution::Settings{}.minScale << ")\n"
+              << "  --capture-every N           write every Nth frame to disk\n"
+              << "  --capture-frames A-B        write frames A to B, every Nth of them with --capture-every\n"
+              << "  --capture-format FORMAT     png or raw (default: png)\n"
+              << "  --capture-dir DIR           directory captures are written to (default: "
+              << FrameCapture::Settings{}.directory << ")\n"
+              << "  --headless                  render offscreen without a window\n"
+              << "  --frames N                  exit after N frames (headless default: " << DEFAULT_HEADLESS_FRAMES
+              << ")" << std::endl;
+}
+
+
+// Digits only, as strtoull would skip leading spaces and wrap a '-' around
+bool parseUnsigned(const std::string &value, uint64_t &number)
+{
+    if (value.empty() || !std::isdigit(static_cast<unsigned char>(value[0])))
+    {
+        return false;
+    }
+    char *end = nullptr;
+    errno = 0;
+    number = std::strtoull(value.c_str(), &end, 10);
+    return *end == '\0' && errno != ERANGE;
+}
+
+bool parseUnsigned(const std::string &value, uint32_t &number)
+{
+    uint64_t wide = 0;
+    if (!parseUnsigned(value, wide) || wide > UINT32_MAX)
+    {
+        return false;
+    }
+    number = static_cast<uint32_t>(wide);
+    return true;
+}
+
+// Plain decimal numbers, no sign, infinity or NaN
+bool parseNonNegative(const std::string &value, double &number)
+{
+    if (value.empty() || (!std::isdigit(static_cast<unsigned char>(value[0])) && value[0] != '.'))
+    {
+        return false;
+    }
+    char *end = nullptr;
+    errno = 0;
+    number = std::strtod(value.c_str(), &end);
+    return *end == '\0' && errno != ERANGE && std::isfinite(number);
+}
+
+// A-B or a single frame A
+bool parseFrameRange(const std::string &range, uint64_t &first, uint64_t &last)
+{
+    const size_t dash = range.find('-');
+    if (dash == std::string::npos)
+    {
+        if (!parseUnsigned(range, first))
+        {
+            return false;
+        }
+        last = first;
+        return true;
+    }
+    return parseUnsigned(range.substr(0, dash), first) && parseUnsigned(range.substr(dash + 1), last) &&
+           first <= last;
+}
+
+// A count of 0 would mean no limit, which a headless run could never leave
+bool parseFrameCount(const std::string &value, uint64_t &count)
+{
+    return parseUnsigned(value, count) && count > 0;
+}
+
+bool parsePresentMode(const std::string &name, VkPresentModeKHR &presentMode)
+{
+    if (name == "fifo")
+    {
+        presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    }
+    else if (name == "fifo-relaxed")
+    {
+        presentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+    }
+    else if (name == "mailbox")
+    {
+        presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+    }
+    else if (name == "immediate")
+    {
+        presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+// Presets are applied first, so individual options can refine them
+bool parseSettings(int argc, char **argv, FirstApp::Settings &settings)
+{
+    auto &policy = settings.presentPolicy;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--benchmark") == 0)
+        {
+            policy = PresentPolicy::throughput();
+        }
+        else if (strcmp(argv[i], "--low-latency") == 0)
+        {
+            policy = PresentPolicy::lowLatency();
+        }
+    }
+
+    bool hasFrameCount = false;
+    bool hasCaptureRange = false;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--benchmark" || arg == "--low-latency")
+        {
+            continue;
+        }
+        if (arg == "--headless")
+        {
+            settings.headless = true;
+            continue;
+        }
+        if (arg == "--gpu-culling")
+        {
+            settings.gpuCulling = true;
+            continue;
+        }
+        if (arg == "--occlusion-culling")
+        {
+            settings.gpuCulling = true;
+            settings.occlusionCulling = true;
+            continue;
+        }
+        if (arg == "--depth-prepass")
+        {
+            settings.depthPrepass = true;
+            continue;
+        }
+        if (arg == "--static-scene")
+        {
+            settings.staticScene = true;
+            continue;
+        }
+        if (arg == "--dump-render-graph")
+        {
+            settings.dumpRenderGraph = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            return false;
+        }
+
+        const std::string value = argv[++i];
+        if (arg == "--present-mode")
+        {
+            if (!parsePresentMode(value, policy.presentMode))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--swapchain-images")
+        {
+            if (!parseUnsigned(value, policy.imageCount))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--max-queued-frames")
+        {
+            if (!parseUnsigned(value, policy.maxQueuedFrames))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--frames-in-flight")
+        {
+            if (!parseUnsigned(value, settings.framesInFlight) || settings.framesInFlight < 1 ||
+                settings.framesInFlight > RenderTarget::MAX_FRAMES_IN_FLIGHT)
+            {
+                return false;
+            }
+        }
+        else if (arg == "--recording-threads")
+        {
+            if (!parseUnsigned(value, settings.recordingThreads))
+            {
+                return false;
+            }
+            if (settings.recordingThreads == 0)
+            {
+                settings.recordingThreads = std::max(1u, std::thread::hardware_concurrency());
+            }
+        }
+        else if (arg == "--culling-threads")
+        {
+            if (!parseUnsigned(value, settings.cullingThreads))
+            {
+                return false;
+            }
+            if (settings.cullingThreads == 0)
+            {
+                settings.cullingThreads = std::max(1u, std::thread::hardware_concurrency());
+            }
+        }
+        else if (arg == "--frame-budget")
+        {
+            if (!parseNonNegative(value, settings.dynamicResolution.frameBudgetMs))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--min-scale")
+        {
+            double minScale = 0.0;
+            if (!parseNonNegative(value, minScale) || minScale <= 0.0 || minScale > 1.0)
+            {
+                return false;
+            }
+            settings.dynamicResolution.minScale = static_cast<float>(minScale);
+        }
+        else if (arg == "--capture-every")
+        {
+            if (!parseUnsigned(value, settings.capture.interval) || settings.capture.interval == 0)
+            {
+                return false;
+            }
+        }
+        else if (arg == "--capture-frames")
+        {
+            if (!parseFrameRange(value, settings.capture.firstFrame, settings.capture.lastFrame))
+            {
+                return false;
+            }
+            hasCaptureRange = true;
+        }
+        else if (arg == "--capture-format")
+        {
+            if (value == "png")
+            {
+                settings.capture.format = CaptureFormat::Png;
+            }
+            else if (value == "raw")
+            {
+                settings.capture.format = CaptureFormat::Raw;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        else if (arg == "--capture-dir")
+        {
+            settings.capture.directory = value;
+        }
+        else if (arg == "--frames")
+        {
+            if (!parseFrameCount(value, settings.frameCount))
+            {
+                return false;
+            }
+            hasFrameCount = true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    if (settings.headless && !hasFrameCount)
+    {
+        settings.frameCount = DEFAULT_HEADLESS_FRAMES;
+    }
+    // A range alone captures each of its frames
+    if (hasCaptureRange && settings.capture.interval == 0)
+    {
+        settings.capture.interval = 1;
+    }
+    return true;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    FirstApp::Settings settings{};
+    if (!parseSettings(argc, argv, settings))
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FirstApp app{settings};
 
     try
     {
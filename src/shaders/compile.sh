@@ -3,6 +3,12 @@ cd "${0%/*}"
 
 /usr/local/bin/glslc simple_shaders/simple_shader.vert -o simple_shaders/simple_shader.vert.spv
 /usr/local/bin/glslc simple_shaders/simple_shader.frag -o simple_shaders/simple_shader.frag.spv
+/usr/local/bin/glslc simple_shaders/depth_only.vert -o simple_shaders/depth_only.vert.spv
+/usr/local/bin/glslc simple_shaders/simple_shader_indirect.vert -o simple_shaders/simple_shader_indirect.vert.spv
+/usr/local/bin/glslc simple_shaders/gpu_cull.comp -o simple_shaders/gpu_cull.comp.spv
+/usr/local/bin/glslc -DEARLY_PHASE simple_shaders/gpu_cull.comp -o simple_shaders/gpu_cull_early.comp.spv
+/usr/local/bin/glslc -DLATE_PHASE simple_shaders/gpu_cull.comp -o simple_shaders/gpu_cull_late.comp.spv
+/usr/local/bin/glslc simple_shaders/hi_z_build.comp -o simple_shaders/hi_z_build.comp.spv
 
 /usr/local/bin/glslc simple_shaders/point_light.vert -o simple_shaders/point_light.vert.spv
 /usr/local/bin/glslc simple_shaders/point_light.frag -o simple_shaders/point_light.frag.spv
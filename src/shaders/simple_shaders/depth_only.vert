@@ -0,0 +1,41 @@
+#version 450
+layout(location = 0) in vec3 position;
+
+// must match simple_shader.vert bit for bit, the color pass tests depth for EQUAL
+invariant gl_Position;
+
+struct PointLight
+{
+    vec4 position; // ignore w
+    vec4 color; // w is intensity
+};
+
+layout(set = 0, binding = 0) uniform GlobalUbo
+{
+    mat4 projection;
+    mat4 view;
+    mat4 invView;
+    vec4 ambientLightColor; // w is intensity
+    PointLight pointLights[10];
+    int numLights;
+}
+ubo;
+
+struct ObjectData
+{
+    mat4 modelMatrix;
+    mat3 normalMatrix;
+};
+
+// the draws pass the index of their first object as firstInstance
+layout(std430, set = 1, binding = 0) readonly buffer Objects
+{
+    ObjectData objects[];
+};
+
+void main()
+{
+    ObjectData object = objects[gl_InstanceIndex];
+    vec4 positionWorld = object.modelMatrix * vec4(position, 1.0);
+    gl_Position = ubo.projection * ubo.view * positionWorld;
+}
@@ -20,10 +20,10 @@ layout(set = 0, binding = 0) uniform GlobalUbo
 }
 ubo;
 
+// the light's position and color change every frame, they are read from the ubo
 layout(push_constant) uniform Push
 {
-    vec4 position;
-    vec4 color;
+    int lightIndex;
     float radius;
 }
 push;
@@ -39,5 +39,5 @@ void main()
     }
 
     float cosDis = 0.5 * (cos(dis * M_PI) + 1.0); // ranges from 1 -> 0
-    outColor = vec4(push.color.xyz + 0.5 * cosDis, cosDis);
+    outColor = vec4(ubo.pointLights[push.lightIndex].color.xyz + 0.5 * cosDis, cosDis);
 }
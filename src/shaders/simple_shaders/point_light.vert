@@ -22,10 +22,10 @@ layout(set = 0, binding = 0) uniform GlobalUbo
 }
 ubo;
 
+// the light's position and color change every frame, they are read from the ubo
 layout(push_constant) uniform Push
 {
-    vec4 position;
-    vec4 color;
+    int lightIndex;
     float radius;
 }
 push;
@@ -36,8 +36,9 @@ void main()
     vec3 cameraRightWorld = {ubo.view[0][0], ubo.view[1][0], ubo.view[2][0]};
     vec3 cameraUpWorld = {ubo.view[0][1], ubo.view[1][1], ubo.view[2][1]};
 
+    vec3 lightPosition = ubo.pointLights[push.lightIndex].position.xyz;
     vec3 positionWorld =
-      push.position.xyz + push.radius * fragOffset.x * cameraRightWorld + push.radius * fragOffset.y * cameraUpWorld;
+      lightPosition + push.radius * fragOffset.x * cameraRightWorld + push.radius * fragOffset.y * cameraUpWorld;
 
     gl_Position = ubo.projection * ubo.view * vec4(positionWorld, 1.0);
 }
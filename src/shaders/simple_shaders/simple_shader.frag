@@ -23,13 +23,6 @@ layout(set = 0, binding = 0) uniform GlobalUbo
 }
 ubo;
 
-layout(push_constant) uniform Push
-{
-    mat4 modelMatrix;
-    mat4 normalMatrix;
-}
-push;
-
 void main()
 {
     vec3 diffuseLight = ubo.ambientLightColor.xyz * ubo.ambientLightColor.w;
@@ -8,6 +8,9 @@ layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec3 fragPosWorld;
 layout(location = 2) out vec3 fragNormalWorld;
 
+// the depth prepass computes the same position, the EQUAL depth test needs it bit for bit
+invariant gl_Position;
+
 struct PointLight
 {
     vec4 position; // ignore w
@@ -25,18 +28,24 @@ layout(set = 0, binding = 0) uniform GlobalUbo
 }
 ubo;
 
-layout(push_constant) uniform Push
+struct ObjectData
 {
     mat4 modelMatrix;
-    mat4 normalMatrix;
-}
-push;
+    mat3 normalMatrix;
+};
+
+// the draws pass the index of their first object as firstInstance
+layout(std430, set = 1, binding = 0) readonly buffer Objects
+{
+    ObjectData objects[];
+};
 
 void main()
 {
-    vec4 positionWorld = push.modelMatrix * vec4(position, 1.0);
+    ObjectData object = objects[gl_InstanceIndex];
+    vec4 positionWorld = object.modelMatrix * vec4(position, 1.0);
     gl_Position = ubo.projection * ubo.view * positionWorld;
-    fragNormalWorld = normalize(mat3(push.normalMatrix) * normal);
+    fragNormalWorld = normalize(object.normalMatrix * normal);
     fragPosWorld = positionWorld.xyz;
     fragColor = color;
 }
@@ -0,0 +1,167 @@
+#include "game_object.hpp"
+#include "transform_store.hpp"
+#include "worker_pool.hpp"
+
+// std
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <vector>
+
+// Compares the matrices TransformStore builds with each kernel the library has and the CPU can run against the
+// ones TransformComponent builds with glm::sin and glm::cos.
+namespace
+{
+// The kernel's sines and cosines are within one ulp of libm's. Each rotation element sums up to two products
+// of three of them, each of which can be three ulps off, and scaling adds one more rounding. The error is
+// measured in ulps of the column's scale (or its inverse for the normal matrix), the largest magnitude any
+// element of the column can have. A million random transforms stayed within 4 ulps.
+constexpr float MAX_ULPS = 8.0f;
+
+// Per group of lanes, so the counts below cover whole groups, partial groups left to the scalar loop, and both
+constexpr size_t COUNTS[] = {1, 3, 4, 5, 7, 8, 9, 12, 15, 16, 17, 25, 31, 33};
+
+float ulp(float x)
+{
+    x = std::fabs(x);
+    return std::nextafter(x, std::numeric_limits<float>::infinity()) - x;
+}
+
+struct Checker
+{
+    const char *testCase;
+    size_t failures = 0;
+    float maxUlps = 0.0f;
+
+    void compare(float actual, float expected, float magnitude, size_t index, const char *matrix)
+    {
+        const float ulps = std::fabs(actual - expected) / ulp(magnitude);
+        if (ulps > maxUlps)
+        {
+            maxUlps = ulps;
+        }
+        if (!(ulps <= MAX_ULPS) && failures++ < 10)
+        {
+            std::cerr << testCase << ": " << matrix << " of transform " << index << " is " << actual
+                      << " instead of " << expected << " (" << ulps << " ulps)" << std::endl;
+        }
+    }
+
+    void compare(const TransformComponent &actual, const TransformComponent &expected, size_t index)
+    {
+        if (actual.isDirty())
+        {
+            failures++;
+            std::cerr << testCase << ": transform " << index << " is still dirty" << std::endl;
+            return;
+        }
+        const glm::mat4 &matrix = actual.mat4();
+        const glm::mat3 &normalMatrix = actual.normalMatrix();
+        const glm::mat4 &expectedMatrix = expected.mat4();
+        const glm::mat3 &expectedNormalMatrix = expected.normalMatrix();
+        for (int column = 0; column < 3; column++)
+        {
+            const float scale = expected.getScale()[column];
+            for (int row = 0; row < 3; row++)
+            {
+                compare(matrix[column][row], expectedMatrix[column][row], scale, index, "matrix");
+                compare(normalMatrix[column][row], expectedNormalMatrix[column][row], 1.0f / scale, index, "normal");
+            }
+            compare(matrix[column][3], expectedMatrix[column][3], 1.0f, index, "matrix");
+        }
+        for (int row = 0; row < 4; row++)
+        {
+            compare(matrix[3][row], expectedMatrix[3][row], expectedMatrix[3][row], index, "translation");
+        }
+    }
+};
+
+// Random transforms, angles within a few turns and scales of either sign
+std::vector<TransformComponent> makeTransforms(size_t count, std::mt19937 &random)
+{
+    std::uniform_real_distribution<float> angle{-12.0f, 12.0f};
+    std::uniform_real_distribution<float> scale{0.1f, 10.0f};
+    std::uniform_real_distribution<float> translation{-100.0f, 100.0f};
+    std::bernoulli_distribution negative{0.2};
+    std::vector<TransformComponent> transforms(count);
+    for (auto &transform : transforms)
+    {
+        transform.setTranslation({translation(random), translation(random), translation(random)});
+        transform.setRotation({angle(random), angle(random), angle(random)});
+        transform.setScale({negative(random) ? -scale(random) : scale(random), scale(random), scale(random)});
+    }
+    return transforms;
+}
+
+bool run(const char *testCase,
+         TransformStore::Simd simd,
+         WorkerPool &workers,
+         std::vector<TransformComponent> expected)
+{
+    std::vector<TransformComponent> actual = expected;
+    TransformStore store{workers, workers.getThreadCount()};
+    store.setSimd(simd);
+    for (auto &transform : actual)
+    {
+        store.add(transform);
+    }
+    store.update();
+
+    Checker checker{testCase};
+    for (size_t i = 0; i < actual.size(); i++)
+    {
+        checker.compare(actual[i], expected[i], i);
+    }
+    std::cout << TransformStore::getSimdName(simd) << " " << testCase << ": " << actual.size()
+              << " transforms, at most " << checker.maxUlps << " ulps" << std::endl;
+    return checker.failures == 0;
+}
+
+bool runAll(TransformStore::Simd simd)
+{
+    std::mt19937 random{42};
+    WorkerPool singleThread{1};
+    bool passed = true;
+    for (size_t count : COUNTS)
+    {
+        passed &= run("lanes and tail", simd, singleThread, makeTransforms(count, random));
+    }
+
+    // Angles the kernel can't reduce send their group to the scalar path, the groups around it stay on the lanes
+    auto largeAngles = makeTransforms(33, random);
+    const float angles[] = {8191.0f, 8192.0f, -8192.0f, 1.0e5f, -3.0e9f, 1.0e30f};
+    for (size_t i = 0; i < std::size(angles); i++)
+    {
+        auto rotation = largeAngles[i * 5].getRotation();
+        rotation[static_cast<int>(i % 3)] = angles[i];
+        largeAngles[i * 5].setRotation(rotation);
+    }
+    passed &= run("large angles", simd, singleThread, largeAngles);
+
+    // Enough for several ranges, whose boundaries don't fall on whole groups
+    WorkerPool workers{3};
+    passed &= run(
+      "ranges", simd, workers, makeTransforms(3 * TransformStore::MIN_TRANSFORMS_PER_RANGE + 5, random));
+    return passed;
+}
+} // namespace
+
+int main()
+{
+    bool passed = true;
+    for (auto simd : {TransformStore::Simd::Scalar, TransformStore::Simd::Sse, TransformStore::Simd::Avx})
+    {
+        if (TransformStore::isSimdAvailable(simd))
+        {
+            passed &= runAll(simd);
+        }
+        else
+        {
+            std::cout << TransformStore::getSimdName(simd) << " not available, skipped" << std::endl;
+        }
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}